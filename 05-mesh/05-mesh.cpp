@@ -1,21 +1,109 @@
+#include <cstddef>
+#include <cassert>
 #include "../framework/vulkanApp.h"
-#include "quadric/include/teapot.h"
+#include "../framework/bezierMesh.h"
+#include "../framework/teapot.h"
+#include "../framework/storageBuffers.h"
+#include "../framework/cullingScene.h"
+#include "../framework/threadPool.h"
+#include "../framework/meshSimplifier.h"
+#include "instanceField.h"
 
+// Frame time of stress test should be bound by GPU, otherwise it is limited by fps cap
+constexpr uint32_t instanceCount = 10000;
+// Instances are animated and culled by compute shader, so CPU cost doesn't depend on count
+constexpr uint32_t gpuInstanceCount = 100000;
+constexpr uint32_t cullGroupSize = 64; // Should match local_size_x of cull.comp
+// Use Up/Down to change size of CPU-culled scene
+constexpr uint32_t sceneSizes[] = {10000, 100000, 1000000};
+constexpr uint32_t lodCount = 4;
+constexpr float fieldEye[3] = {0.f, 90.f, 150.f};
+constexpr float statisticsInterval = 2000.f; // ms
+
+// Use Space to switch between single mesh, instanced stress test,
+// stress test with separate draw call per instance, GPU-culled
+// stress test, where compute shader writes indirect draw command,
+// and CPU-culled scene, where visible instances are found using BVH
+// and drawn with level of detail selected by projected size.
 class MeshApp : public VulkanApp
 {
+    enum class Mode : uint32_t
+    {
+        Single = 0, Instanced, DrawPerInstance, GpuCulled, CpuCulled,
+        Count
+    };
+
     struct DescriptorSetTable : magma::DescriptorSetTable
     {
-        magma::descriptor::UniformBuffer worldViewProj = 0;
-        MAGMA_REFLECT(worldViewProj)
+        magma::descriptor::UniformBuffer transforms = 0;
+        MAGMA_REFLECT(transforms)
     } setTable;
 
-    std::unique_ptr<quadric::Teapot> mesh;
-    std::shared_ptr<magma::UniformBuffer<rapid::matrix>> uniformBuffer;
+    // Matches uniform block of instanced.vert, transform.vert reads only the first matrix
+    struct Transforms
+    {
+        rapid::matrix worldViewProj; // View-projection for instances
+        rapid::matrix dequantization;
+    };
+
+    struct CullDescriptorSetTable : magma::DescriptorSetTable
+    {
+        magma::descriptor::UniformBuffer parameters = 0;
+        magma::descriptor::StorageBuffer instances = 1;
+        magma::descriptor::StorageBuffer visibleInstances = 2;
+        magma::descriptor::StorageBuffer drawCommand = 3;
+        MAGMA_REFLECT(parameters, instances, visibleInstances, drawCommand)
+    } cullSetTable;
+
+    // Matches uniform block of cull.comp
+    struct CullParameters
+    {
+        rapid::matrix viewProj;
+        rapid::float4 boundingSphere;
+        float time;
+        float scale;
+        uint32_t objectCount;
+    };
+
+    std::unique_ptr<BezierPatchMesh> mesh;
+    std::unique_ptr<InstanceField> instanceField;
+    std::shared_ptr<magma::DynamicVertexBuffer> instanceBuffers[2]; // Per frame in flight
+    std::unique_ptr<InstanceField> gpuInstanceField;
+    std::shared_ptr<magma::StorageBuffer> instanceParameters;
+    std::shared_ptr<StorageVertexBuffer> visibleInstances;
+    std::shared_ptr<StorageIndirectBuffer> drawCommand;
+    std::shared_ptr<magma::UniformBuffer<CullParameters>> cullUniforms;
+    std::shared_ptr<magma::DescriptorSet> cullDescriptorSet;
+    std::shared_ptr<magma::PipelineLayout> cullPipelineLayout;
+    std::shared_ptr<magma::ComputePipeline> cullPipeline;
+    std::unique_ptr<ThreadPool> threadPool;
+    std::unique_ptr<InstanceField> sceneField;
+    CullingScene scene;
+    std::vector<uint32_t> visibleObjects;
+    std::vector<uint32_t> sortedObjects; // Visible objects grouped by LOD
+    std::vector<uint8_t> objectLods; // Selected on previous frame, for hysteresis
+    uint32_t lodInstanceCounts[lodCount] = {};
+    std::shared_ptr<magma::DynamicVertexBuffer> visibleInstanceBuffers[2]; // Per frame in flight
+    uint32_t visibleInstanceCapacity = 0;
+    uint32_t sceneSizeIndex = 0;
+    uint32_t visibleInstanceCount = 0;
+    CullingScene::Statistics cullStatistics;
+    Timer cullTimer;
+    float cullTime = 0.f;
+    std::shared_ptr<magma::UniformBuffer<Transforms>> uniformBuffer;
     std::shared_ptr<magma::DescriptorSet> descriptorSet;
     std::shared_ptr<magma::PipelineLayout> pipelineLayout;
     std::shared_ptr<magma::GraphicsPipeline> wireframePipeline;
+    std::shared_ptr<magma::GraphicsPipeline> instancedPipeline;
 
     rapid::matrix viewProj;
+    rapid::matrix fieldViewProj;
+    float focalLength = 0.f; // In pixels
+    Mode mode = Mode::Single;
+    bool rebuildCommandBuffers = false;
+    float angle = 0.f;
+    float statisticsTime = 0.f;
+    uint32_t statisticsFrames = 0;
 
 public:
     MeshApp(const AppEntry& entry):
@@ -24,9 +112,12 @@ public:
         initialize();
         setupView();
         createMesh();
+        createInstances();
+        createScene();
         createUniformBuffer();
         setupDescriptorSet();
         setupPipeline();
+        setupCullPipeline();
         recordCommandBuffer(FrontBuffer);
         recordCommandBuffer(BackBuffer);
         timer->run();
@@ -34,8 +125,62 @@ public:
 
     virtual void render(uint32_t bufferIndex) override
     {
-        updatePerspectiveTransform();
+        if (rebuildCommandBuffers)
+        {
+            waitFences[1 - bufferIndex]->wait();
+            recordCommandBuffer(FrontBuffer);
+            recordCommandBuffer(BackBuffer);
+            rebuildCommandBuffers = false;
+        }
+        const float dt = timer->millisecondsElapsed();
+        updatePerspectiveTransform(dt);
+        if (Mode::GpuCulled == mode)
+            updateCullParameters();
+        else if (Mode::CpuCulled == mode)
+        {   // Command buffer and instance buffer of this frame have been released by fence, so it is safe to rewrite them
+            cullScene(bufferIndex);
+            recordCommandBuffer(bufferIndex);
+        }
+        else if (mode != Mode::Single)
+            updateInstances(bufferIndex);
         submitCommandBuffer(bufferIndex);
+        updateStatistics(dt);
+    }
+
+    virtual void onKeyDown(char key, int repeat, uint32_t flags) override
+    {
+        if (AppKey::Space == key)
+        {
+            mode = static_cast<Mode>((static_cast<uint32_t>(mode) + 1) % static_cast<uint32_t>(Mode::Count));
+            rebuildCommandBuffers = true;
+            statisticsTime = 0.f;
+            statisticsFrames = 0;
+            std::cout << "Mode: " << getModeName() << std::endl;
+        }
+        else if ((AppKey::Up == key || AppKey::Down == key) && (Mode::CpuCulled == mode))
+        {
+            const uint32_t sizeCount = sizeof(sceneSizes)/sizeof(sceneSizes[0]);
+            if (AppKey::Up == key)
+                sceneSizeIndex = std::min(sceneSizeIndex + 1, sizeCount - 1);
+            else if (sceneSizeIndex > 0)
+                --sceneSizeIndex;
+            createScene();
+            statisticsTime = 0.f;
+            statisticsFrames = 0;
+        }
+        VulkanApp::onKeyDown(key, repeat, flags);
+    }
+
+    const char *getModeName() const noexcept
+    {
+        switch (mode)
+        {
+        case Mode::Instanced: return "instanced";
+        case Mode::DrawPerInstance: return "draw per instance";
+        case Mode::GpuCulled: return "GPU culled";
+        case Mode::CpuCulled: return "CPU culled";
+        default: return "single";
+        }
     }
 
     void setupView()
@@ -49,38 +194,240 @@ public:
         const rapid::matrix view = rapid::lookAtRH(eye, center, up);
         const rapid::matrix proj = rapid::perspectiveFovRH(fov, aspect, zn, zf);
         viewProj = view * proj;
+        // Overview of the whole instance field
+        const rapid::vector3 fieldCenter(0.f, 0.f, 10.f);
+        const rapid::vector3 fieldEyePosition(fieldEye[0], fieldEye[1], fieldEye[2]);
+        const rapid::matrix fieldView = rapid::lookAtRH(fieldEyePosition, fieldCenter, up);
+        const rapid::matrix fieldProj = rapid::perspectiveFovRH(fov, aspect, zn, 500.f);
+        fieldViewProj = fieldView * fieldProj;
+        focalLength = height * .5f/tanf(fov * .5f);
     }
 
-    void updatePerspectiveTransform()
+    void updatePerspectiveTransform(float dt)
     {
         constexpr float speed = 0.05f;
-        static float angle = 0.f;
-        angle += timer->millisecondsElapsed() * speed;
-        const rapid::matrix world = rapid::rotationY(rapid::radians(angle));
+        angle += dt * speed;
+        const rapid::matrix zUpToYUp = rapid::rotationX(rapid::radians(-90.f));
+        const rapid::matrix world = zUpToYUp * rapid::rotationY(rapid::radians(angle));
         magma::helpers::mapScoped(uniformBuffer,
-            [this, &world](auto *worldViewProj)
+            [this, &world](auto *transforms)
+            {   // Instances have their own world transforms, so they decode positions in vertex shader
+                const rapid::matrix& dequantization = mesh->getDequantizationMatrix();
+                if (Mode::Single == mode)
+                    transforms->worldViewProj = dequantization * world * viewProj;
+                else
+                    transforms->worldViewProj = fieldViewProj;
+                transforms->dequantization = dequantization;
+            });
+    }
+
+    void updateInstances(uint32_t index)
+    {   // Fence of this frame has been waited, so GPU doesn't read its buffer anymore
+        const float time = rapid::radians(angle);
+        magma::helpers::mapScoped<InstanceData>(instanceBuffers[index],
+            [this, time](InstanceData *instances)
             {
-                *worldViewProj = world * viewProj;
+                instanceField->update(time, instances);
             });
     }
 
+    void updateCullParameters()
+    {
+        const float time = rapid::radians(angle);
+        magma::helpers::mapScoped(cullUniforms,
+            [this, time](auto *parameters)
+            {
+                parameters->viewProj = fieldViewProj;
+                parameters->boundingSphere = mesh->getBoundingSphere();
+                parameters->time = time;
+                parameters->scale = gpuInstanceField->getScale();
+                parameters->objectCount = gpuInstanceField->getCount();
+            });
+    }
+
+    void cullScene(uint32_t index)
+    {
+        cullTimer.run();
+        scene.cull(fieldViewProj, visibleObjects, &cullStatistics);
+        cullTime += cullTimer.millisecondsElapsed();
+        visibleInstanceCount = cullStatistics.visibleCount;
+        assert(visibleInstanceCount <= visibleInstanceCapacity);
+        selectLods();
+        const float time = rapid::radians(angle);
+        magma::helpers::mapScoped<InstanceData>(visibleInstanceBuffers[index],
+            [this, time](InstanceData *instances)
+            {
+                sceneField->update(time, sortedObjects.data(), visibleInstanceCount, instances);
+            });
+    }
+
+    void selectLods()
+    {   // Group visible objects by LOD, so that each level is drawn by single instanced call
+        const std::vector<mesh::LevelOfDetail>& lods = mesh->getLods();
+        const float scale = sceneField->getScale();
+        std::fill(lodInstanceCounts, lodInstanceCounts + lodCount, 0);
+        for (uint32_t i = 0; i < visibleInstanceCount; ++i)
+        {
+            const uint32_t object = visibleObjects[i];
+            float x, z;
+            sceneField->getPosition(object, x, z);
+            const float dx = x - fieldEye[0], dy = fieldEye[1], dz = z - fieldEye[2];
+            const float distance = sqrtf(dx * dx + dy * dy + dz * dz);
+            const float pixelsPerUnit = focalLength * scale/distance;
+            const uint32_t lod = mesh::selectLod(lods, objectLods[object], pixelsPerUnit);
+            objectLods[object] = static_cast<uint8_t>(lod);
+            ++lodInstanceCounts[lod];
+        }
+        uint32_t offsets[lodCount];
+        for (uint32_t lod = 0, offset = 0; lod < lodCount; ++lod)
+        {
+            offsets[lod] = offset;
+            offset += lodInstanceCounts[lod];
+        }
+        sortedObjects.resize(visibleInstanceCount);
+        for (uint32_t i = 0; i < visibleInstanceCount; ++i)
+        {
+            const uint32_t object = visibleObjects[i];
+            sortedObjects[offsets[objectLods[object]]++] = object;
+        }
+    }
+
+    void updateStatistics(float dt)
+    {
+        statisticsTime += dt;
+        ++statisticsFrames;
+        if (statisticsTime < statisticsInterval)
+            return;
+        const double framesPerSecond = statisticsFrames * 1000.0/statisticsTime;
+        if (Mode::GpuCulled == mode)
+        {   // Number of survivors stays on GPU, so report culling throughput
+            std::cout << getModeName() << ": " << framesPerSecond << " fps, "
+                << framesPerSecond * gpuInstanceCount * 1e-6 << "M instances tested/s" << std::endl;
+            statisticsTime = 0.f;
+            statisticsFrames = 0;
+            return;
+        }
+        if (Mode::CpuCulled == mode)
+        {
+            const std::vector<mesh::LevelOfDetail>& lods = mesh->getLods();
+            uint32_t triangleCount = 0;
+            for (uint32_t lod = 0; lod < mesh->getLodCount(); ++lod)
+                triangleCount += lodInstanceCounts[lod] * lods[lod].indexCount/3;
+            std::cout << getModeName() << ": " << framesPerSecond << " fps, "
+                << scene.getObjectCount() << " objects, "
+                << cullStatistics.visibleCount << " visible, "
+                << cullStatistics.culledCount << " culled, "
+                << cullStatistics.nodesVisited << " nodes visited, "
+                << cullTime/statisticsFrames << " ms cull time" << std::endl;
+            std::cout << "LOD instances:";
+            for (uint32_t lod = 0; lod < mesh->getLodCount(); ++lod)
+                std::cout << " " << lodInstanceCounts[lod];
+            std::cout << ", " << triangleCount << " triangles (" <<
+                static_cast<uint64_t>(visibleInstanceCount) * mesh->getIndexCount()/3 << " without LOD)" << std::endl;
+            statisticsTime = 0.f;
+            statisticsFrames = 0;
+            cullTime = 0.f;
+            return;
+        }
+        const uint32_t instances = (Mode::Single == mode) ? 1 : instanceCount;
+        const uint32_t draws = (Mode::DrawPerInstance == mode) ? instanceCount : 1;
+        const double trianglesPerFrame = static_cast<double>(instances) * mesh->getIndexCount()/3;
+        std::cout << getModeName() << ": " << framesPerSecond << " fps, "
+            << framesPerSecond * draws << " draws/s, "
+            << framesPerSecond * trianglesPerFrame * 1e-6 << "M triangles/s" << std::endl;
+        statisticsTime = 0.f;
+        statisticsFrames = 0;
+    }
+
     void createMesh()
     {
-        constexpr uint16_t subdivisionDegree = 4;
-        mesh = std::make_unique<quadric::Teapot>(subdivisionDegree, cmdBufferCopy);
+        constexpr uint32_t subdivisionDegree = 4;
+        threadPool = std::make_unique<ThreadPool>();
+        BezierPatchMesh::Options options;
+        options.optimize = true;
+        options.quantize = true; // Shaders decode quantized normals
+        options.threadPool = threadPool.get();
+        options.lodCount = lodCount;
+        mesh = std::make_unique<BezierPatchMesh>(teapotPatches, kTeapotNumPatches, teapotVertices,
+            subdivisionDegree, cmdBufferCopy, options);
+        const std::vector<mesh::LevelOfDetail>& lods = mesh->getLods();
+        for (uint32_t lod = 0; lod < mesh->getLodCount(); ++lod)
+            std::cout << "LOD " << lod << ": " << lods[lod].indexCount/3 << " triangles, error " << lods[lod].error << std::endl;
+        const VkDeviceSize floatSize = mesh->getVertexCount() * sizeof(BezierPatchMesh::Vertex);
+        std::cout << "Vertex buffer: " << mesh->getVertexBufferSize() << " bytes (" << floatSize << " bytes as float, "
+            << static_cast<float>(floatSize)/mesh->getVertexBufferSize() << "x less fetch bandwidth)" << std::endl;
+    }
+
+    void createInstances()
+    {
+        constexpr float spacing = 2.f;
+        constexpr float scale = .25f;
+        instanceField = std::make_unique<InstanceField>(instanceCount, spacing, scale);
+        const bool barStagedMemory = device->getDeviceFeatures()->hasLocalHostVisibleMemory();
+        for (auto& instanceBuffer : instanceBuffers)
+            instanceBuffer = std::make_shared<magma::DynamicVertexBuffer>(device, instanceCount * sizeof(InstanceData), barStagedMemory);
+        // Static parameters are uploaded once, transforms are computed on GPU
+        gpuInstanceField = std::make_unique<InstanceField>(gpuInstanceCount, spacing, scale);
+        std::vector<InstanceParameters> parameters(gpuInstanceCount);
+        gpuInstanceField->getParameters(parameters.data());
+        instanceParameters = std::make_shared<magma::StorageBuffer>(cmdBufferCopy,
+            gpuInstanceCount * sizeof(InstanceParameters), parameters.data());
+        visibleInstances = std::make_shared<StorageVertexBuffer>(device, gpuInstanceCount * sizeof(InstanceData));
+        drawCommand = std::make_shared<StorageIndirectBuffer>(device, sizeof(VkDrawIndexedIndirectCommand));
+    }
+
+    void createScene()
+    {
+        constexpr float spacing = 2.f;
+        constexpr float scale = .25f;
+        const uint32_t objectCount = sceneSizes[sceneSizeIndex];
+        if (visibleInstanceCapacity != objectCount)
+        {   // Every object of the scene may be visible
+            if (visibleInstanceBuffers[0])
+                device->waitIdle(); // Buffers may still be used by frames in flight
+            const bool barStagedMemory = device->getDeviceFeatures()->hasLocalHostVisibleMemory();
+            for (auto& visibleInstanceBuffer : visibleInstanceBuffers)
+                visibleInstanceBuffer = std::make_shared<magma::DynamicVertexBuffer>(device, objectCount * sizeof(InstanceData), barStagedMemory);
+            visibleInstanceCapacity = objectCount;
+        }
+        Timer buildTimer;
+        buildTimer.run();
+        sceneField = std::make_unique<InstanceField>(objectCount, spacing, scale);
+        objectLods.assign(objectCount, 0);
+        // Encloses mesh at any angle of rotation
+        const rapid::float4 sphere = mesh->getBoundingSphere();
+        const float meshRadius = sqrtf(sphere.x * sphere.x + sphere.y * sphere.y + sphere.z * sphere.z) + sphere.w;
+        std::vector<float> boxMin(objectCount * 3), boxMax(objectCount * 3);
+        sceneField->getBounds(meshRadius, boxMin.data(), boxMax.data());
+        scene.clear();
+        scene.reserve(objectCount);
+        for (uint32_t i = 0; i < objectCount; ++i)
+            scene.addObject(&boxMin[i * 3], &boxMax[i * 3]);
+        scene.build(threadPool.get());
+        std::cout << "Built BVH of " << objectCount << " objects (" << scene.getNodeCount() << " nodes) in "
+            << buildTimer.millisecondsElapsed() << " ms" << std::endl;
+        cullTime = 0.f;
     }
 
     void createUniformBuffer()
     {
-        uniformBuffer = std::make_shared<magma::UniformBuffer<rapid::matrix>>(device);
+        uniformBuffer = std::make_shared<magma::UniformBuffer<Transforms>>(device);
+        cullUniforms = std::make_shared<magma::UniformBuffer<CullParameters>>(device);
     }
 
     void setupDescriptorSet()
     {
-        setTable.worldViewProj = uniformBuffer;
+        setTable.transforms = uniformBuffer;
         descriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
             setTable, VK_SHADER_STAGE_VERTEX_BIT,
             nullptr, shaderReflectionFactory, "transform.o");
+        cullSetTable.parameters = cullUniforms;
+        cullSetTable.instances = instanceParameters;
+        cullSetTable.visibleInstances = visibleInstances;
+        cullSetTable.drawCommand = drawCommand;
+        cullDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
+            cullSetTable, VK_SHADER_STAGE_COMPUTE_BIT,
+            nullptr, shaderReflectionFactory, "cull.o");
     }
 
     void setupPipeline()
@@ -98,13 +445,82 @@ public:
             pipelineLayout,
             renderPass, 0,
             pipelineCache);
+        // Second binding advances once per instance
+        const magma::VertexInputState instancedVertexInput(
+            {
+                magma::VertexInputBinding(0, sizeof(BezierPatchMesh::QuantizedVertex)),
+                magma::VertexInputBinding(1, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE)
+            },
+            {
+                magma::VertexInputAttribute(0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(BezierPatchMesh::QuantizedVertex, position)),
+                magma::VertexInputAttribute(1, 0, VK_FORMAT_A2B10G10R10_UNORM_PACK32, offsetof(BezierPatchMesh::QuantizedVertex, normal)),
+                magma::VertexInputAttribute(3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, transform[0])),
+                magma::VertexInputAttribute(4, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, transform[1])),
+                magma::VertexInputAttribute(5, 1, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(InstanceData, transform[2])),
+                magma::VertexInputAttribute(6, 1, VK_FORMAT_R8G8B8A8_UNORM, offsetof(InstanceData, color))
+            });
+        instancedPipeline = std::make_shared<GraphicsPipeline>(device,
+            "instanced.o", "color.o",
+            instancedVertexInput,
+            magma::renderstate::triangleList,
+            negateViewport ? magma::renderstate::fillCullBackCcw
+                           : magma::renderstate::fillCullBackCw,
+            magma::renderstate::dontMultisample,
+            magma::renderstate::depthLessOrEqual,
+            magma::renderstate::dontBlendRgb,
+            pipelineLayout,
+            renderPass, 0,
+            pipelineCache);
+    }
+
+    void setupCullPipeline()
+    {
+        cullPipelineLayout = std::make_shared<magma::PipelineLayout>(cullDescriptorSet->getLayout());
+        const aligned_vector<char> bytecode = utilities::loadBinaryFile("cull.o");
+        auto cullShader = std::make_shared<magma::ShaderModule>(device, (const magma::SpirvWord *)bytecode.data(), bytecode.size());
+        cullPipeline = std::make_shared<magma::ComputePipeline>(device,
+            magma::ComputeShaderStage(cullShader, "main"),
+            cullPipelineLayout, nullptr, pipelineCache);
+    }
+
+    void cullInstances(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {   // Reset instance count, it is incremented by each survivor
+        VkDrawIndexedIndirectCommand drawIndexed;
+        drawIndexed.indexCount = mesh->getIndexCount();
+        drawIndexed.instanceCount = 0;
+        drawIndexed.firstIndex = 0;
+        drawIndexed.vertexOffset = 0;
+        drawIndexed.firstInstance = 0;
+        // Previous frame should consume draw command before it is overwritten
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            magma::BufferMemoryBarrier(drawCommand,
+                magma::MemoryBarrier(VK_ACCESS_INDIRECT_COMMAND_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT)));
+        cmdBuffer->updateBuffer(drawCommand, sizeof(VkDrawIndexedIndirectCommand), &drawIndexed);
+        const std::vector<magma::BufferMemoryBarrier> computeBarriers = {
+            {drawCommand, magma::MemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)},
+            {visibleInstances, magma::MemoryBarrier(VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)}
+        };
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            {}, computeBarriers, {});
+        cmdBuffer->bindDescriptorSet(cullPipeline, 0, cullDescriptorSet);
+        cmdBuffer->bindPipeline(cullPipeline);
+        cmdBuffer->dispatch((gpuInstanceCount + cullGroupSize - 1)/cullGroupSize, 1, 1);
+        // Draw command and per-instance attributes should be written before they are fetched
+        const std::vector<magma::BufferMemoryBarrier> drawBarriers = {
+            {drawCommand, magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT)},
+            {visibleInstances, magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT)}
+        };
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT,
+            {}, drawBarriers, {});
     }
 
     void recordCommandBuffer(uint32_t index)
     {
         std::shared_ptr<magma::CommandBuffer> cmdBuffer = commandBuffers[index];
         cmdBuffer->begin();
-        {
+        {   // Dispatch can't be recorded inside render pass
+            if (Mode::GpuCulled == mode)
+                cullInstances(cmdBuffer);
             cmdBuffer->beginRenderPass(renderPass, framebuffers[index],
                 {
                     magma::clear::gray,
@@ -113,9 +529,44 @@ public:
             {
                 cmdBuffer->setViewport(0, 0, width, negateViewport ? -height : height);
                 cmdBuffer->setScissor(0, 0, width, height);
-                cmdBuffer->bindDescriptorSet(wireframePipeline, 0, descriptorSet);
-                cmdBuffer->bindPipeline(wireframePipeline);
-                mesh->draw(cmdBuffer);
+                if (Mode::Single == mode)
+                {
+                    cmdBuffer->bindDescriptorSet(wireframePipeline, 0, descriptorSet);
+                    cmdBuffer->bindPipeline(wireframePipeline);
+                    mesh->draw(cmdBuffer);
+                }
+                else
+                {
+                    cmdBuffer->bindDescriptorSet(instancedPipeline, 0, descriptorSet);
+                    cmdBuffer->bindPipeline(instancedPipeline);
+                    mesh->bind(cmdBuffer);
+                    if (Mode::GpuCulled == mode)
+                    {   // Instance count is written by compute shader
+                        cmdBuffer->bindVertexBuffer(1, visibleInstances);
+                        cmdBuffer->drawIndexedIndirect(drawCommand, 1, sizeof(VkDrawIndexedIndirectCommand));
+                    }
+                    else if (Mode::CpuCulled == mode)
+                    {   // Compact list of visible instances is written before recording
+                        cmdBuffer->bindVertexBuffer(1, visibleInstanceBuffers[index]);
+                        for (uint32_t lod = 0, firstInstance = 0; lod < mesh->getLodCount(); ++lod)
+                        {
+                            if (lodInstanceCounts[lod])
+                                mesh->drawInstanced(cmdBuffer, lodInstanceCounts[lod], firstInstance, lod);
+                            firstInstance += lodInstanceCounts[lod];
+                        }
+                    }
+                    else if (Mode::Instanced == mode)
+                    {
+                        cmdBuffer->bindVertexBuffer(1, instanceBuffers[index]);
+                        mesh->drawInstanced(cmdBuffer, instanceCount);
+                    }
+                    else
+                    {   // First instance selects per-instance attributes of each draw
+                        cmdBuffer->bindVertexBuffer(1, instanceBuffers[index]);
+                        for (uint32_t i = 0; i < instanceCount; ++i)
+                            mesh->drawInstanced(cmdBuffer, 1, i);
+                    }
+                }
             }
             cmdBuffer->endRenderPass();
         }
@@ -0,0 +1,130 @@
+#include <cmath>
+#include <random>
+#include <smmintrin.h>
+#include "instanceField.h"
+
+namespace
+{
+constexpr float pi = 3.14159265f;
+
+// Polynomial approximation, absolute error is less than 1e-5
+inline __m128 sin4(__m128 x) noexcept
+{   // Reduce to [-pi, pi]
+    const __m128 q = _mm_round_ps(_mm_mul_ps(x, _mm_set1_ps(.5f/pi)), _MM_FROUND_TO_NEAREST_INT);
+    x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(2.f * pi)));
+    // Fold to [-pi/2, pi/2] using sin(x) = sin(pi - x)
+    const __m128 halfPi = _mm_set1_ps(pi * .5f);
+    x = _mm_blendv_ps(x, _mm_sub_ps(_mm_set1_ps(pi), x), _mm_cmpgt_ps(x, halfPi));
+    x = _mm_blendv_ps(x, _mm_sub_ps(_mm_set1_ps(-pi), x), _mm_cmplt_ps(x, _mm_sub_ps(_mm_setzero_ps(), halfPi)));
+    const __m128 x2 = _mm_mul_ps(x, x);
+    __m128 p = _mm_set1_ps(1.f/362880.f);
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.f/5040.f));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.f/120.f));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(-1.f/6.f));
+    p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(1.f));
+    return _mm_mul_ps(p, x);
+}
+} // namespace
+
+InstanceField::InstanceField(uint32_t count, float spacing, float scale):
+    count(count),
+    scale(scale)
+{
+    const uint32_t paddedCount = (count + 3) & ~3;
+    x.resize(paddedCount, 0.f);
+    z.resize(paddedCount, 0.f);
+    phase.resize(paddedCount, 0.f);
+    speed.resize(paddedCount, 0.f);
+    colors.resize(count);
+    const uint32_t side = static_cast<uint32_t>(ceilf(sqrtf(static_cast<float>(count))));
+    const float offset = (side - 1) * spacing * .5f;
+    std::mt19937 rng(0x5EED);
+    std::uniform_real_distribution<float> angle(0.f, 2.f * pi);
+    std::uniform_real_distribution<float> velocity(.5f, 2.f);
+    std::uniform_int_distribution<uint32_t> channel(64, 255);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        x[i] = (i % side) * spacing - offset;
+        z[i] = (i / side) * spacing - offset;
+        phase[i] = angle(rng);
+        speed[i] = velocity(rng);
+        colors[i] = channel(rng) | (channel(rng) << 8) | (channel(rng) << 16) | 0xFF000000;
+    }
+}
+
+void InstanceField::update(float time, InstanceData *instances) const noexcept
+{
+    for (uint32_t i = 0; i < count; i += 4)
+    {
+        const uint32_t n = std::min(4U, count - i);
+        computeTransforms(time, _mm_load_ps(&x[i]), _mm_load_ps(&z[i]),
+            _mm_load_ps(&phase[i]), _mm_load_ps(&speed[i]), n, &colors[i], instances + i);
+    }
+}
+
+void InstanceField::update(float time, const uint32_t *indices, uint32_t indexCount, InstanceData *instances) const noexcept
+{
+    for (uint32_t i = 0; i < indexCount; i += 4)
+    {   // Gather parameters of visible instances, tail repeats last one
+        const uint32_t n = std::min(4U, indexCount - i);
+        uint32_t j[4];
+        for (uint32_t k = 0; k < 4; ++k)
+            j[k] = indices[i + std::min(k, n - 1)];
+        const uint32_t gatheredColors[4] = {colors[j[0]], colors[j[1]], colors[j[2]], colors[j[3]]};
+        computeTransforms(time,
+            _mm_setr_ps(x[j[0]], x[j[1]], x[j[2]], x[j[3]]),
+            _mm_setr_ps(z[j[0]], z[j[1]], z[j[2]], z[j[3]]),
+            _mm_setr_ps(phase[j[0]], phase[j[1]], phase[j[2]], phase[j[3]]),
+            _mm_setr_ps(speed[j[0]], speed[j[1]], speed[j[2]], speed[j[3]]),
+            n, gatheredColors, instances + i);
+    }
+}
+
+void InstanceField::getBounds(float meshRadius, float *boxMin, float *boxMax) const noexcept
+{   // Bounding sphere of spinning mesh doesn't depend on time
+    const float radius = meshRadius * scale;
+    for (uint32_t i = 0; i < count; ++i, boxMin += 3, boxMax += 3)
+    {
+        boxMin[0] = x[i] - radius; boxMin[1] = -radius; boxMin[2] = z[i] - radius;
+        boxMax[0] = x[i] + radius; boxMax[1] = radius; boxMax[2] = z[i] + radius;
+    }
+}
+
+void InstanceField::computeTransforms(float time, __m128 x, __m128 z, __m128 phase, __m128 speed,
+    uint32_t n, const uint32_t *colors, InstanceData *instances) const noexcept
+{
+    const __m128 k = _mm_set1_ps(scale);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 halfPi = _mm_set1_ps(pi * .5f);
+    // Z-up to Y-up, spin around Y: (x, y, z) -> (c * x - s * y, z, -s * x - c * y)
+    const __m128 column1 = _mm_set_ps(0.f, scale, 0.f, 0.f);
+    const __m128 a = _mm_add_ps(phase, _mm_mul_ps(speed, _mm_set1_ps(time)));
+    const __m128 ks = _mm_mul_ps(k, sin4(a));
+    const __m128 kc = _mm_mul_ps(k, sin4(_mm_add_ps(a, halfPi)));
+    __m128 c0[4] = {kc, _mm_sub_ps(zero, ks), zero, x};
+    __m128 c2[4] = {_mm_sub_ps(zero, ks), _mm_sub_ps(zero, kc), zero, z};
+    _MM_TRANSPOSE4_PS(c0[0], c0[1], c0[2], c0[3]);
+    _MM_TRANSPOSE4_PS(c2[0], c2[1], c2[2], c2[3]);
+    for (uint32_t j = 0; j < n; ++j)
+    {   // Vertex buffer is written sequentially, which is fine for write-combined memory
+        InstanceData& instance = instances[j];
+        _mm_storeu_ps(instance.transform[0], c0[j]);
+        _mm_storeu_ps(instance.transform[1], column1);
+        _mm_storeu_ps(instance.transform[2], c2[j]);
+        instance.color = colors[j];
+    }
+}
+
+void InstanceField::getParameters(InstanceParameters *parameters) const noexcept
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        InstanceParameters& instance = parameters[i];
+        instance.x = x[i];
+        instance.z = z[i];
+        instance.phase = phase[i];
+        instance.speed = speed[i];
+        instance.color = colors[i];
+        instance.padding[0] = instance.padding[1] = instance.padding[2] = 0;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <xmmintrin.h>
+#include "../framework/utilities.h"
+
+/* Per-instance vertex attributes: 3x4 world matrix stored by columns
+   (dot with object-space position gives world-space coordinate) and color. */
+struct InstanceData
+{
+    float transform[3][4];
+    uint32_t color;
+};
+
+// Static parameters of instance for GPU-side animation, std430 layout
+struct InstanceParameters
+{
+    float x, z;
+    float phase;
+    float speed;
+    uint32_t color;
+    uint32_t padding[3];
+};
+
+/* Grid of spinning Z-up meshes on XZ plane. Instance parameters are stored
+   as structure of arrays, so that transforms of four instances are computed
+   at once with SSE and transposed into vertex buffer layout. */
+class InstanceField
+{
+public:
+    explicit InstanceField(uint32_t count, float spacing, float scale);
+    uint32_t getCount() const noexcept { return count; }
+    float getScale() const noexcept { return scale; }
+    void getPosition(uint32_t i, float& posX, float& posZ) const noexcept { posX = x[i]; posZ = z[i]; }
+    void update(float time, InstanceData *instances) const noexcept;
+    // Writes transforms of selected instances only
+    void update(float time, const uint32_t *indices, uint32_t indexCount, InstanceData *instances) const noexcept;
+    // Axis-aligned boxes of instances for CPU-side culling, three floats per corner
+    void getBounds(float meshRadius, float *boxMin, float *boxMax) const noexcept;
+    void getParameters(InstanceParameters *parameters) const noexcept;
+
+private:
+    void computeTransforms(float time, __m128 x, __m128 z, __m128 phase, __m128 speed,
+        uint32_t n, const uint32_t *colors, InstanceData *instances) const noexcept;
+
+    uint32_t count;
+    float scale;
+    aligned_vector<float> x;
+    aligned_vector<float> z;
+    aligned_vector<float> phase;
+    aligned_vector<float> speed;
+    std::vector<uint32_t> colors;
+};
@@ -0,0 +1,33 @@
+#version 450
+
+layout(binding = 0) uniform Transforms {
+    mat4 viewProj;
+    mat4 dequantization;
+};
+
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec3 normal;
+// Per-instance
+layout(location = 3) in vec4 world0;
+layout(location = 4) in vec4 world1;
+layout(location = 5) in vec4 world2;
+layout(location = 6) in vec4 color;
+
+layout(location = 0) out vec3 oColor;
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main()
+{
+    const vec3 lightDir = vec3(0.577, 0.577, 0.577);
+    // Position is quantized relative to bounding box of mesh
+    vec4 pos = vec4((dequantization * position).xyz, 1.);
+    vec3 worldPos = vec3(dot(world0, pos), dot(world1, pos), dot(world2, pos));
+    // 10:10:10:2 UNORM normal is mapped back to [-1, 1]
+    vec3 objNormal = normal * 2. - 1.;
+    // Uniform scale, so rotation part transforms normal as well
+    vec3 n = normalize(vec3(dot(world0.xyz, objNormal), dot(world1.xyz, objNormal), dot(world2.xyz, objNormal)));
+    oColor = color.rgb * (max(dot(n, lightDir), 0.) * 0.8 + 0.2);
+    gl_Position = viewProj * vec4(worldPos, 1.);
+}
@@ -15,6 +15,6 @@ out gl_PerVertex {
 
 void main()
 {
-    oNormal = normal;
+    oNormal = normal * 2. - 1.; // Decode 10:10:10:2 UNORM
     gl_Position = worldViewProj * position;
 }
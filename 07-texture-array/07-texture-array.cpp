@@ -1,22 +1,32 @@
 #include <fstream>
 #include "../framework/vulkanApp.h"
 #include "../framework/utilities.h"
+#include "../framework/imageArrayStreamer.h"
 #include "quadric/include/cube.h"
 
 // Use PgUp/PgDown to select texture lod
+// Use Space to start/stop streaming of array layers
 class TextureArrayApp : public VulkanApp
 {
+    constexpr static uint32_t numLayers = 6;
+
     struct alignas(16) TexParameters
     {
         float lod;
     };
 
+    struct alignas(16) LayerMap
+    {
+        int32_t physicalLayers[numLayers][4]; // std140 array stride
+    };
+
     struct DescriptorSetTable : magma::DescriptorSetTable
     {
         magma::descriptor::UniformBuffer worldViewProj = 0;
         magma::descriptor::UniformBuffer texParameters = 1;
         magma::descriptor::CombinedImageSampler imageArray = 2;
-        MAGMA_REFLECT(worldViewProj, texParameters, imageArray)
+        magma::descriptor::UniformBuffer layerMap = 3;
+        MAGMA_REFLECT(worldViewProj, texParameters, imageArray, layerMap)
     } setTable;
 
     std::unique_ptr<quadric::Cube> mesh;
@@ -24,12 +34,20 @@ class TextureArrayApp : public VulkanApp
     std::shared_ptr<magma::Sampler> anisotropicSampler;
     std::shared_ptr<magma::UniformBuffer<rapid::matrix>> uniformWorldViewProj;
     std::shared_ptr<magma::UniformBuffer<TexParameters>> uniformTexParameters;
+    std::shared_ptr<magma::UniformBuffer<LayerMap>> uniformLayerMap;
+    std::shared_ptr<magma::SrcTransferBuffer> stagingBuffer;
+    std::vector<std::vector<magma::Image::Mip>> textureMipMaps;
+    std::unique_ptr<ImageArrayStreamer> streamer;
     std::shared_ptr<magma::DescriptorSet> descriptorSet;
     std::shared_ptr<magma::PipelineLayout> pipelineLayout;
     std::shared_ptr<magma::GraphicsPipeline> graphicsPipeline;
 
     rapid::matrix viewProj;
     float lod = 0.f;
+    bool streaming = true;
+    float streamTime = 0.f;
+    uint32_t nextLayer = 0;
+    uint32_t textureShift = 0;
 
 public:
     TextureArrayApp(const AppEntry& entry):
@@ -50,7 +68,13 @@ public:
 
     void render(uint32_t bufferIndex) override
     {
-        updatePerspectiveTransform();
+        const float elapsed = timer->millisecondsElapsed();
+        updatePerspectiveTransform(elapsed);
+        streamer->advanceFrame();
+        if (streamer->update())
+            updateLayerMap();
+        if (streaming)
+            streamLayers(elapsed);
         submitCommandBuffer(bufferIndex);
     }
 
@@ -72,6 +96,9 @@ public:
                 updateLod();
             }
             break;
+        case AppKey::Space:
+            streaming = !streaming;
+            break;
         }
         VulkanApp::onKeyDown(key, repeat, flags);
     }
@@ -89,11 +116,11 @@ public:
         viewProj = view * proj;
     }
 
-    void updatePerspectiveTransform()
+    void updatePerspectiveTransform(float elapsed)
     {
         constexpr float speed = 0.1f;
         static float angle = 0.f;
-        angle += timer->millisecondsElapsed() * speed;
+        angle += elapsed * speed;
         const float radians = rapid::radians(angle);
         const rapid::matrix pitch = rapid::rotationX(radians);
         const rapid::matrix yaw = rapid::rotationY(radians);
@@ -116,6 +143,34 @@ public:
         std::cout << "Texture LOD: " << lod << "\n";
     }
 
+    void streamLayers(float elapsed)
+    {   // Replace one layer at a time, so that dice faces change gradually
+        constexpr float period = 500.f; // ms
+        streamTime += elapsed;
+        if (streamTime < period || !streamer->canUpdate(nextLayer))
+            return;
+        streamTime = 0.f;
+        const uint32_t texture = (nextLayer + textureShift) % numLayers;
+        constexpr uint32_t baseMipLevel = 0;
+        streamer->updateLayer(nextLayer, baseMipLevel, stagingBuffer, textureMipMaps[texture]);
+        streamer->flush(graphicsQueue);
+        if (++nextLayer == numLayers)
+        {
+            nextLayer = 0;
+            textureShift = (textureShift + 1) % numLayers;
+        }
+    }
+
+    void updateLayerMap()
+    {
+        magma::helpers::mapScoped<LayerMap>(uniformLayerMap,
+            [this](auto *block)
+            {
+                for (uint32_t layer = 0; layer < numLayers; ++layer)
+                    block->physicalLayers[layer][0] = static_cast<int32_t>(streamer->getPhysicalLayer(layer));
+            });
+    }
+
     void createMesh()
     {
         mesh = std::make_unique<quadric::Cube>(cmdBufferCopy);
@@ -134,6 +189,7 @@ public:
         }
         std::list<gliml::context> ctxArray;
         std::shared_ptr<magma::SrcTransferBuffer> buffer = std::make_shared<magma::SrcTransferBuffer>(device, totalSize);
+        MAGMA_ASSERT(filenames.size() == numLayers);
         VkDeviceSize baseMipOffset = 0ull;
         magma::helpers::mapScoped<uint8_t>(buffer, [&](uint8_t *data)
         {   // Read all data to single buffer
@@ -171,6 +227,7 @@ public:
         std::vector<magma::Image::Mip> mipMaps;
         for (const auto& ctx: ctxArray)
         {
+            textureMipMaps.emplace_back();
             for (int level = 0; level < ctx.num_mipmaps(0); ++level)
             {
                 magma::Image::Mip mip;
@@ -180,15 +237,24 @@ public:
                 mip.bufferOffset = (const uint8_t *)ctx.image_data(0, level) - frontImageFirstMipData;
                 MAGMA_ASSERT(mip.bufferOffset < (VkDeviceSize)totalSize);
                 mipMaps.push_back(mip);
+                // Streamer expects absolute offsets
+                mip.bufferOffset += baseMipOffset;
+                textureMipMaps.back().push_back(mip);
             }
         }
+        // Second half of array is a back copy of each layer for streaming
+        const std::vector<magma::Image::Mip> frontLayers = mipMaps;
+        mipMaps.insert(mipMaps.end(), frontLayers.begin(), frontLayers.end());
         // Upload texture array data from buffer
         cmdImageCopy->begin();
         const magma::Image::CopyLayout bufferLayout{baseMipOffset, 0, 0};
         std::shared_ptr<magma::Image2DArray> imageArray = std::make_shared<magma::Image2DArray>(cmdImageCopy,
-            format, MAGMA_COUNT(ctxArray), buffer, mipMaps, bufferLayout);
+            format, MAGMA_COUNT(ctxArray) * 2, buffer, mipMaps, bufferLayout);
         cmdImageCopy->end();
         submitCopyImageCommands();
+        // Keep staging buffer to stream layers from it later
+        stagingBuffer = std::move(buffer);
+        streamer = std::make_unique<ImageArrayStreamer>(imageArray, commandPools[0]);
         // Create image view for fragment shader
         imageArrayView = std::make_shared<magma::ImageView>(std::move(imageArray));
     }
@@ -202,7 +268,9 @@ public:
     {
         uniformWorldViewProj = std::make_shared<magma::UniformBuffer<rapid::matrix>>(device);
         uniformTexParameters = std::make_shared<magma::UniformBuffer<TexParameters>>(device);
+        uniformLayerMap = std::make_shared<magma::UniformBuffer<LayerMap>>(device);
         updateLod();
+        updateLayerMap();
     }
 
     void setupDescriptorSet()
@@ -210,6 +278,7 @@ public:
         setTable.worldViewProj = uniformWorldViewProj;
         setTable.texParameters = uniformTexParameters;
         setTable.imageArray = {imageArrayView, anisotropicSampler};
+        setTable.layerMap = uniformLayerMap;
         descriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
             setTable, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
             nullptr, shaderReflectionFactory, "textureArray.o");
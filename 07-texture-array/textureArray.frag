@@ -5,6 +5,9 @@ layout(binding = 1) uniform TexParameters {
 };
 
 layout(binding = 2) uniform sampler2DArray texarr;
+layout(binding = 3) uniform LayerMap {
+    ivec4 physicalLayers[6];
+};
 
 layout(location = 0) in vec2 texCoord;
 layout(location = 1) flat in int arrayLayer;
@@ -13,7 +16,7 @@ layout(location = 0) out vec4 oColor;
 
 void main()
 {
-    vec4 color = textureLod(texarr, vec3(texCoord, arrayLayer), lod);
+    vec4 color = textureLod(texarr, vec3(texCoord, physicalLayers[arrayLayer].x), lod);
     color.rgb *= vec3(texCoord.st, 0.);
     oColor = color;
 }
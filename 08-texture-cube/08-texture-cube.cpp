@@ -1,11 +1,32 @@
-#include <fstream>
+#include <iomanip>
+#include <sstream>
 #include "../framework/vulkanApp.h"
 #include "../framework/utilities.h"
-#include "quadric/include/teapot.h"
+#include "../framework/threadPool.h"
+#include "../framework/bezierMesh.h"
+#include "../framework/storageBuffers.h"
+#include "quadric/include/cube.h"
+#include "../framework/teapot.h"
+#include "iblFilter.h"
+#include "sphericalHarmonics.h"
+#include "dynamicCubeMap.h"
 
 // Use L button + mouse to rotate scene
+// Use PgUp/PgDown to change roughness
+// Use Space to toggle between irradiance cubemap and spherical harmonics
+// Use D to toggle reflection of dynamic environment instead of static cubemap
+// Use 1-6 to set number of dynamic cubemap faces updated per frame
+// Use C to toggle culling of teapot meshlets by compute shader
 class TextureCubeApp : public VulkanApp
 {
+    constexpr static uint32_t dynamicCubeMapSize = 256;
+    constexpr static uint32_t numObjects = 4;
+    constexpr static uint32_t meshletGroupSize = 64; // Should match local_size_x of meshletCull.comp
+
+    // Number of GGX samples per texel of prefiltered specular map
+    constexpr static uint32_t specularSampleCount = 128;
+    constexpr static uint32_t irradianceDimension = 32;
+
     struct TransformMatrices
     {
         rapid::matrix worldView;
@@ -13,25 +34,98 @@ class TextureCubeApp : public VulkanApp
         rapid::matrix normal;
     };
 
+    struct alignas(16) MaterialParameters
+    {
+        float roughness;
+        float maxSpecularLod;
+    };
+
+    struct PushConstants
+    {
+        rapid::matrix transform;
+        rapid::float4 color;
+    };
+
+    // Matches uniform block of meshletCull.comp
+    struct MeshletCullParameters
+    {
+        rapid::matrix worldViewProj;
+        rapid::matrix viewToObject;
+        uint32_t meshletCount;
+    };
+
+    // Header of meshletCull.comp draw command buffer
+    struct MeshletCounters
+    {
+        uint32_t visibleMeshletCount;
+        uint32_t visibleTriangleCount;
+        uint32_t reserved[2];
+    };
+
+    struct SkyDescriptorSetTable : magma::DescriptorSetTable
+    {
+        magma::descriptor::CombinedImageSampler environment = 0;
+        MAGMA_REFLECT(environment)
+    } skySetTable;
+
     struct DescriptorSetTable : magma::DescriptorSetTable
     {
         magma::descriptor::UniformBuffer transforms = 0;
         magma::descriptor::CombinedImageSampler diffuse = 1;
         magma::descriptor::CombinedImageSampler specular = 2;
-        MAGMA_REFLECT(transforms, diffuse, specular)
-    } setTable;
+        magma::descriptor::UniformBuffer material = 3;
+        magma::descriptor::UniformBuffer irradiance = 4;
+        MAGMA_REFLECT(transforms, diffuse, specular, material, irradiance)
+    } setTable, dynamicSetTable;
 
-    std::unique_ptr<quadric::Teapot> mesh;
+    struct MeshletCullDescriptorSetTable : magma::DescriptorSetTable
+    {
+        magma::descriptor::UniformBuffer parameters = 0;
+        magma::descriptor::StorageBuffer meshlets = 1;
+        magma::descriptor::StorageBuffer drawCommands = 2;
+        MAGMA_REFLECT(parameters, meshlets, drawCommands)
+    } meshletCullSetTable;
+
+    std::unique_ptr<BezierPatchMesh> mesh;
     std::shared_ptr<magma::ImageView> diffuse;
     std::shared_ptr<magma::ImageView> specular;
     std::shared_ptr<magma::Sampler> anisotropicSampler;
     std::shared_ptr<magma::UniformBuffer<TransformMatrices>> uniformTransforms;
+    std::shared_ptr<magma::UniformBuffer<MaterialParameters>> uniformMaterial;
+    std::shared_ptr<magma::UniformBuffer<sh::Irradiance>> uniformIrradiance;
     std::shared_ptr<magma::DescriptorSet> descriptorSet;
     std::shared_ptr<magma::PipelineLayout> pipelineLayout;
     std::shared_ptr<magma::GraphicsPipeline> graphicsPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> shPipeline;
+    std::shared_ptr<magma::StorageBuffer> meshletBuffer;
+    std::shared_ptr<StorageIndirectBuffer> meshletDrawCommands;
+    std::shared_ptr<magma::DstTransferBuffer> meshletReadback[2];
+    std::shared_ptr<magma::UniformBuffer<MeshletCullParameters>> meshletCullUniforms;
+    std::shared_ptr<magma::DescriptorSet> meshletCullDescriptorSet;
+    std::shared_ptr<magma::PipelineLayout> meshletCullPipelineLayout;
+    std::shared_ptr<magma::ComputePipeline> meshletCullPipeline;
+    std::unique_ptr<DynamicCubeMap> dynamicCubeMap;
+    std::unique_ptr<quadric::Cube> cube;
+    std::shared_ptr<magma::CommandBuffer> cubeMapCmdBuffers[2];
+    std::shared_ptr<magma::Semaphore> cubeMapSemaphore;
+    std::shared_ptr<magma::DescriptorSet> skyDescriptorSet;
+    std::shared_ptr<magma::PipelineLayout> cubeMapPipelineLayout;
+    std::shared_ptr<magma::GraphicsPipeline> skyPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> cubeMapObjectPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> objectPipeline;
+    rapid::matrix objectTransforms[numObjects];
+    std::shared_ptr<magma::DescriptorSet> dynamicDescriptorSet;
+    float objectAngle = 0.f;
 
     rapid::matrix view;
     rapid::matrix proj;
+    float roughness = 0.f;
+    sh::Irradiance irradianceSH;
+    bool useSH = false;
+    bool dynamicEnvironment = false;
+    bool cullMeshlets = true;
+    bool rebuildCommandBuffers = false;
+    uint32_t meshletFrameCount = 0;
 
 public:
     TextureCubeApp(const AppEntry& entry):
@@ -41,18 +135,97 @@ public:
         setupView();
         createMesh();
         loadCubeMaps();
+        createDynamicCubeMap();
         createSampler();
-        createUniformBuffer();
+        createUniformBuffers();
         setupDescriptorSet();
         setupPipeline();
+        setupMeshletCullPipeline();
+        setupDynamicCubeMapPipelines();
+        timer->run();
+        updateObjectTransforms();
         recordCommandBuffer(FrontBuffer);
         recordCommandBuffer(BackBuffer);
     }
 
     void render(uint32_t bufferIndex) override
     {
+        if (rebuildCommandBuffers)
+        {
+            waitFences[1 - bufferIndex]->wait();
+            recordCommandBuffer(FrontBuffer);
+            recordCommandBuffer(BackBuffer);
+            rebuildCommandBuffers = false;
+        }
         updatePerspectiveTransform();
-        submitCommandBuffer(bufferIndex);
+        if (cullMeshlets)
+            printMeshletStatistics(bufferIndex);
+        if (dynamicEnvironment)
+        {
+            updateObjectTransforms();
+            recordCubeMapCommandBuffer(bufferIndex);
+            // Objects are moving, so we have to rebuild command buffer each frame
+            recordCommandBuffer(bufferIndex);
+            graphicsQueue->submit(cubeMapCmdBuffers[bufferIndex], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                presentFinished, // Wait for swapchain
+                cubeMapSemaphore, // Signal when cubemap faces are updated
+                nullptr);
+            // Cubemap is sampled by fragment shader, so onscreen pass should wait before it
+            graphicsQueue->submit(commandBuffers[bufferIndex], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                cubeMapSemaphore, // Wait for cubemap update
+                renderFinished, // Signal when command buffer execution finished
+                (WaitMethod::Fence == waitMethod) ? waitFences[bufferIndex] : nullptr);
+        }
+        else
+            submitCommandBuffer(bufferIndex);
+    }
+
+    void onKeyDown(char key, int repeat, uint32_t flags) override
+    {
+        switch (key)
+        {
+        case AppKey::PgUp:
+            roughness = std::min(roughness + .1f, 1.f);
+            updateMaterial();
+            break;
+        case AppKey::PgDn:
+            roughness = std::max(roughness - .1f, 0.f);
+            updateMaterial();
+            break;
+        case AppKey::Space:
+            useSH = !useSH;
+            rebuildCommandBuffers = true;
+            std::cout << "Diffuse: " << (useSH ? "spherical harmonics" : "irradiance cubemap") << "\n";
+            break;
+        case 'C': case 'c':
+            cullMeshlets = !cullMeshlets;
+            rebuildCommandBuffers = true;
+            meshletFrameCount = 0;
+            std::cout << "Meshlet culling: " << (cullMeshlets ? "on" : "off") << "\n";
+            break;
+        case 'D': case 'd':
+            if (dynamicEnvironment)
+                printDynamicCubeMapCost();
+            dynamicEnvironment = !dynamicEnvironment;
+            dynamicCubeMap->resetStatistics();
+            timer->millisecondsElapsed(); // Objects don't jump after pause
+            updateMaterial();
+            rebuildCommandBuffers = true;
+            std::cout << "Reflection: " << (dynamicEnvironment ? "dynamic environment" : "static cubemap") << "\n";
+            break;
+        case '1': case '2': case '3': case '4': case '5': case '6':
+        {
+            if (dynamicEnvironment)
+                printDynamicCubeMapCost();
+            const uint32_t facesPerFrame = key - '0';
+            dynamicCubeMap->setFacesPerFrame(facesPerFrame);
+            dynamicCubeMap->resetStatistics();
+            std::cout << "Dynamic cubemap: " << facesPerFrame << " face(s) per frame, full update every "
+                << (DynamicCubeMap::NumFaces + facesPerFrame - 1)/facesPerFrame << " frame(s)" << std::endl;
+            break;
+        }
+        }
+        VulkanApp::onKeyDown(key, repeat, flags);
     }
 
     void setupView()
@@ -72,7 +245,8 @@ public:
         const rapid::matrix pitch = rapid::rotationX(rapid::radians(spinY/2.f));
         const rapid::matrix yaw = rapid::rotationY(rapid::radians(spinX/2.f));
         const rapid::matrix trans = rapid::translation(0.f, -1.25f, 0.f);
-        const rapid::matrix world = trans * pitch * yaw;
+        const rapid::matrix zUpToYUp = rapid::rotationX(rapid::radians(-90.f));
+        const rapid::matrix world = zUpToYUp * trans * pitch * yaw;
         magma::helpers::mapScoped(uniformTransforms,
             [this, &world](auto *block)
             {
@@ -80,78 +254,256 @@ public:
                 block->worldViewProj = block->worldView * proj;
                 block->normal = rapid::transpose(rapid::inverse(block->worldView));
             });
+        magma::helpers::mapScoped(meshletCullUniforms,
+            [this, &world](auto *block)
+            {   // Meshlet bounds are in object space, so cull there
+                const rapid::matrix worldView = world * view;
+                block->worldViewProj = worldView * proj;
+                block->viewToObject = rapid::inverse(worldView);
+                block->meshletCount = static_cast<uint32_t>(mesh->getMeshlets().size());
+            });
     }
 
     void createMesh()
+    {   // Patches are tessellated in parallel, then grouped into meshlets
+        ThreadPool threadPool;
+        constexpr uint32_t subdivisionDegree = 32;
+        BezierPatchMesh::Options options;
+        options.threadPool = &threadPool;
+        options.buildMeshlets = true;
+        mesh = std::make_unique<BezierPatchMesh>(teapotPatches, kTeapotNumPatches, teapotVertices,
+            subdivisionDegree, cmdBufferCopy, options);
+        std::cout << "Teapot: " << mesh->getIndexCount()/3 << " triangles tessellated on "
+            << threadPool.getThreadCount() << " threads in " << mesh->getTessellationTime() << " ms" << std::endl;
+        const std::vector<mesh::Meshlet>& meshlets = mesh->getMeshlets();
+        uint32_t vertexCount = 0;
+        for (const mesh::Meshlet& meshlet : meshlets)
+            vertexCount += meshlet.vertexCount;
+        std::cout << "Teapot: " << meshlets.size() << " meshlets, " << vertexCount/(float)meshlets.size() << " vertices and "
+            << mesh->getIndexCount()/3/(float)meshlets.size() << " triangles on average, mesh setup "
+            << mesh->getSetupTime() << " ms" << std::endl;
+        meshletBuffer = std::make_shared<magma::StorageBuffer>(cmdBufferCopy,
+            meshlets.size() * sizeof(mesh::Meshlet), meshlets.data());
+        meshletDrawCommands = std::make_shared<StorageIndirectBuffer>(device,
+            sizeof(MeshletCounters) + meshlets.size() * sizeof(VkDrawIndexedIndirectCommand));
+        for (auto& readback : meshletReadback)
+            readback = std::make_shared<magma::DstTransferBuffer>(device, sizeof(MeshletCounters));
+    }
+
+    void updateMaterial()
     {
-        constexpr uint16_t subdivisionDegree = 16;
-        mesh = std::make_unique<quadric::Teapot>(subdivisionDegree, cmdBufferCopy);
+        magma::helpers::mapScoped(uniformMaterial,
+            [this](auto *block)
+            {
+                block->roughness = roughness;
+                const uint32_t mipLevels = dynamicEnvironment ? dynamicCubeMap->getMipLevels()
+                                                              : specular->getImage()->getMipLevels();
+                block->maxSpecularLod = static_cast<float>(mipLevels - 1);
+            });
+        std::cout << "Roughness: " << roughness << "\n";
     }
 
-    std::shared_ptr<magma::ImageView> loadCubeMap(const std::string& filename, std::shared_ptr<magma::SrcTransferBuffer> buffer)
+    ibl::FilteredCubeMap filterCubeMap(const std::string& filename, bool irradiance, ThreadPool& threadPool) const
     {
-        std::ifstream file(filename, std::ios::in | std::ios::binary | std::ios::ate);
-        if (!file.is_open())
-            throw std::runtime_error("failed to open file \"" + filename + "\"");
-        const std::streamoff size = file.tellg();
-        file.seekg(0, std::ios::beg);
+        const aligned_vector<char> dds = utilities::loadBinaryFile(filename);
+        // Filter parameters are part of the key, so changing them invalidates cache
+        const uint32_t parameters[] = {irradiance, irradiance ? irradianceDimension : specularSampleCount};
+        const uint64_t hash = utilities::hashFnv1a(parameters, sizeof(parameters),
+            utilities::hashFnv1a(dds.data(), dds.size()));
+        std::ostringstream cacheName;
+        cacheName << filename.substr(0, filename.find_last_of('.')) << "-"
+            << std::hex << std::setw(16) << std::setfill('0') << hash << ".cache";
+        Timer timer;
+        timer.run();
+        ibl::FilteredCubeMap cubeMap;
+        if (ibl::loadCache(cacheName.str(), hash, cubeMap))
+        {
+            std::cout << filename << ": loaded from \"" << cacheName.str() << "\" in "
+                << timer.millisecondsElapsed() << " ms" << std::endl;
+            return cubeMap;
+        }
+        gliml::context ctx;
+        ctx.enable_dxt(true);
+        if (!ctx.load(dds.data(), static_cast<unsigned>(dds.size())))
+            throw std::runtime_error("failed to load DDS texture");
+        const CubeMap radiance(ctx);
+        if (irradiance)
+            cubeMap = ibl::convolveIrradiance(radiance, irradianceDimension, threadPool);
+        else
+            cubeMap = ibl::prefilterSpecular(radiance, specularSampleCount, threadPool);
+        std::cout << filename << ": filtered " << cubeMap.mipLevels << " mip level(s) on "
+            << threadPool.getThreadCount() << " threads in " << timer.millisecondsElapsed() << " ms" << std::endl;
+        ibl::saveCache(cacheName.str(), hash, cubeMap);
+        return cubeMap;
+    }
+
+    sh::Irradiance projectSH(const std::string& filename, ThreadPool& threadPool) const
+    {   // Projection is cheap enough to be done every run
+        const aligned_vector<char> dds = utilities::loadBinaryFile(filename);
         gliml::context ctx;
         ctx.enable_dxt(true);
-        VkDeviceSize bufferOffset = buffer->getPrivateData();
-        VkDeviceSize baseMipOffset = 0;
-        magma::helpers::mapRangeScoped<uint8_t>(buffer, bufferOffset, (VkDeviceSize)size,
-            [&](uint8_t *data)
-            {   // Read data from file
-                file.read(reinterpret_cast<char *>(data), size);
-                if (!ctx.load(data, static_cast<unsigned>(size)))
-                    throw std::runtime_error("failed to load DDS texture");
-                // Skip DDS header
-                baseMipOffset = reinterpret_cast<const uint8_t *>(ctx.image_data(0, 0)) - data;
+        if (!ctx.load(dds.data(), static_cast<unsigned>(dds.size())))
+            throw std::runtime_error("failed to load DDS texture");
+        Timer timer;
+        timer.run();
+        const CubeMap radiance(ctx);
+        const sh::Irradiance irradiance = sh::projectIrradiance(radiance, threadPool);
+        std::cout << filename << ": projected onto " << sh::NumCoefficients << " SH coefficients in "
+            << timer.millisecondsElapsed() << " ms" << std::endl;
+        return irradiance;
+    }
+
+    std::shared_ptr<magma::ImageView> uploadCubeMap(const ibl::FilteredCubeMap& cubeMap, std::shared_ptr<magma::SrcTransferBuffer> buffer)
+    {
+        const VkDeviceSize bufferOffset = buffer->getPrivateData();
+        magma::helpers::mapRangeScoped<uint8_t>(buffer, bufferOffset, (VkDeviceSize)cubeMap.data.size(),
+            [&cubeMap](uint8_t *data)
+            {
+                memcpy(data, cubeMap.data.data(), cubeMap.data.size());
             });
-        buffer->setPrivateData(bufferOffset + size);
+        buffer->setPrivateData(bufferOffset + cubeMap.data.size());
         // Setup texture data description
-        const uint32_t dimension = ctx.image_width(0, 0);
-        const uint8_t *firstMipData = (const uint8_t *)ctx.image_data(0, 0);
         std::vector<magma::Image::Mip> mipMaps;
-        mipMaps.reserve(ctx.num_faces() * ctx.num_mipmaps(0));
-        for (int face = 0; face < ctx.num_faces(); ++face)
+        mipMaps.reserve(CubeMap::NumFaces * cubeMap.mipLevels);
+        for (uint32_t face = 0; face < CubeMap::NumFaces; ++face)
         {
-            for (int level = 0; level < ctx.num_mipmaps(face); ++level)
+            for (uint32_t level = 0; level < cubeMap.mipLevels; ++level)
             {
                 magma::Image::Mip mip;
+                const uint32_t dimension = cubeMap.getDimension(level);
                 mip.extent = VkExtent3D{dimension, dimension, 1};
-                mip.bufferOffset = (const uint8_t *)ctx.image_data(face, level) - firstMipData;
+                mip.bufferOffset = cubeMap.getMipOffset(face, level);
                 mipMaps.push_back(mip);
             }
         }
         // Upload texture data from buffer
-        const magma::Image::CopyLayout bufferLayout{bufferOffset + baseMipOffset, 0, 0};
-        const VkFormat format = utilities::getBlockCompressedFormat(ctx);
-        std::shared_ptr<magma::ImageCube> image = std::make_shared<magma::ImageCube>(cmdImageCopy, format, std::move(buffer), mipMaps, bufferLayout);
+        const magma::Image::CopyLayout bufferLayout{bufferOffset, 0, 0};
+        std::shared_ptr<magma::ImageCube> image = std::make_shared<magma::ImageCube>(cmdImageCopy,
+            VK_FORMAT_R8G8B8A8_UNORM, std::move(buffer), mipMaps, bufferLayout);
         // Create image view for fragment shader
         return std::make_shared<magma::ImageView>(std::move(image));
     }
 
     void loadCubeMaps()
-    {
-        auto buffer = std::make_shared<magma::SrcTransferBuffer>(device, 1024 * 1024);
+    {   // Prefiltering is performed only once, next time maps are loaded from cache
+        ThreadPool threadPool;
+        constexpr bool irradiance = true;
+        const ibl::FilteredCubeMap irradianceMap = filterCubeMap("diff.dds", irradiance, threadPool);
+        irradianceSH = projectSH("diff.dds", threadPool);
+        const ibl::FilteredCubeMap specularMap = filterCubeMap("spec.dds", !irradiance, threadPool);
+        auto buffer = std::make_shared<magma::SrcTransferBuffer>(device, irradianceMap.data.size() + specularMap.data.size());
         cmdImageCopy->begin();
         {
-            diffuse = loadCubeMap("diff.dds", buffer);
-            specular = loadCubeMap("spec.dds", buffer);
+            diffuse = uploadCubeMap(irradianceMap, buffer);
+            specular = uploadCubeMap(specularMap, buffer);
         }
         cmdImageCopy->end();
         submitCopyImageCommands();
     }
 
+    void createDescriptorPool() override
+    {   // Static and dynamic reflections have their own descriptor sets
+        constexpr uint32_t maxDescriptorSets = 8;
+        descriptorPool = std::make_shared<magma::DescriptorPool>(device, maxDescriptorSets,
+            std::vector<magma::descriptor::DescriptorPool>{
+                magma::descriptor::UniformBufferPool(8),
+                magma::descriptor::DynamicUniformBufferPool(4),
+                magma::descriptor::StorageBufferPool(4),
+                magma::descriptor::CombinedImageSamplerPool(8)
+            });
+    }
+
+    void createDynamicCubeMap()
+    {
+        constexpr uint32_t facesPerFrame = 2;
+        const VkFormat depthFormat = utilities::getSupportedDepthFormat(physicalDevice, false, true);
+        dynamicCubeMap = std::make_unique<DynamicCubeMap>(device, depthFormat, dynamicCubeMapSize, facesPerFrame);
+        cube = std::make_unique<quadric::Cube>(cmdBufferCopy);
+        cubeMapCmdBuffers[0] = std::make_shared<magma::PrimaryCommandBuffer>(commandPools[0]);
+        cubeMapCmdBuffers[1] = std::make_shared<magma::PrimaryCommandBuffer>(commandPools[0]);
+        cubeMapSemaphore = std::make_shared<magma::Semaphore>(device);
+    }
+
+    void printDynamicCubeMapCost() const
+    {   // Each face costs render pass and blit chain of its mip levels
+        std::cout << "Dynamic cubemap: " << dynamicCubeMap->getAverageFacesPerFrame() << " face(s) of "
+            << dynamicCubeMap->getDimension() << "x" << dynamicCubeMap->getDimension() << " with "
+            << dynamicCubeMap->getMipLevels() << " mip levels rendered per frame on average" << std::endl;
+    }
+
+    void updateObjectTransforms()
+    {
+        constexpr float speed = 0.05f;
+        objectAngle += timer->millisecondsElapsed() * speed;
+        for (uint32_t i = 0; i < numObjects; ++i)
+        {   // Orbit around the teapot
+            const float phase = i * 360.f/numObjects;
+            const rapid::matrix spin = rapid::rotationY(rapid::radians(objectAngle * 2.f + phase));
+            const rapid::matrix orbit = rapid::rotationY(rapid::radians(objectAngle + phase));
+            const float height = sinf(rapid::radians(objectAngle * 3.f + phase));
+            objectTransforms[i] = spin * rapid::translation(4.f, height, 0.f) * orbit;
+        }
+    }
+
+    void drawObjects(std::shared_ptr<magma::CommandBuffer> cmdBuffer, const rapid::matrix& viewProj)
+    {
+        static const rapid::float4 colors[numObjects] = {
+            {1.f, 0.2f, 0.2f, 1.f},
+            {0.2f, 1.f, 0.2f, 1.f},
+            {0.2f, 0.4f, 1.f, 1.f},
+            {1.f, 0.9f, 0.2f, 1.f}
+        };
+        for (uint32_t i = 0; i < numObjects; ++i)
+        {
+            PushConstants pushConstants;
+            pushConstants.transform = objectTransforms[i] * viewProj;
+            pushConstants.color = colors[i];
+            cmdBuffer->pushConstantBlock(cubeMapPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, pushConstants);
+            cube->draw(cmdBuffer);
+        }
+    }
+
+    uint32_t recordCubeMapCommandBuffer(uint32_t index)
+    {
+        std::shared_ptr<magma::CommandBuffer> cmdBuffer = cubeMapCmdBuffers[index];
+        cmdBuffer->reset(false);
+        cmdBuffer->begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        // Cubemap is centered at the teapot
+        const rapid::vector3 position(0.f, 0.f, 0.f);
+        const uint32_t faceCount = dynamicCubeMap->update(cmdBuffer,
+            [this, &position](std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t face)
+            {
+                const rapid::matrix viewProj = dynamicCubeMap->getFaceViewProj(face, position);
+                PushConstants pushConstants;
+                pushConstants.transform = rapid::inverse(viewProj);
+                cmdBuffer->pushConstantBlock(cubeMapPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, pushConstants);
+                cmdBuffer->bindDescriptorSet(skyPipeline, 0, skyDescriptorSet);
+                cmdBuffer->bindPipeline(skyPipeline);
+                cmdBuffer->draw(3, 0);
+                cmdBuffer->bindPipeline(cubeMapObjectPipeline);
+                drawObjects(cmdBuffer, viewProj);
+            });
+        cmdBuffer->end();
+        return faceCount;
+    }
+
     void createSampler()
     {
         anisotropicSampler = std::make_shared<magma::Sampler>(device, magma::sampler::magMinLinearMipAnisotropicClampToEdge);
     }
 
-    void createUniformBuffer()
+    void createUniformBuffers()
     {
         uniformTransforms = std::make_shared<magma::UniformBuffer<TransformMatrices>>(device);
+        meshletCullUniforms = std::make_shared<magma::UniformBuffer<MeshletCullParameters>>(device);
+        uniformMaterial = std::make_shared<magma::UniformBuffer<MaterialParameters>>(device);
+        updateMaterial();
+        uniformIrradiance = std::make_shared<magma::UniformBuffer<sh::Irradiance>>(device);
+        magma::helpers::mapScoped(uniformIrradiance,
+            [this](auto *block)
+            {
+                *block = irradianceSH;
+            });
     }
 
     void setupDescriptorSet()
@@ -159,9 +511,26 @@ public:
         setTable.transforms = uniformTransforms;
         setTable.diffuse = {diffuse, anisotropicSampler};
         setTable.specular = {specular, anisotropicSampler};
+        setTable.material = uniformMaterial;
+        setTable.irradiance = uniformIrradiance;
         descriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
             setTable, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
             nullptr, shaderReflectionFactory, "envmap.o");
+        // The same bindings, but reflection is sampled from dynamic cubemap
+        dynamicSetTable.transforms = uniformTransforms;
+        dynamicSetTable.diffuse = {diffuse, anisotropicSampler};
+        dynamicSetTable.specular = {dynamicCubeMap->getView(), anisotropicSampler};
+        dynamicSetTable.material = uniformMaterial;
+        dynamicSetTable.irradiance = uniformIrradiance;
+        dynamicDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
+            dynamicSetTable, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+            nullptr, shaderReflectionFactory, "envmap.o");
+        meshletCullSetTable.parameters = meshletCullUniforms;
+        meshletCullSetTable.meshlets = meshletBuffer;
+        meshletCullSetTable.drawCommands = meshletDrawCommands;
+        meshletCullDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
+            meshletCullSetTable, VK_SHADER_STAGE_COMPUTE_BIT,
+            nullptr, shaderReflectionFactory, "meshletCull.o");
     }
 
     void setupPipeline()
@@ -179,6 +548,110 @@ public:
             pipelineLayout,
             renderPass, 0,
             pipelineCache);
+        // Evaluates diffuse from uniform block instead of cubemap fetch
+        shPipeline = std::make_shared<GraphicsPipeline>(device,
+            "transform.o", "envmapSH.o",
+            mesh->getVertexInput(),
+            magma::renderstate::triangleList,
+            negateViewport ? magma::renderstate::fillCullBackCcw
+                           : magma::renderstate::fillCullBackCw,
+            magma::renderstate::dontMultisample,
+            magma::renderstate::depthLessOrEqual,
+            magma::renderstate::dontBlendRgb,
+            pipelineLayout,
+            renderPass, 0,
+            pipelineCache);
+    }
+
+    void setupMeshletCullPipeline()
+    {
+        meshletCullPipelineLayout = std::make_shared<magma::PipelineLayout>(meshletCullDescriptorSet->getLayout());
+        const aligned_vector<char> bytecode = utilities::loadBinaryFile("meshletCull.o");
+        auto cullShader = std::make_shared<magma::ShaderModule>(device, (const magma::SpirvWord *)bytecode.data(), bytecode.size());
+        meshletCullPipeline = std::make_shared<magma::ComputePipeline>(device,
+            magma::ComputeShaderStage(cullShader, "main"),
+            meshletCullPipelineLayout, nullptr, pipelineCache);
+    }
+
+    void setupDynamicCubeMapPipelines()
+    {   // Static cubemap is used as the sky of dynamic environment
+        skySetTable.environment = {specular, anisotropicSampler};
+        skyDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
+            skySetTable, VK_SHADER_STAGE_FRAGMENT_BIT,
+            nullptr, shaderReflectionFactory, "sky.o");
+        constexpr magma::pushconstant::VertexFragmentConstantRange<PushConstants> pushConstantRange;
+        cubeMapPipelineLayout = std::make_shared<magma::PipelineLayout>(skyDescriptorSet->getLayout(), pushConstantRange);
+        skyPipeline = std::make_shared<GraphicsPipeline>(device,
+            "fullscreen.o", "sky.o",
+            magma::renderstate::nullVertexInput,
+            magma::renderstate::triangleList,
+            magma::renderstate::fillCullNoneCcw,
+            magma::renderstate::dontMultisample,
+            magma::renderstate::depthAlwaysDontWrite,
+            magma::renderstate::dontBlendRgb,
+            cubeMapPipelineLayout,
+            dynamicCubeMap->getRenderPass(), 0,
+            pipelineCache);
+        // Cubemap faces are rendered without viewport negation
+        cubeMapObjectPipeline = std::make_shared<GraphicsPipeline>(device,
+            "object.o", "color.o",
+            cube->getVertexInput(),
+            magma::renderstate::triangleList,
+            magma::renderstate::fillCullBackCw,
+            magma::renderstate::dontMultisample,
+            magma::renderstate::depthLessOrEqual,
+            magma::renderstate::dontBlendRgb,
+            cubeMapPipelineLayout,
+            dynamicCubeMap->getRenderPass(), 0,
+            pipelineCache);
+        objectPipeline = std::make_shared<GraphicsPipeline>(device,
+            "object.o", "color.o",
+            cube->getVertexInput(),
+            magma::renderstate::triangleList,
+            negateViewport ? magma::renderstate::fillCullBackCcw
+                           : magma::renderstate::fillCullBackCw,
+            magma::renderstate::dontMultisample,
+            magma::renderstate::depthLessOrEqual,
+            magma::renderstate::dontBlendRgb,
+            cubeMapPipelineLayout,
+            renderPass, 0,
+            pipelineCache);
+    }
+
+    void cullMeshletsOnGpu(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t index)
+    {   // Previous frame should consume draw commands before counters are reset
+        const MeshletCounters counters = {};
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            magma::BufferMemoryBarrier(meshletDrawCommands,
+                magma::MemoryBarrier(VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT)));
+        cmdBuffer->updateBuffer(meshletDrawCommands, sizeof(MeshletCounters), &counters);
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            magma::BufferMemoryBarrier(meshletDrawCommands,
+                magma::MemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)));
+        cmdBuffer->bindDescriptorSet(meshletCullPipeline, 0, meshletCullDescriptorSet);
+        cmdBuffer->bindPipeline(meshletCullPipeline);
+        const uint32_t meshletCount = static_cast<uint32_t>(mesh->getMeshlets().size());
+        cmdBuffer->dispatch((meshletCount + meshletGroupSize - 1)/meshletGroupSize, 1, 1);
+        // Draw commands should be written before they are fetched
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            magma::BufferMemoryBarrier(meshletDrawCommands,
+                magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT)));
+        // Counters are read on host when fence of this command buffer is signaled
+        cmdBuffer->copyBuffer(meshletDrawCommands, meshletReadback[index], 0, 0, sizeof(MeshletCounters));
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            magma::BufferMemoryBarrier(meshletReadback[index], magma::barrier::transferWriteHostRead));
+    }
+
+    void printMeshletStatistics(uint32_t index)
+    {   // Fence of this command buffer was waited before render(), so counters are available
+        if (++meshletFrameCount % 600 != 0)
+            return;
+        magma::helpers::mapScoped<MeshletCounters>(meshletReadback[index],
+            [this](const MeshletCounters *counters)
+            {
+                std::cout << "Meshlets: " << counters->visibleMeshletCount << " of " << mesh->getMeshlets().size()
+                    << " visible, " << counters->visibleTriangleCount << " of " << mesh->getIndexCount()/3 << " triangles" << std::endl;
+            });
     }
 
     void recordCommandBuffer(uint32_t index)
@@ -186,6 +659,8 @@ public:
         std::shared_ptr<magma::CommandBuffer> cmdBuffer = commandBuffers[index];
         cmdBuffer->begin();
         {
+            if (cullMeshlets)
+                cullMeshletsOnGpu(cmdBuffer, index);
             cmdBuffer->beginRenderPass(renderPass, framebuffers[index],
                 {
                     magma::clear::gray,
@@ -194,9 +669,34 @@ public:
             {
                 cmdBuffer->setViewport(0, 0, width, negateViewport ? -height : height);
                 cmdBuffer->setScissor(0, 0, width, height);
-                cmdBuffer->bindDescriptorSet(graphicsPipeline, 0, descriptorSet);
-                cmdBuffer->bindPipeline(graphicsPipeline);
-                mesh->draw(cmdBuffer);
+                std::shared_ptr<magma::GraphicsPipeline> pipeline = useSH ? shPipeline : graphicsPipeline;
+                cmdBuffer->bindDescriptorSet(pipeline, 0, dynamicEnvironment ? dynamicDescriptorSet : descriptorSet);
+                cmdBuffer->bindPipeline(pipeline);
+                if (cullMeshlets)
+                {   // One command per meshlet, culled ones have zero instances
+                    mesh->bind(cmdBuffer);
+                    const uint32_t meshletCount = static_cast<uint32_t>(mesh->getMeshlets().size());
+                    if (multiDrawIndirect)
+                    {
+                        cmdBuffer->drawIndexedIndirect(meshletDrawCommands, meshletCount,
+                            sizeof(VkDrawIndexedIndirectCommand), sizeof(MeshletCounters));
+                    }
+                    else
+                    {   // Draw count must be 0 or 1 without multiDrawIndirect feature
+                        for (uint32_t i = 0; i < meshletCount; ++i)
+                        {
+                            cmdBuffer->drawIndexedIndirect(meshletDrawCommands, 1, sizeof(VkDrawIndexedIndirectCommand),
+                                sizeof(MeshletCounters) + i * sizeof(VkDrawIndexedIndirectCommand));
+                        }
+                    }
+                }
+                else
+                    mesh->draw(cmdBuffer);
+                if (dynamicEnvironment)
+                {
+                    cmdBuffer->bindPipeline(objectPipeline);
+                    drawObjects(cmdBuffer, view * proj);
+                }
             }
             cmdBuffer->endRenderPass();
         }
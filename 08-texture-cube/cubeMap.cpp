@@ -0,0 +1,249 @@
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include "cubeMap.h"
+#include "../framework/utilities.h"
+
+namespace
+{
+inline __m128 unpack565(uint16_t color) noexcept
+{
+    return _mm_set_ps(1.f,
+        (color & 0x1F)/31.f,
+        ((color >> 5) & 0x3F)/63.f,
+        (color >> 11)/31.f);
+}
+
+// Decodes 4x4 block of DXT color endpoints and indices
+void decodeColorBlock(const uint8_t *block, bool allowTransparency, __m128 colors[16]) noexcept
+{
+    const uint16_t c0 = block[0] | (block[1] << 8);
+    const uint16_t c1 = block[2] | (block[3] << 8);
+    const uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+    __m128 palette[4];
+    palette[0] = unpack565(c0);
+    palette[1] = unpack565(c1);
+    if (c0 > c1 || !allowTransparency)
+    {
+        const __m128 third = _mm_set1_ps(1.f/3.f);
+        const __m128 twoThirds = _mm_set1_ps(2.f/3.f);
+        palette[2] = _mm_add_ps(_mm_mul_ps(palette[0], twoThirds), _mm_mul_ps(palette[1], third));
+        palette[3] = _mm_add_ps(_mm_mul_ps(palette[0], third), _mm_mul_ps(palette[1], twoThirds));
+    }
+    else
+    {   // 1-bit alpha mode
+        palette[2] = _mm_mul_ps(_mm_add_ps(palette[0], palette[1]), _mm_set1_ps(.5f));
+        palette[3] = _mm_setzero_ps();
+    }
+    for (int i = 0; i < 16; ++i)
+        colors[i] = palette[(indices >> (i * 2)) & 0x3];
+}
+
+// Interpolated alpha of BC3 block
+void decodeAlphaBlock(const uint8_t *block, float alpha[16]) noexcept
+{
+    float palette[8];
+    palette[0] = block[0]/255.f;
+    palette[1] = block[1]/255.f;
+    if (block[0] > block[1])
+    {
+        for (int i = 1; i < 7; ++i)
+            palette[i + 1] = ((7 - i) * palette[0] + i * palette[1])/7.f;
+    }
+    else
+    {
+        for (int i = 1; i < 5; ++i)
+            palette[i + 1] = ((5 - i) * palette[0] + i * palette[1])/5.f;
+        palette[6] = 0.f;
+        palette[7] = 1.f;
+    }
+    uint64_t indices = 0;
+    for (int i = 0; i < 6; ++i)
+        indices |= (uint64_t)block[2 + i] << (i * 8);
+    for (int i = 0; i < 16; ++i)
+        alpha[i] = palette[(indices >> (i * 3)) & 0x7];
+}
+
+inline float areaElement(float x, float y) noexcept
+{
+    return atan2f(x * y, sqrtf(x * x + y * y + 1.f));
+}
+} // namespace
+
+CubeMap::CubeMap(uint32_t dimension, uint32_t mipLevels /* 1 */):
+    dimension(dimension),
+    mipLevels(mipLevels)
+{
+    allocate();
+}
+
+CubeMap::CubeMap(const gliml::context& ctx):
+    dimension(ctx.image_width(0, 0)),
+    mipLevels(ctx.num_mipmaps(0))
+{
+    if (ctx.num_faces() != NumFaces)
+        throw std::invalid_argument("DDS texture is not a cubemap");
+    allocate();
+    decodeBlockCompressed(ctx);
+}
+
+uint32_t CubeMap::getDimension(uint32_t level /* 0 */) const noexcept
+{
+    return std::max(1U, dimension >> level);
+}
+
+CubeMap::Texel *CubeMap::getFace(uint32_t face, uint32_t level) noexcept
+{
+    const uint32_t dim = getDimension(level);
+    return texels.data() + levelOffsets[level] + face * dim * dim;
+}
+
+const CubeMap::Texel *CubeMap::getFace(uint32_t face, uint32_t level) const noexcept
+{
+    const uint32_t dim = getDimension(level);
+    return texels.data() + levelOffsets[level] + face * dim * dim;
+}
+
+__m128 CubeMap::sample(const float dir[3], float lod) const noexcept
+{
+    lod = std::min(std::max(lod, 0.f), static_cast<float>(mipLevels - 1));
+    const uint32_t level = static_cast<uint32_t>(lod);
+    const __m128 a = sampleLevel(dir, level);
+    if (level + 1 >= mipLevels)
+        return a;
+    const __m128 b = sampleLevel(dir, level + 1);
+    const __m128 t = _mm_set1_ps(lod - level);
+    return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+}
+
+__m128 CubeMap::sampleLevel(const float dir[3], uint32_t level) const noexcept
+{   // Select face and project direction onto it
+    const float ax = fabsf(dir[0]), ay = fabsf(dir[1]), az = fabsf(dir[2]);
+    uint32_t face;
+    float u, v, ma;
+    if (ax >= ay && ax >= az)
+    {
+        ma = ax;
+        face = dir[0] > 0.f ? 0 : 1;
+        u = dir[0] > 0.f ? -dir[2] : dir[2];
+        v = -dir[1];
+    }
+    else if (ay >= az)
+    {
+        ma = ay;
+        face = dir[1] > 0.f ? 2 : 3;
+        u = dir[0];
+        v = dir[1] > 0.f ? dir[2] : -dir[2];
+    }
+    else
+    {
+        ma = az;
+        face = dir[2] > 0.f ? 4 : 5;
+        u = dir[2] > 0.f ? dir[0] : -dir[0];
+        v = -dir[1];
+    }
+    const uint32_t dim = getDimension(level);
+    // [-1, 1] -> texel space, bilinear filter with clamp to edge
+    const float s = std::min(std::max((u/ma * .5f + .5f) * dim - .5f, 0.f), dim - 1.f);
+    const float t = std::min(std::max((v/ma * .5f + .5f) * dim - .5f, 0.f), dim - 1.f);
+    const uint32_t x0 = static_cast<uint32_t>(s), y0 = static_cast<uint32_t>(t);
+    const uint32_t x1 = std::min(x0 + 1, dim - 1), y1 = std::min(y0 + 1, dim - 1);
+    const Texel *texels = getFace(face, level);
+    const __m128 c00 = _mm_loadu_ps(&texels[y0 * dim + x0].r);
+    const __m128 c10 = _mm_loadu_ps(&texels[y0 * dim + x1].r);
+    const __m128 c01 = _mm_loadu_ps(&texels[y1 * dim + x0].r);
+    const __m128 c11 = _mm_loadu_ps(&texels[y1 * dim + x1].r);
+    const __m128 fx = _mm_set1_ps(s - x0);
+    const __m128 fy = _mm_set1_ps(t - y0);
+    const __m128 top = _mm_add_ps(c00, _mm_mul_ps(_mm_sub_ps(c10, c00), fx));
+    const __m128 bottom = _mm_add_ps(c01, _mm_mul_ps(_mm_sub_ps(c11, c01), fx));
+    return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+}
+
+void CubeMap::texelDirection(uint32_t face, uint32_t x, uint32_t y, uint32_t dimension, float dir[3]) noexcept
+{
+    const float u = 2.f * (x + .5f)/dimension - 1.f;
+    const float v = 2.f * (y + .5f)/dimension - 1.f;
+    switch (face)
+    {
+    case 0: dir[0] = 1.f; dir[1] = -v; dir[2] = -u; break;
+    case 1: dir[0] = -1.f; dir[1] = -v; dir[2] = u; break;
+    case 2: dir[0] = u; dir[1] = 1.f; dir[2] = v; break;
+    case 3: dir[0] = u; dir[1] = -1.f; dir[2] = -v; break;
+    case 4: dir[0] = u; dir[1] = -v; dir[2] = 1.f; break;
+    case 5: dir[0] = -u; dir[1] = -v; dir[2] = -1.f; break;
+    }
+}
+
+float CubeMap::texelSolidAngle(uint32_t x, uint32_t y, uint32_t dimension) noexcept
+{   // https://www.rorydriscoll.com/2012/01/15/cubemap-texel-solid-angle/
+    const float invDim = 1.f/dimension;
+    const float x0 = 2.f * x * invDim - 1.f;
+    const float y0 = 2.f * y * invDim - 1.f;
+    const float x1 = x0 + 2.f * invDim;
+    const float y1 = y0 + 2.f * invDim;
+    return areaElement(x0, y0) - areaElement(x0, y1) - areaElement(x1, y0) + areaElement(x1, y1);
+}
+
+void CubeMap::allocate()
+{
+    uint32_t texelCount = 0;
+    levelOffsets.resize(mipLevels);
+    for (uint32_t level = 0; level < mipLevels; ++level)
+    {
+        levelOffsets[level] = texelCount;
+        const uint32_t dim = getDimension(level);
+        texelCount += NumFaces * dim * dim;
+    }
+    texels.resize(texelCount);
+}
+
+void CubeMap::decodeBlockCompressed(const gliml::context& ctx)
+{
+    const VkFormat format = utilities::getBlockCompressedFormat(ctx);
+    const size_t blockSize = (VK_FORMAT_BC1_RGBA_UNORM_BLOCK == format) ? 8 : 16;
+    for (uint32_t face = 0; face < NumFaces; ++face)
+    {
+        for (uint32_t level = 0; level < mipLevels; ++level)
+        {
+            const uint32_t dim = getDimension(level);
+            const uint32_t blockCount = std::max(1U, (dim + 3)/4);
+            const uint8_t *block = reinterpret_cast<const uint8_t *>(ctx.image_data(face, level));
+            Texel *dst = getFace(face, level);
+            for (uint32_t by = 0; by < blockCount; ++by)
+            {
+                for (uint32_t bx = 0; bx < blockCount; ++bx, block += blockSize)
+                {
+                    __m128 colors[16];
+                    float alpha[16];
+                    switch (format)
+                    {
+                    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+                        decodeColorBlock(block, true, colors);
+                        for (int i = 0; i < 16; ++i)
+                            alpha[i] = _mm_cvtss_f32(_mm_shuffle_ps(colors[i], colors[i], _MM_SHUFFLE(3, 3, 3, 3)));
+                        break;
+                    case VK_FORMAT_BC2_UNORM_BLOCK:
+                        for (int i = 0; i < 16; ++i)
+                            alpha[i] = ((block[i/2] >> ((i & 1) * 4)) & 0xF)/15.f;
+                        decodeColorBlock(block + 8, false, colors);
+                        break;
+                    default:
+                        decodeAlphaBlock(block, alpha);
+                        decodeColorBlock(block + 8, false, colors);
+                    }
+                    for (uint32_t i = 0; i < 16; ++i)
+                    {   // Mip levels smaller than block size are partially covered
+                        const uint32_t x = bx * 4 + (i & 3), y = by * 4 + (i >> 2);
+                        if (x < dim && y < dim)
+                        {
+                            Texel& texel = dst[y * dim + x];
+                            _mm_storeu_ps(&texel.r, colors[i]);
+                            texel.a = alpha[i];
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
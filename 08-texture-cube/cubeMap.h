@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <xmmintrin.h>
+
+namespace gliml
+{
+    class context;
+}
+
+/* Floating-point cubemap in system memory, used as a source for
+   offline filtering. Faces are stored in Vulkan order: +X, -X, +Y, -Y, +Z, -Z.
+   Texels are 16 bytes wide, so that they can be loaded into SSE registers. */
+class CubeMap
+{
+public:
+    enum { NumFaces = 6 };
+
+    struct Texel
+    {
+        float r, g, b, a;
+    };
+
+    explicit CubeMap(uint32_t dimension, uint32_t mipLevels = 1);
+    // Decodes BC1/BC2/BC3 compressed cubemap
+    explicit CubeMap(const gliml::context& ctx);
+    uint32_t getDimension(uint32_t level = 0) const noexcept;
+    uint32_t getMipLevels() const noexcept { return mipLevels; }
+    Texel *getFace(uint32_t face, uint32_t level) noexcept;
+    const Texel *getFace(uint32_t face, uint32_t level) const noexcept;
+    // Trilinear lookup, direction doesn't need to be normalized
+    __m128 sample(const float dir[3], float lod) const noexcept;
+    __m128 sampleLevel(const float dir[3], uint32_t level) const noexcept;
+    // Converts texel center to (not normalized) direction in cube space
+    static void texelDirection(uint32_t face, uint32_t x, uint32_t y, uint32_t dimension, float dir[3]) noexcept;
+    static float texelSolidAngle(uint32_t x, uint32_t y, uint32_t dimension) noexcept;
+
+private:
+    void allocate();
+    void decodeBlockCompressed(const gliml::context& ctx);
+
+    uint32_t dimension;
+    uint32_t mipLevels;
+    std::vector<uint32_t> levelOffsets;
+    std::vector<Texel> texels;
+};
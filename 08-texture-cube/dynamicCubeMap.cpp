@@ -0,0 +1,198 @@
+#include <algorithm>
+#include "dynamicCubeMap.h"
+
+namespace
+{
+// Cube-compatible image that can be rendered to and sampled as texture,
+// mip chain is generated by blits
+class CubeColorAttachment : public magma::Image
+{
+public:
+    explicit CubeColorAttachment(std::shared_ptr<magma::Device> device, VkFormat format, uint32_t dimension,
+        uint32_t mipLevels):
+        magma::Image(std::move(device), VK_IMAGE_TYPE_2D, format, VkExtent3D{dimension, dimension, 1},
+            mipLevels,
+            DynamicCubeMap::NumFaces, // arrayLayers
+            1, // samples
+            VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, // Allocated and bound by base constructor
+            magma::Sharing(), nullptr)
+    {}
+};
+} // namespace
+
+DynamicCubeMap::DynamicCubeMap(std::shared_ptr<magma::Device> device, VkFormat depthFormat,
+    uint32_t dimension, uint32_t facesPerFrame):
+    dimension(dimension),
+    mipLevels(1),
+    facesPerFrame(std::min(std::max(facesPerFrame, 1U), (uint32_t)NumFaces))
+{   // Linear filtering of blits is guaranteed for this format
+    constexpr VkFormat colorFormat = VK_FORMAT_R8G8B8A8_UNORM;
+    while (dimension >> mipLevels)
+        ++mipLevels;
+    cube = std::make_shared<CubeColorAttachment>(device, colorFormat, dimension, mipLevels);
+    cubeView = std::make_shared<magma::ImageView>(cube);
+    // Each face is a separate render target
+    for (uint32_t face = 0; face < NumFaces; ++face)
+    {
+        constexpr uint32_t baseMipLevel = 0, levelCount = 1;
+        constexpr uint32_t layerCount = 1;
+        faceViews[face] = std::make_shared<magma::ImageView>(cube, baseMipLevel, levelCount, face, layerCount);
+    }
+    // Depth buffer is shared between faces, as they are rendered sequentially
+    constexpr bool dontSampled = false;
+    depth = std::make_shared<magma::DepthStencilAttachment>(std::move(device), depthFormat, VkExtent2D{dimension, dimension}, 1, 1, dontSampled);
+    depthView = std::make_shared<magma::ImageView>(depth);
+    // Attachments are transitioned by barriers in update(), so render pass doesn't change initial layouts.
+    // Top mip of face becomes source of blit to the next mip level.
+    const magma::AttachmentDescription colorAttachment(colorFormat, 1,
+        magma::op::clearStore,
+        magma::op::dontCare,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    const magma::AttachmentDescription depthAttachment(depthFormat, 1,
+        magma::op::clearStore,
+        magma::op::dontCare,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL);
+    renderPass = std::shared_ptr<magma::RenderPass>(new magma::RenderPass(
+        cube->getDevice(), {colorAttachment, depthAttachment}));
+    for (uint32_t face = 0; face < NumFaces; ++face)
+    {
+        framebuffers[face] = std::shared_ptr<magma::Framebuffer>(new magma::Framebuffer(
+            renderPass, {faceViews[face], depthView}));
+    }
+}
+
+void DynamicCubeMap::setFacesPerFrame(uint32_t count) noexcept
+{
+    facesPerFrame = std::min(std::max(count, 1U), (uint32_t)NumFaces);
+}
+
+rapid::matrix DynamicCubeMap::getFaceViewProj(uint32_t face, const rapid::vector3& position) const noexcept
+{   // Face orientation follows cubemap addressing in Vulkan specification
+    static const float directions[NumFaces][6] = {
+        { 1.f, 0.f, 0.f, 0.f,-1.f, 0.f}, // +X
+        {-1.f, 0.f, 0.f, 0.f,-1.f, 0.f}, // -X
+        { 0.f, 1.f, 0.f, 0.f, 0.f, 1.f}, // +Y
+        { 0.f,-1.f, 0.f, 0.f, 0.f,-1.f}, // -Y
+        { 0.f, 0.f, 1.f, 0.f,-1.f, 0.f}, // +Z
+        { 0.f, 0.f,-1.f, 0.f,-1.f, 0.f}  // -Z
+    };
+    const float *dir = directions[face];
+    const rapid::vector3 center = position + rapid::vector3(dir[0], dir[1], dir[2]);
+    const rapid::vector3 up(dir[3], dir[4], dir[5]);
+    const rapid::matrix view = rapid::lookAtRH(position, center, up);
+    constexpr float fov = rapid::radians(90.f);
+    constexpr float zn = .1f, zf = 100.f;
+    const rapid::matrix proj = rapid::perspectiveFovRH(fov, 1.f, zn, zf);
+    return view * proj;
+}
+
+uint32_t DynamicCubeMap::update(std::shared_ptr<magma::CommandBuffer> cmdBuffer,
+    const std::function<void(std::shared_ptr<magma::CommandBuffer>, uint32_t face)>& drawFace)
+{
+    const uint32_t count = initialized ? facesPerFrame : NumFaces;
+    VkImageSubresourceRange depthRange;
+    depthRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (magma::Format(depth->getFormat()).depthStencil())
+        depthRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    depthRange.baseMipLevel = 0;
+    depthRange.levelCount = 1;
+    depthRange.baseArrayLayer = 0;
+    depthRange.layerCount = 1;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const uint32_t face = nextFace;
+        VkImageSubresourceRange faceRange;
+        faceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        faceRange.baseMipLevel = 0;
+        faceRange.levelCount = 1;
+        faceRange.baseArrayLayer = face;
+        faceRange.layerCount = 1;
+        /* Face may still be sampled by onscreen pass of the previous frame,
+           so clear should wait for fragment shader (write after read).
+           Face is completely redrawn, so its contents are discarded. */
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            magma::ImageMemoryBarrier(cube,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                faceRange));
+        // Depth buffer is shared between faces, so clear should wait for tests of the previous face
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+            magma::ImageMemoryBarrier(depth,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                depthRange));
+        cmdBuffer->beginRenderPass(renderPass, framebuffers[face],
+            {
+                magma::clear::black,
+                magma::clear::depthOne
+            });
+        {
+            cmdBuffer->setViewport(magma::Viewport(0, 0, framebuffers[face]->getExtent()));
+            cmdBuffer->setScissor(magma::Scissor(0, 0, framebuffers[face]->getExtent()));
+            drawFace(cmdBuffer, face);
+        }
+        cmdBuffer->endRenderPass();
+        generateMipmap(cmdBuffer, face);
+        nextFace = (nextFace + 1) % NumFaces;
+    }
+    initialized = true;
+    ++frameCount;
+    faceCount += count;
+    return count;
+}
+
+void DynamicCubeMap::generateMipmap(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t face)
+{   // Each face is downsampled separately, so filtering doesn't cross cube edges
+    VkImageSubresourceRange mipRange;
+    mipRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    mipRange.levelCount = 1;
+    mipRange.baseArrayLayer = face;
+    mipRange.layerCount = 1;
+    for (uint32_t level = 1; level < mipLevels; ++level)
+    {   // Mip may still be sampled by onscreen pass of the previous frame
+        mipRange.baseMipLevel = level;
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            magma::ImageMemoryBarrier(cube,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                mipRange));
+        const int32_t srcDimension = static_cast<int32_t>(std::max(dimension >> (level - 1), 1U));
+        const int32_t dstDimension = static_cast<int32_t>(std::max(dimension >> level, 1U));
+        VkImageBlit region;
+        region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.mipLevel = level - 1;
+        region.srcSubresource.baseArrayLayer = face;
+        region.srcSubresource.layerCount = 1;
+        region.srcOffsets[0] = VkOffset3D{0, 0, 0};
+        region.srcOffsets[1] = VkOffset3D{srcDimension, srcDimension, 1};
+        region.dstSubresource = region.srcSubresource;
+        region.dstSubresource.mipLevel = level;
+        region.dstOffsets[0] = VkOffset3D{0, 0, 0};
+        region.dstOffsets[1] = VkOffset3D{dstDimension, dstDimension, 1};
+        cmdBuffer->blitImage(cube, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            cube, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, region, VK_FILTER_LINEAR);
+        // Becomes source of the next level
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            magma::ImageMemoryBarrier(cube,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                mipRange));
+    }
+    mipRange.baseMipLevel = 0;
+    mipRange.levelCount = mipLevels;
+    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        magma::ImageMemoryBarrier(cube,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            mipRange));
+}
+
+float DynamicCubeMap::getAverageFacesPerFrame() const noexcept
+{
+    return frameCount ? faceCount/static_cast<float>(frameCount) : 0.f;
+}
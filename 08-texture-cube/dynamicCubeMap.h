@@ -0,0 +1,52 @@
+#pragma once
+#include <functional>
+#include "magma/magma.h"
+#include "rapid/rapid.h"
+
+/* Cubemap that is rendered at runtime. Rendering all six faces every
+   frame is expensive, so only a few faces are updated per frame in
+   round-robin order; full refresh takes 6/facesPerFrame frames.
+   The first update renders all faces, as content of cubemap is undefined.
+   Mip chain of each updated face is regenerated by blits, so that
+   reflection can be blurred by roughness. */
+class DynamicCubeMap
+{
+public:
+    enum { NumFaces = 6 };
+
+    explicit DynamicCubeMap(std::shared_ptr<magma::Device> device,
+        VkFormat depthFormat,
+        uint32_t dimension,
+        uint32_t facesPerFrame);
+    void setFacesPerFrame(uint32_t count) noexcept;
+    uint32_t getFacesPerFrame() const noexcept { return facesPerFrame; }
+    uint32_t getDimension() const noexcept { return dimension; }
+    uint32_t getMipLevels() const noexcept { return mipLevels; }
+    const std::shared_ptr<magma::RenderPass>& getRenderPass() const noexcept { return renderPass; }
+    const std::shared_ptr<magma::ImageView>& getView() const noexcept { return cubeView; }
+    rapid::matrix getFaceViewProj(uint32_t face, const rapid::vector3& position) const noexcept;
+    // Records render passes for the next faces, returns number of faces updated
+    uint32_t update(std::shared_ptr<magma::CommandBuffer> cmdBuffer,
+        const std::function<void(std::shared_ptr<magma::CommandBuffer>, uint32_t face)>& drawFace);
+    // Since construction or the last reset
+    float getAverageFacesPerFrame() const noexcept;
+    void resetStatistics() noexcept { frameCount = faceCount = 0; }
+
+private:
+    void generateMipmap(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t face);
+
+    uint32_t dimension;
+    uint32_t mipLevels;
+    uint32_t facesPerFrame;
+    uint32_t nextFace = 0;
+    bool initialized = false;
+    uint64_t frameCount = 0;
+    uint64_t faceCount = 0;
+    std::shared_ptr<magma::Image> cube;
+    std::shared_ptr<magma::ImageView> cubeView;
+    std::shared_ptr<magma::ImageView> faceViews[NumFaces];
+    std::shared_ptr<magma::DepthStencilAttachment> depth;
+    std::shared_ptr<magma::ImageView> depthView;
+    std::shared_ptr<magma::RenderPass> renderPass;
+    std::shared_ptr<magma::Framebuffer> framebuffers[NumFaces];
+};
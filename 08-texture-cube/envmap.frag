@@ -2,6 +2,10 @@
 
 layout(binding = 1) uniform samplerCube envDiff;
 layout(binding = 2) uniform samplerCube envSpec;
+layout(binding = 3) uniform Material {
+    float roughness;
+    float maxSpecularLod;
+};
 
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 normal;
@@ -22,7 +26,7 @@ void main()
     float scale = 5.0;
     float power = 2.0;
     float factor = fresnelApprox(I, N, bias, scale, power);
-    vec3 diff = texture(envDiff, R).rgb;
-    vec3 spec = texture(envSpec, R).rgb;
+    vec3 diff = texture(envDiff, N).rgb; // Irradiance
+    vec3 spec = textureLod(envSpec, R, roughness * maxSpecularLod).rgb;
     oColor = vec4(mix(diff, spec, factor), 1.);
 }
@@ -0,0 +1,48 @@
+#version 450
+
+layout(binding = 2) uniform samplerCube envSpec;
+layout(binding = 3) uniform Material {
+    float roughness;
+    float maxSpecularLod;
+};
+layout(binding = 4) uniform Irradiance {
+    vec4 sh[9];
+};
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+
+layout(location = 0) out vec4 oColor;
+
+float fresnelApprox(vec3 I, vec3 N, float bias, float scale, float power)
+{
+    return max(0., min(1., bias + scale * pow(1. + dot(I, N), power)));
+}
+
+// Coefficients are pre-convolved with cosine lobe on CPU
+vec3 irradianceSH(vec3 n)
+{
+    return sh[0].rgb * 0.282095 +
+        sh[1].rgb * 0.488603 * n.y +
+        sh[2].rgb * 0.488603 * n.z +
+        sh[3].rgb * 0.488603 * n.x +
+        sh[4].rgb * 1.092548 * n.x * n.y +
+        sh[5].rgb * 1.092548 * n.y * n.z +
+        sh[6].rgb * 0.315392 * (3. * n.z * n.z - 1.) +
+        sh[7].rgb * 1.092548 * n.x * n.z +
+        sh[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
+void main()
+{
+    vec3 I = normalize(position);
+    vec3 N = normalize(normal);
+    vec3 R = reflect(I, N);
+    float bias = 0.0;
+    float scale = 5.0;
+    float power = 2.0;
+    float factor = fresnelApprox(I, N, bias, scale, power);
+    vec3 diff = max(irradianceSH(N), 0.);
+    vec3 spec = textureLod(envSpec, R, roughness * maxSpecularLod).rgb;
+    oColor = vec4(mix(diff, spec, factor), 1.);
+}
@@ -0,0 +1,18 @@
+#version 450
+
+layout(location = 0) out vec2 oPosition;
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main()
+{
+    // full screen triangle
+    vec2 positions[3] = vec2[3](
+        vec2(-1.,-1.),
+        vec2(-1., 3.),
+        vec2( 3.,-1.)
+    );
+    oPosition = positions[gl_VertexIndex];
+    gl_Position = vec4(oPosition, 1., 1.);
+}
@@ -0,0 +1,297 @@
+#include <cmath>
+#include <fstream>
+#include "iblFilter.h"
+#include "../framework/alignedAllocator.h"
+#include "../framework/threadPool.h"
+#include "../framework/utilities.h"
+
+namespace ibl
+{
+namespace
+{
+constexpr float pi = 3.14159265358979f;
+constexpr uint32_t cacheMagic = 0x434C4249; // IBLC
+constexpr uint32_t cacheVersion = 1;
+
+struct CacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash;
+    uint32_t dimension;
+    uint32_t mipLevels;
+    uint64_t dataSize;
+};
+
+// Sample direction in tangent space (N = +Z)
+struct LobeSample
+{
+    float l[3];
+    float weight; // N dot L
+    float lod;
+};
+
+inline float radicalInverse(uint32_t bits) noexcept
+{
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return float(bits) * 2.3283064365386963e-10f;
+}
+
+inline void normalize(float v[3]) noexcept
+{
+    const float invLength = 1.f/sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    v[0] *= invLength; v[1] *= invLength; v[2] *= invLength;
+}
+
+inline uint8_t toUnorm8(float x) noexcept
+{
+    return static_cast<uint8_t>(std::min(std::max(x, 0.f), 1.f) * 255.f + .5f);
+}
+
+inline void storeTexel(__m128 color, uint8_t *dst) noexcept
+{
+    alignas(16) float rgba[4];
+    _mm_store_ps(rgba, color);
+    for (int i = 0; i < 4; ++i)
+        dst[i] = toUnorm8(rgba[i]);
+}
+
+/* Importance sampling of GGX distribution with filtered lookup:
+   each sample fetches from source mip that matches its solid angle.
+   See "GPU-Based Importance Sampling", GPU Gems 3, chapter 20. */
+std::vector<LobeSample> importanceSampleGgx(float roughness, uint32_t sampleCount, uint32_t sourceDimension)
+{
+    const float alpha = roughness * roughness;
+    const float alpha2 = alpha * alpha;
+    const float texelSolidAngle = 4.f * pi/(6.f * sourceDimension * sourceDimension);
+    std::vector<LobeSample> samples;
+    samples.reserve(sampleCount);
+    for (uint32_t i = 0; i < sampleCount; ++i)
+    {
+        const float phi = 2.f * pi * i/sampleCount;
+        const float e = radicalInverse(i);
+        const float cosTheta = sqrtf((1.f - e)/(1.f + (alpha2 - 1.f) * e));
+        const float sinTheta = sqrtf(1.f - cosTheta * cosTheta);
+        const float h[3] = {sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta};
+        // Reflect V = N around H
+        LobeSample sample;
+        sample.l[0] = 2.f * cosTheta * h[0];
+        sample.l[1] = 2.f * cosTheta * h[1];
+        sample.l[2] = 2.f * cosTheta * h[2] - 1.f;
+        sample.weight = sample.l[2];
+        if (sample.weight <= 0.f)
+            continue;
+        const float d = (cosTheta * cosTheta) * (alpha2 - 1.f) + 1.f;
+        const float ggx = alpha2/(pi * d * d);
+        const float pdf = ggx * .25f; // D * NdotH/(4 * VdotH), where V = N
+        const float sampleSolidAngle = 1.f/(sampleCount * pdf + 1e-6f);
+        sample.lod = std::max(.5f * log2f(sampleSolidAngle/texelSolidAngle) + 1.f, 0.f);
+        samples.push_back(sample);
+    }
+    return samples;
+}
+
+void filterLevel(const CubeMap& radiance, const std::vector<LobeSample>& samples,
+    uint32_t level, FilteredCubeMap& cubeMap, ThreadPool& threadPool)
+{
+    const uint32_t dim = cubeMap.getDimension(level);
+    float totalWeight = 0.f;
+    for (const LobeSample& sample : samples)
+        totalWeight += sample.weight;
+    const __m128 invTotalWeight = _mm_set1_ps(1.f/totalWeight);
+    threadPool.parallelFor(CubeMap::NumFaces * dim,
+        [&](uint32_t first, uint32_t last)
+        {
+            for (uint32_t row = first; row < last; ++row)
+            {
+                const uint32_t face = row/dim;
+                const uint32_t y = row % dim;
+                uint8_t *dst = cubeMap.data.data() + cubeMap.getMipOffset(face, level) + y * dim * 4;
+                for (uint32_t x = 0; x < dim; ++x, dst += 4)
+                {
+                    float n[3];
+                    CubeMap::texelDirection(face, x, y, dim, n);
+                    normalize(n);
+                    // Build tangent frame around normal
+                    float up[3] = {0.f, 0.f, 1.f};
+                    if (fabsf(n[2]) > .999f)
+                    {
+                        up[0] = 1.f;
+                        up[2] = 0.f;
+                    }
+                    float t[3] = {up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0]};
+                    normalize(t);
+                    const float b[3] = {n[1] * t[2] - n[2] * t[1], n[2] * t[0] - n[0] * t[2], n[0] * t[1] - n[1] * t[0]};
+                    __m128 color = _mm_setzero_ps();
+                    for (const LobeSample& sample : samples)
+                    {
+                        const float l[3] = {
+                            t[0] * sample.l[0] + b[0] * sample.l[1] + n[0] * sample.l[2],
+                            t[1] * sample.l[0] + b[1] * sample.l[1] + n[1] * sample.l[2],
+                            t[2] * sample.l[0] + b[2] * sample.l[1] + n[2] * sample.l[2]};
+                        const __m128 radianceSample = radiance.sample(l, sample.lod);
+                        color = _mm_add_ps(color, _mm_mul_ps(radianceSample, _mm_set1_ps(sample.weight)));
+                    }
+                    storeTexel(_mm_mul_ps(color, invTotalWeight), dst);
+                }
+            }
+        });
+}
+} // namespace
+
+size_t FilteredCubeMap::getMipOffset(uint32_t face, uint32_t level) const noexcept
+{
+    size_t faceSize = 0, levelOffset = 0;
+    for (uint32_t i = 0; i < mipLevels; ++i)
+    {
+        if (i == level)
+            levelOffset = faceSize;
+        faceSize += getMipSize(i);
+    }
+    return face * faceSize + levelOffset;
+}
+
+size_t FilteredCubeMap::getMipSize(uint32_t level) const noexcept
+{
+    const uint32_t dim = getDimension(level);
+    return dim * dim * 4;
+}
+
+FilteredCubeMap prefilterSpecular(const CubeMap& radiance, uint32_t sampleCount, ThreadPool& threadPool)
+{
+    FilteredCubeMap cubeMap;
+    cubeMap.dimension = radiance.getDimension(0);
+    // Stop at 4x4, as lower levels are too blurry to be useful
+    while (cubeMap.getDimension(cubeMap.mipLevels) >= 4)
+        ++cubeMap.mipLevels;
+    cubeMap.mipLevels = std::max(1U, cubeMap.mipLevels);
+    cubeMap.data.resize(cubeMap.getMipOffset(CubeMap::NumFaces, 0));
+    // Mirror reflection for zero roughness
+    for (uint32_t face = 0; face < CubeMap::NumFaces; ++face)
+    {
+        const CubeMap::Texel *src = radiance.getFace(face, 0);
+        uint8_t *dst = cubeMap.data.data() + cubeMap.getMipOffset(face, 0);
+        const uint32_t texelCount = cubeMap.dimension * cubeMap.dimension;
+        for (uint32_t i = 0; i < texelCount; ++i, dst += 4)
+            storeTexel(_mm_loadu_ps(&src[i].r), dst);
+    }
+    for (uint32_t level = 1; level < cubeMap.mipLevels; ++level)
+    {
+        const float roughness = level/float(cubeMap.mipLevels - 1);
+        const std::vector<LobeSample> samples = importanceSampleGgx(roughness, sampleCount, radiance.getDimension(0));
+        filterLevel(radiance, samples, level, cubeMap, threadPool);
+    }
+    return cubeMap;
+}
+
+FilteredCubeMap convolveIrradiance(const CubeMap& radiance, uint32_t dimension, ThreadPool& threadPool)
+{   // Irradiance is low-frequency, so integrate over the small mip level
+    uint32_t sourceLevel = 0;
+    while (sourceLevel + 1 < radiance.getMipLevels() && radiance.getDimension(sourceLevel) > dimension)
+        ++sourceLevel;
+    const uint32_t srcDim = radiance.getDimension(sourceLevel);
+    // Structure of arrays for SIMD: direction, solid angle and color of each source texel
+    const uint32_t texelCount = CubeMap::NumFaces * srcDim * srcDim;
+    const uint32_t paddedCount = (texelCount + 3) & ~3;
+    std::vector<float, utilities::aligned_allocator<float>> soa(paddedCount * 7, 0.f);
+    float *dx = soa.data(), *dy = dx + paddedCount, *dz = dy + paddedCount;
+    float *r = dz + paddedCount, *g = r + paddedCount, *b = g + paddedCount, *a = b + paddedCount;
+    for (uint32_t face = 0, i = 0; face < CubeMap::NumFaces; ++face)
+    {
+        const CubeMap::Texel *src = radiance.getFace(face, sourceLevel);
+        for (uint32_t y = 0; y < srcDim; ++y)
+        {
+            for (uint32_t x = 0; x < srcDim; ++x, ++i)
+            {
+                float dir[3];
+                CubeMap::texelDirection(face, x, y, srcDim, dir);
+                normalize(dir);
+                // Premultiply radiance by solid angle and 1/pi of Lambertian BRDF
+                const float weight = CubeMap::texelSolidAngle(x, y, srcDim)/pi;
+                const CubeMap::Texel& texel = src[y * srcDim + x];
+                dx[i] = dir[0]; dy[i] = dir[1]; dz[i] = dir[2];
+                r[i] = texel.r * weight; g[i] = texel.g * weight; b[i] = texel.b * weight;
+                a[i] = texel.a * weight;
+            }
+        }
+    }
+    FilteredCubeMap cubeMap;
+    cubeMap.dimension = dimension;
+    cubeMap.mipLevels = 1;
+    cubeMap.data.resize(cubeMap.getMipOffset(CubeMap::NumFaces, 0));
+    threadPool.parallelFor(CubeMap::NumFaces * dimension,
+        [&](uint32_t first, uint32_t last)
+        {
+            for (uint32_t row = first; row < last; ++row)
+            {
+                const uint32_t face = row/dimension;
+                const uint32_t y = row % dimension;
+                uint8_t *dst = cubeMap.data.data() + cubeMap.getMipOffset(face, 0) + y * dimension * 4;
+                for (uint32_t x = 0; x < dimension; ++x, dst += 4)
+                {
+                    float n[3];
+                    CubeMap::texelDirection(face, x, y, dimension, n);
+                    normalize(n);
+                    const __m128 nx = _mm_set1_ps(n[0]), ny = _mm_set1_ps(n[1]), nz = _mm_set1_ps(n[2]);
+                    __m128 sumR = _mm_setzero_ps(), sumG = _mm_setzero_ps(), sumB = _mm_setzero_ps(), sumA = _mm_setzero_ps();
+                    for (uint32_t i = 0; i < paddedCount; i += 4)
+                    {   // max(0, N dot L) for four source texels
+                        __m128 cosTheta = _mm_mul_ps(nx, _mm_load_ps(dx + i));
+                        cosTheta = _mm_add_ps(cosTheta, _mm_mul_ps(ny, _mm_load_ps(dy + i)));
+                        cosTheta = _mm_add_ps(cosTheta, _mm_mul_ps(nz, _mm_load_ps(dz + i)));
+                        cosTheta = _mm_max_ps(cosTheta, _mm_setzero_ps());
+                        sumR = _mm_add_ps(sumR, _mm_mul_ps(cosTheta, _mm_load_ps(r + i)));
+                        sumG = _mm_add_ps(sumG, _mm_mul_ps(cosTheta, _mm_load_ps(g + i)));
+                        sumB = _mm_add_ps(sumB, _mm_mul_ps(cosTheta, _mm_load_ps(b + i)));
+                        sumA = _mm_add_ps(sumA, _mm_mul_ps(cosTheta, _mm_load_ps(a + i)));
+                    }
+                    // Horizontal sum: transpose so that each register holds one channel sum
+                    _MM_TRANSPOSE4_PS(sumR, sumG, sumB, sumA);
+                    storeTexel(_mm_add_ps(_mm_add_ps(sumR, sumG), _mm_add_ps(sumB, sumA)), dst);
+                }
+            }
+        });
+    return cubeMap;
+}
+
+bool loadCache(const std::string& filename, uint64_t sourceHash, FilteredCubeMap& cubeMap)
+{
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open())
+        return false;
+    CacheHeader header;
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(CacheHeader)))
+        return false;
+    if (header.magic != cacheMagic ||
+        header.version != cacheVersion ||
+        header.sourceHash != sourceHash)
+        return false;
+    cubeMap.dimension = header.dimension;
+    cubeMap.mipLevels = header.mipLevels;
+    if (cubeMap.getMipOffset(CubeMap::NumFaces, 0) != header.dataSize)
+        return false;
+    cubeMap.data.resize(static_cast<size_t>(header.dataSize));
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(cubeMap.data.data()), header.dataSize));
+}
+
+bool saveCache(const std::string& filename, uint64_t sourceHash, const FilteredCubeMap& cubeMap)
+{
+    CacheHeader header;
+    header.magic = cacheMagic;
+    header.version = cacheVersion;
+    header.sourceHash = sourceHash;
+    header.dimension = cubeMap.dimension;
+    header.mipLevels = cubeMap.mipLevels;
+    header.dataSize = cubeMap.data.size();
+    return utilities::writeCacheFile(filename,
+        [&](std::ostream& file)
+        {
+            file.write(reinterpret_cast<const char *>(&header), sizeof(CacheHeader));
+            file.write(reinterpret_cast<const char *>(cubeMap.data.data()), cubeMap.data.size());
+        });
+}
+} // namespace ibl
@@ -0,0 +1,31 @@
+#pragma once
+#include <string>
+#include <algorithm>
+#include "cubeMap.h"
+
+class ThreadPool;
+
+/* Image-based lighting preprocessing. Radiance is prefiltered with GGX lobe
+   of increasing roughness into mip chain, so that rough surfaces need
+   a single texture fetch. Irradiance is convolved with cosine lobe.
+   Results are stored in RGBA8 and may be cached on disk. */
+namespace ibl
+{
+    struct FilteredCubeMap
+    {
+        uint32_t dimension = 0;
+        uint32_t mipLevels = 0;
+        std::vector<uint8_t> data; // Face-major, RGBA8
+
+        uint32_t getDimension(uint32_t level) const noexcept { return std::max(1U, dimension >> level); }
+        size_t getMipOffset(uint32_t face, uint32_t level) const noexcept;
+        size_t getMipSize(uint32_t level) const noexcept;
+    };
+
+    FilteredCubeMap prefilterSpecular(const CubeMap& radiance, uint32_t sampleCount, ThreadPool& threadPool);
+    FilteredCubeMap convolveIrradiance(const CubeMap& radiance, uint32_t dimension, ThreadPool& threadPool);
+    // Hash of source data makes cache invalid when source changes
+    bool loadCache(const std::string& filename, uint64_t sourceHash, FilteredCubeMap& cubeMap);
+    // Returns false if file couldn't be written, failure is reported
+    bool saveCache(const std::string& filename, uint64_t sourceHash, const FilteredCubeMap& cubeMap);
+} // namespace ibl
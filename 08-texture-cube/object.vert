@@ -0,0 +1,22 @@
+#version 450
+
+layout(push_constant) uniform PushConstants {
+    mat4 worldViewProj;
+    vec4 color;
+};
+
+layout(location = 0) in vec4 position;
+layout(location = 1) in vec3 normal;
+
+layout(location = 0) out vec3 oColor;
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main()
+{
+    // cheap shading to make faces distinguishable
+    float shade = .7 + .3 * dot(normalize(normal), normalize(vec3(.3, .8, .5)));
+    oColor = color.rgb * shade;
+    gl_Position = worldViewProj * position;
+}
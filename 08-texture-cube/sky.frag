@@ -0,0 +1,18 @@
+#version 450
+
+layout(push_constant) uniform PushConstants {
+    mat4 invViewProj;
+    vec4 color;
+};
+
+layout(binding = 0) uniform samplerCube environment;
+
+layout(location = 0) in vec2 position;
+
+layout(location = 0) out vec4 oColor;
+
+void main()
+{
+    vec4 dir = invViewProj * vec4(position, 1., 1.);
+    oColor = textureLod(environment, dir.xyz/dir.w, 0.);
+}
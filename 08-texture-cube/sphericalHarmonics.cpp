@@ -0,0 +1,86 @@
+#include <cmath>
+#include <mutex>
+#include "sphericalHarmonics.h"
+#include "cubeMap.h"
+#include "../framework/threadPool.h"
+
+namespace sh
+{
+namespace
+{
+constexpr float pi = 3.14159265358979f;
+// Higher frequencies are cut off by L2 anyway
+constexpr uint32_t maxSourceDimension = 64;
+
+inline void evaluateBasis(const float n[3], float basis[NumCoefficients]) noexcept
+{
+    const float x = n[0], y = n[1], z = n[2];
+    basis[0] = 0.282095f;
+    basis[1] = 0.488603f * y;
+    basis[2] = 0.488603f * z;
+    basis[3] = 0.488603f * x;
+    basis[4] = 1.092548f * x * y;
+    basis[5] = 1.092548f * y * z;
+    basis[6] = 0.315392f * (3.f * z * z - 1.f);
+    basis[7] = 1.092548f * x * z;
+    basis[8] = 0.546274f * (x * x - y * y);
+}
+} // namespace
+
+Irradiance projectIrradiance(const CubeMap& radiance, ThreadPool& threadPool)
+{
+    uint32_t level = 0;
+    while (level + 1 < radiance.getMipLevels() && radiance.getDimension(level) > maxSourceDimension)
+        ++level;
+    const uint32_t dim = radiance.getDimension(level);
+    __m128 sum[NumCoefficients];
+    for (__m128& coeff : sum)
+        coeff = _mm_setzero_ps();
+    float totalSolidAngle = 0.f;
+    std::mutex sumAccess;
+    threadPool.parallelFor(CubeMap::NumFaces * dim,
+        [&](uint32_t first, uint32_t last)
+        {   // Accumulate locally, then merge once per range
+            __m128 partial[NumCoefficients];
+            for (__m128& coeff : partial)
+                coeff = _mm_setzero_ps();
+            float partialSolidAngle = 0.f;
+            for (uint32_t row = first; row < last; ++row)
+            {
+                const uint32_t face = row/dim;
+                const uint32_t y = row % dim;
+                const CubeMap::Texel *texels = radiance.getFace(face, level) + y * dim;
+                for (uint32_t x = 0; x < dim; ++x)
+                {
+                    float n[3];
+                    CubeMap::texelDirection(face, x, y, dim, n);
+                    const float invLength = 1.f/sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                    n[0] *= invLength; n[1] *= invLength; n[2] *= invLength;
+                    const float solidAngle = CubeMap::texelSolidAngle(x, y, dim);
+                    float basis[NumCoefficients];
+                    evaluateBasis(n, basis);
+                    const __m128 color = _mm_mul_ps(_mm_loadu_ps(&texels[x].r), _mm_set1_ps(solidAngle));
+                    for (uint32_t i = 0; i < NumCoefficients; ++i)
+                        partial[i] = _mm_add_ps(partial[i], _mm_mul_ps(color, _mm_set1_ps(basis[i])));
+                    partialSolidAngle += solidAngle;
+                }
+            }
+            std::lock_guard<std::mutex> guard(sumAccess);
+            for (uint32_t i = 0; i < NumCoefficients; ++i)
+                sum[i] = _mm_add_ps(sum[i], partial[i]);
+            totalSolidAngle += partialSolidAngle;
+        });
+    /* Convolution with clamped cosine scales bands by pi, 2pi/3 and pi/4.
+       Result is divided by pi to be directly used as Lambertian radiance.
+       Solid angles are renormalized to compensate for numerical error. */
+    const float bandScale[3] = {1.f, 2.f/3.f, .25f};
+    const float normalization = 4.f * pi/totalSolidAngle;
+    Irradiance irradiance;
+    for (uint32_t i = 0; i < NumCoefficients; ++i)
+    {
+        const uint32_t band = (i < 1) ? 0 : (i < 4 ? 1 : 2);
+        _mm_store_ps(irradiance.coeffs[i], _mm_mul_ps(sum[i], _mm_set1_ps(bandScale[band] * normalization)));
+    }
+    return irradiance;
+}
+} // namespace sh
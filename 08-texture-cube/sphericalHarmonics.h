@@ -0,0 +1,22 @@
+#pragma once
+#include <cstdint>
+
+class CubeMap;
+class ThreadPool;
+
+/* Projection of radiance onto second-order spherical harmonics.
+   Coefficients are convolved with clamped cosine lobe, so that irradiance
+   is evaluated in the shader with a few multiply-adds instead of a cubemap fetch.
+   See "An Efficient Representation for Irradiance Environment Maps". */
+namespace sh
+{
+    constexpr uint32_t NumCoefficients = 9;
+
+    // Layout matches std140 array of vec4
+    struct alignas(16) Irradiance
+    {
+        float coeffs[NumCoefficients][4]; // RGB, w is unused
+    };
+
+    Irradiance projectIrradiance(const CubeMap& radiance, ThreadPool& threadPool);
+} // namespace sh
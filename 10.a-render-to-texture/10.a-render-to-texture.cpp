@@ -1,20 +1,21 @@
 #include "../framework/vulkanApp.h"
 #include "../framework/bufferFromArray.h"
 #include "../framework/utilities.h"
+#include "../framework/renderGraph.h"
 
 class RenderToTextureApp : public VulkanApp
 {
     constexpr static uint32_t fbSize = 128;
+    constexpr static float statisticsInterval = 1000.f; // ms
 
-    struct Framebuffer
+    enum Timestamp
     {
-        std::shared_ptr<magma::ColorAttachment> color;
-        std::shared_ptr<magma::ImageView> colorView;
-        std::shared_ptr<magma::DepthStencilAttachment> depth;
-        std::shared_ptr<magma::ImageView> depthView;
-        std::shared_ptr<magma::RenderPass> renderPass;
-        std::shared_ptr<magma::Framebuffer> framebuffer;
-    } fb;
+        OffscreenBegin = 0,
+        OffscreenEnd,
+        OnscreenBegin,
+        OnscreenEnd,
+        TimestampCount
+    };
 
     struct RtDescriptorSetTable : magma::DescriptorSetTable
     {
@@ -28,30 +29,50 @@ class RenderToTextureApp : public VulkanApp
         MAGMA_REFLECT(texture)
     } setTableTx;
 
+    std::unique_ptr<RenderGraph> renderGraph;
+    RenderGraph::Pass *rtPass = nullptr;
+    std::shared_ptr<magma::ImageView> rtColorView;
     std::shared_ptr<magma::VertexBuffer> vertexBuffer;
     std::shared_ptr<magma::UniformBuffer<rapid::matrix>> uniformBuffer;
     std::shared_ptr<magma::Sampler> nearestSampler;
-    std::shared_ptr<magma::CommandBuffer> rtCmdBuffer;
-    std::shared_ptr<magma::Semaphore> rtSemaphore;
     std::shared_ptr<magma::DescriptorSet> rtDescriptorSet;
     std::shared_ptr<magma::PipelineLayout> rtPipelineLayout;
     std::shared_ptr<magma::GraphicsPipeline> rtPipeline;
     std::shared_ptr<magma::DescriptorSet> txDescriptorSet;
     std::shared_ptr<magma::PipelineLayout> txPipelineLayout;
     std::shared_ptr<magma::GraphicsPipeline> txPipeline;
+    // Render-to-texture in its own submission, for comparison
+    std::shared_ptr<magma::CommandBuffer> rtCmdBuffers[2];
+    std::shared_ptr<magma::Semaphore> rtSemaphore;
+    // Slice of timestamps per frame in flight
+    std::shared_ptr<magma::TimestampQuery> timestamps;
+    bool timestampsWritten[2] = {false, false};
+    double timestampPeriod = 0.; // ns
+    bool separateSubmission = false;
+    bool rebuildCommandBuffers = false;
+    Timer submitTimer;
+    float statisticsTime = 0.f;
+    float submitTime = 0.f;
+    uint32_t statisticsFrames = 0;
+    double offscreenGpuTime = 0.;
+    double gapGpuTime = 0.;
+    double onscreenGpuTime = 0.;
+    uint32_t gpuFrames = 0;
 
 public:
     RenderToTextureApp(const AppEntry& entry):
         VulkanApp(entry, TEXT("10.a - Render to texture"), 512, 512)
     {
         initialize();
-        createFramebuffer({fbSize, fbSize});
+        createRenderGraph({fbSize, fbSize});
         createVertexBuffer();
         createUniformBuffer();
         createSampler();
         setupDescriptorSets();
         setupPipelines();
-        recordOffscreenCommandBuffer(fb);
+        createTimestampQuery();
+        recordOffscreenCommandBuffer(FrontBuffer);
+        recordOffscreenCommandBuffer(BackBuffer);
         recordCommandBuffer(FrontBuffer);
         recordCommandBuffer(BackBuffer);
         timer->run();
@@ -59,23 +80,109 @@ public:
 
     void render(uint32_t bufferIndex) override
     {
-        updateWorldTransform();
-        constexpr VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        graphicsQueue->submit(rtCmdBuffer, stageMask,
-            presentFinished, // Wait for swapchain
-            rtSemaphore, // Signal when render-to-texture finished
-            nullptr);
-        graphicsQueue->submit(commandBuffers[bufferIndex], stageMask,
-            rtSemaphore, // Wait for render-to-texture
-            renderFinished, // Signal when command buffer execution finished
-            (WaitMethod::Fence == waitMethod) ? waitFences[bufferIndex] : nullptr);
+        if (rebuildCommandBuffers)
+        {
+            waitFences[1 - bufferIndex]->wait();
+            recordCommandBuffer(FrontBuffer);
+            recordCommandBuffer(BackBuffer);
+            rebuildCommandBuffers = false;
+        }
+        const float dt = timer->millisecondsElapsed();
+        updateWorldTransform(dt);
+        readTimestamps(bufferIndex);
+        submitTimer.run();
+        if (separateSubmission)
+        {
+            graphicsQueue->submit(rtCmdBuffers[bufferIndex], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                presentFinished, // Wait for swapchain
+                rtSemaphore, // Signal when render-to-texture finished
+                nullptr);
+            // Texture is sampled by fragment shader, so onscreen pass should wait before it
+            graphicsQueue->submit(commandBuffers[bufferIndex], VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                rtSemaphore, // Wait for render-to-texture
+                renderFinished, // Signal when command buffer execution finished
+                (WaitMethod::Fence == waitMethod) ? waitFences[bufferIndex] : nullptr);
+        }
+        else
+        {   // Render-to-texture is recorded into the same command buffer
+            submitCommandBuffer(bufferIndex);
+        }
+        submitTime += submitTimer.millisecondsElapsed();
+        timestampsWritten[bufferIndex] = (timestamps != nullptr);
+        updateStatistics(dt);
     }
 
-    void updateWorldTransform()
+    void onKeyDown(char key, int repeat, uint32_t flags) override
+    {
+        switch (key)
+        {
+        case 'S': case 's':
+            separateSubmission = !separateSubmission;
+            rebuildCommandBuffers = true;
+            resetStatistics();
+            break;
+        }
+        VulkanApp::onKeyDown(key, repeat, flags);
+    }
+
+    void readTimestamps(uint32_t bufferIndex)
+    {   // Fence of this frame has been waited, so results of its previous submission should be ready
+        if (!timestampsWritten[bufferIndex])
+            return;
+        const std::vector<magma::QueryPool::Result<uint64_t, uint64_t>> results =
+            timestamps->getResultsWithAvailability<uint64_t>(bufferIndex * TimestampCount, TimestampCount);
+        for (const auto& result : results)
+        {
+            if (!result.availability)
+                return;
+        }
+        auto elapsed = [this, &results](Timestamp begin, Timestamp end)
+        {   // Milliseconds
+            return (results[end].result - results[begin].result) * timestampPeriod * 1e-6;
+        };
+        offscreenGpuTime += elapsed(OffscreenBegin, OffscreenEnd);
+        gapGpuTime += elapsed(OffscreenEnd, OnscreenBegin);
+        onscreenGpuTime += elapsed(OnscreenBegin, OnscreenEnd);
+        ++gpuFrames;
+    }
+
+    void updateStatistics(float dt)
+    {   /* Two submissions are chained by semaphore, so GPU drains
+           between them; it shows up as gap between the end of offscreen
+           pass and the beginning of onscreen one. */
+        statisticsTime += dt;
+        ++statisticsFrames;
+        if (statisticsTime < statisticsInterval)
+            return;
+        std::cout << (separateSubmission ? "Two submissions: " : "Single submission: ")
+            << submitTime/statisticsFrames << " ms to submit, "
+            << statisticsTime/statisticsFrames << " ms per frame";
+        if (gpuFrames)
+        {
+            std::cout << ", GPU: " << offscreenGpuTime/gpuFrames << " ms offscreen, "
+                << gapGpuTime/gpuFrames << " ms gap, "
+                << onscreenGpuTime/gpuFrames << " ms onscreen";
+        }
+        std::cout << std::endl;
+        resetStatistics();
+    }
+
+    void resetStatistics() noexcept
+    {
+        statisticsTime = 0.f;
+        submitTime = 0.f;
+        statisticsFrames = 0;
+        offscreenGpuTime = 0.;
+        gapGpuTime = 0.;
+        onscreenGpuTime = 0.;
+        gpuFrames = 0;
+    }
+
+    void updateWorldTransform(float dt)
     {
         constexpr float speed = 0.02f;
         static float angle = 0.f;
-        const float step = timer->millisecondsElapsed() * speed;
+        const float step = dt * speed;
         angle += step;
         const rapid::matrix roll = rapid::rotationZ(rapid::radians(angle));
         magma::helpers::mapScoped(uniformBuffer,
@@ -85,37 +192,28 @@ public:
             });
     }
 
-    void createFramebuffer(const VkExtent2D& extent)
+    void createRenderGraph(const VkExtent2D& extent)
     {
-        constexpr bool sampled = true;
-        constexpr bool dontSampled = false;
-        // Create color attachment
-        fb.color = std::make_shared<magma::ColorAttachment>(device, VK_FORMAT_R8G8B8A8_UNORM, extent, 1, 1, sampled);
-        fb.colorView = std::make_shared<magma::ImageView>(fb.color);
-        // Create depth attachment
+        renderGraph = std::make_unique<RenderGraph>(device);
+        const RenderGraph::Resource color = renderGraph->createImage("color", VK_FORMAT_R8G8B8A8_UNORM, extent);
         const VkFormat depthFormat = utilities::getSupportedDepthFormat(physicalDevice, false, true);
-        fb.depth = std::make_shared<magma::DepthStencilAttachment>(device, depthFormat, extent, 1, 1, dontSampled);
-        fb.depthView = std::make_shared<magma::ImageView>(fb.depth);
-        // Don't care about initial layout
-        constexpr VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        // Define that color attachment can be cleared, can store shader output and should be read-only image
-        const magma::AttachmentDescription colorAttachment(fb.color->getFormat(), 1,
-            magma::op::clearStore, // Color clear, store
-            magma::op::dontCare, // Inapplicable
-            initialLayout,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL); // Should be read-only in the shader when a render pass instance ends
-        // Define that depth attachment can be cleared and can store shader output
-        const magma::AttachmentDescription depthAttachment(fb.depth->getFormat(), 1,
-            magma::op::clearStore, // Depth clear, store
-            magma::op::dontCare, // Don't care about stencil
-            initialLayout,
-            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL); // Stay as depth/stencil attachment
-        // Render pass defines attachment formats, load/store operations and final layouts
-        fb.renderPass = std::shared_ptr<magma::RenderPass>(new magma::RenderPass(
-            device, {colorAttachment, depthAttachment}));
-        // Framebuffer defines render pass, color/depth/stencil image views and dimensions
-        fb.framebuffer = std::shared_ptr<magma::Framebuffer>(new magma::Framebuffer(
-            fb.renderPass, {fb.colorView, fb.depthView}));
+        const RenderGraph::Resource depth = renderGraph->createImage("depth", depthFormat, extent);
+        // Graph creates render pass and framebuffer, layout transitions and barriers
+        rtPass = &renderGraph->addPass("render to texture",
+            [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer, const RenderGraph::Pass& pass)
+            {
+                recordOffscreenPass(cmdBuffer, pass);
+            })
+            .writeColor(color)
+            .writeDepth(depth);
+        // Texture is sampled by onscreen pass
+        renderGraph->exportImage(color, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        renderGraph->compile();
+        rtColorView = renderGraph->getImageView(color);
+        const RenderGraph::Statistics& stats = renderGraph->getStatistics();
+        std::cout << "Render graph: " << stats.passCount << " pass(es), " << stats.imageCount << " images in "
+            << stats.physicalImageCount << " physical ones, " << stats.barrierCount << " barriers" << std::endl;
     }
 
     void createVertexBuffer()
@@ -165,7 +263,7 @@ public:
         rtDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
             setTableRt, VK_SHADER_STAGE_VERTEX_BIT,
             nullptr, shaderReflectionFactory, "triangle.o");
-        setTableTx.texture = {fb.colorView, nearestSampler};
+        setTableTx.texture = {rtColorView, nearestSampler};
         txDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
             setTableTx, VK_SHADER_STAGE_FRAGMENT_BIT,
             nullptr, shaderReflectionFactory, "tex.o");
@@ -183,7 +281,7 @@ public:
             magma::renderstate::depthAlwaysDontWrite,
             magma::renderstate::dontBlendRgb,
             rtPipelineLayout,
-            fb.renderPass, 0,
+            rtPass->getRenderPass(), 0,
             pipelineCache);
         txPipelineLayout = std::make_shared<magma::PipelineLayout>(txDescriptorSet->getLayout());
         txPipeline = std::make_shared<GraphicsPipeline>(device,
@@ -199,30 +297,61 @@ public:
             pipelineCache);
     }
 
-    void recordOffscreenCommandBuffer(const Framebuffer& fb)
+    void recordOffscreenPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer, const RenderGraph::Pass& pass)
     {
-        /* VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT specifies that
-           a command buffer can be resubmitted to a queue while it is in
-           the pending state, and recorded into multiple primary command buffers. */
-        rtCmdBuffer = std::make_shared<magma::PrimaryCommandBuffer>(commandPools[0]);
-        rtCmdBuffer->begin(VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
-        {
-            rtCmdBuffer->beginRenderPass(fb.renderPass, fb.framebuffer,
-                {
-                    magma::ClearColor(0.35f, 0.53f, 0.7f, 1.f),
-                    magma::clear::depthOne
-                });
+        cmdBuffer->beginRenderPass(pass.getRenderPass(), pass.getFramebuffer(),
             {
-                rtCmdBuffer->setViewport(magma::Viewport(0, 0, fb.framebuffer->getExtent()));
-                rtCmdBuffer->setScissor(magma::Scissor(0, 0, fb.framebuffer->getExtent()));
-                rtCmdBuffer->bindDescriptorSet(rtPipeline, 0, rtDescriptorSet);
-                rtCmdBuffer->bindPipeline(rtPipeline);
-                rtCmdBuffer->draw(3, 0);
-            }
-            rtCmdBuffer->endRenderPass();
+                magma::ClearColor(0.35f, 0.53f, 0.7f, 1.f),
+                magma::clear::depthOne
+            });
+        {
+            cmdBuffer->setViewport(magma::Viewport(0, 0, pass.getFramebuffer()->getExtent()));
+            cmdBuffer->setScissor(magma::Scissor(0, 0, pass.getFramebuffer()->getExtent()));
+            cmdBuffer->bindDescriptorSet(rtPipeline, 0, rtDescriptorSet);
+            cmdBuffer->bindPipeline(rtPipeline);
+            cmdBuffer->draw(3, 0);
+        }
+        cmdBuffer->endRenderPass();
+    }
+
+    void createTimestampQuery()
+    {
+        const VkPhysicalDeviceLimits& limits = physicalDevice->getProperties().limits;
+        if (!limits.timestampComputeAndGraphics)
+        {
+            std::cout << "Timestamps are not supported by graphics queue, GPU time won't be measured" << std::endl;
+            return;
+        }
+        timestamps = std::make_shared<magma::TimestampQuery>(device, TimestampCount * 2);
+        timestampPeriod = limits.timestampPeriod;
+    }
+
+    void writeTimestamp(std::shared_ptr<magma::CommandBuffer> cmdBuffer, VkPipelineStageFlagBits stage,
+        uint32_t index, Timestamp timestamp)
+    {
+        if (timestamps)
+            cmdBuffer->writeTimestamp(stage, timestamps, index * TimestampCount + timestamp);
+    }
+
+    void recordOffscreenPasses(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t index)
+    {   // Offscreen pass comes first in both paths, so it resets timestamps of the frame
+        if (timestamps)
+            cmdBuffer->resetQueryPool(timestamps, index * TimestampCount, TimestampCount);
+        writeTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, index, OffscreenBegin);
+        renderGraph->record(cmdBuffer);
+        writeTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, index, OffscreenEnd);
+    }
+
+    void recordOffscreenCommandBuffer(uint32_t index)
+    {   // One per frame in flight, as each one writes its own slice of timestamps
+        rtCmdBuffers[index] = std::make_shared<magma::PrimaryCommandBuffer>(commandPools[0]);
+        rtCmdBuffers[index]->begin();
+        {
+            recordOffscreenPasses(rtCmdBuffers[index], index);
         }
-        rtCmdBuffer->end();
-        rtSemaphore = std::make_shared<magma::Semaphore>(device);
+        rtCmdBuffers[index]->end();
+        if (!rtSemaphore)
+            rtSemaphore = std::make_shared<magma::Semaphore>(device);
     }
 
     void recordCommandBuffer(uint32_t index)
@@ -230,6 +359,9 @@ public:
         std::shared_ptr<magma::CommandBuffer> cmdBuffer = commandBuffers[index];
         cmdBuffer->begin();
         {
+            if (!separateSubmission)
+                recordOffscreenPasses(cmdBuffer, index);
+            writeTimestamp(cmdBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, index, OnscreenBegin);
             cmdBuffer->beginRenderPass(renderPass, framebuffers[index],
                 {
                     magma::clear::gray
@@ -243,6 +375,7 @@ public:
                 cmdBuffer->draw(4, 0);
             }
             cmdBuffer->endRenderPass();
+            writeTimestamp(cmdBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, index, OnscreenEnd);
         }
         cmdBuffer->end();
     }
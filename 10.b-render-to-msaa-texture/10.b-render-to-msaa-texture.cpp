@@ -1,6 +1,7 @@
 #include "../framework/vulkanApp.h"
 #include "../framework/bufferFromArray.h"
 #include "../framework/utilities.h"
+#include "../framework/renderGraph.h"
 
 /* MSAA resolve operation may happen in the end of render pass
    if resolve attachment is specified or programmer may perform
@@ -9,20 +10,7 @@
 
 class RenderToMsaaTextureApp : public VulkanApp
 {
-    struct Framebuffer
-    {
-        constexpr static VkExtent2D extent = {128, 128};
-
-        std::shared_ptr<magma::ColorAttachment> colorMsaa;
-        std::shared_ptr<magma::ImageView> colorMsaaView;
-        std::shared_ptr<magma::DepthStencilAttachment> depthMsaa;
-        std::shared_ptr<magma::ImageView> depthMsaaView;
-        std::shared_ptr<magma::ColorAttachment> colorResolve;
-        std::shared_ptr<magma::ImageView> colorResolveView;
-        std::shared_ptr<magma::RenderPass> renderPass;
-        std::shared_ptr<magma::Framebuffer> framebuffer;
-        uint32_t sampleCount = 0;
-    } fb;
+    constexpr static uint32_t fbSize = 128;
 
     struct RtDescriptorSetTable : magma::DescriptorSetTable
     {
@@ -36,11 +24,13 @@ class RenderToMsaaTextureApp : public VulkanApp
         MAGMA_REFLECT(texture)
     } setTableTx;
 
+    std::unique_ptr<RenderGraph> renderGraph;
+    RenderGraph::Pass *rtPass = nullptr;
+    std::shared_ptr<magma::ImageView> rtColorView;
+    uint32_t sampleCount = 0;
     std::shared_ptr<magma::VertexBuffer> vertexBuffer;
     std::shared_ptr<magma::UniformBuffer<rapid::matrix>> uniformBuffer;
     std::shared_ptr<magma::Sampler> nearestSampler;
-    std::shared_ptr<magma::CommandBuffer> rtCmdBuffer;
-    std::shared_ptr<magma::Semaphore> rtSemaphore;
     std::shared_ptr<magma::DescriptorSet> rtDescriptorSet;
     std::shared_ptr<magma::PipelineLayout> rtPipelineLayout;
     std::shared_ptr<magma::GraphicsPipeline> rtPipeline;
@@ -53,13 +43,12 @@ public:
         VulkanApp(entry, TEXT("10.b - Render to multisample texture"), 512, 512)
     {
         initialize();
-        createMultisampleFramebuffer(Framebuffer::extent);
+        createRenderGraph({fbSize, fbSize});
         createVertexBuffer();
         createUniformBuffer();
         createSampler();
         setupDescriptorSet();
         setupPipelines();
-        recordOffscreenCommandBuffer(fb);
         recordCommandBuffer(FrontBuffer);
         recordCommandBuffer(BackBuffer);
         timer->run();
@@ -68,15 +57,8 @@ public:
     void render(uint32_t bufferIndex) override
     {
         updateWorldTransform();
-        constexpr VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        graphicsQueue->submit(rtCmdBuffer, stageMask,
-            presentFinished, // Wait for swapchain
-            rtSemaphore, // Signal when render-to-texture finished
-            nullptr);
-        graphicsQueue->submit(commandBuffers[bufferIndex], stageMask,
-            rtSemaphore, // Wait for render-to-texture
-            renderFinished, // Signal when command buffer execution finished
-            (WaitMethod::Fence == waitMethod) ? waitFences[bufferIndex] : nullptr);
+        // Render-to-texture is recorded into the same command buffer
+        submitCommandBuffer(bufferIndex);
     }
 
     void updateWorldTransform()
@@ -93,62 +75,56 @@ public:
             });
     }
 
-    void createMultisampleFramebuffer(const VkExtent2D& extent)
+    void createRenderGraph(const VkExtent2D& extent)
     {
-        constexpr bool sampled = true;
-        constexpr bool dontSampled = false;
+        renderGraph = std::make_unique<RenderGraph>(device);
         // Choose supported multisample level
-        fb.sampleCount = utilities::getSupportedMultisampleLevel(physicalDevice, VK_FORMAT_R8G8B8A8_UNORM);
-        // Create multisample color attachment
-        fb.colorMsaa = std::make_shared<magma::ColorAttachment>(device, VK_FORMAT_R8G8B8A8_UNORM, extent, 1, fb.sampleCount, dontSampled,
-            nullptr, MSAA_EXPLICIT_RESOLVE);
-        fb.colorMsaaView = std::make_shared<magma::ImageView>(fb.colorMsaa);
-        // Create multisample depth attachment
+        sampleCount = utilities::getSupportedMultisampleLevel(physicalDevice, VK_FORMAT_R8G8B8A8_UNORM);
+        const RenderGraph::Resource colorMsaa = renderGraph->createImage("color MSAA", VK_FORMAT_R8G8B8A8_UNORM, extent, sampleCount);
         const VkFormat depthFormat = utilities::getSupportedDepthFormat(physicalDevice, false, true);
-        fb.depthMsaa = std::make_shared<magma::DepthStencilAttachment>(device, depthFormat, extent, 1, fb.sampleCount, dontSampled);
-        fb.depthMsaaView = std::make_shared<magma::ImageView>(fb.depthMsaa);
-        // Create color resolve attachment
-        fb.colorResolve = std::make_shared<magma::ColorAttachment>(device, fb.colorMsaa->getFormat(), extent, 1, 1, sampled,
-            nullptr, MSAA_EXPLICIT_RESOLVE);
-        fb.colorResolveView = std::make_shared<magma::ImageView>(fb.colorResolve);
-        // Don't care about initial layout
-        constexpr VkImageLayout initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        // Define that multisample color attachment can be cleared and can store shader output
-        const magma::AttachmentDescription colorMsaaAttachment(fb.colorMsaa->getFormat(), fb.colorMsaa->getSamples(),
-            // Typically, after the multisampled image is resolved, we don't need the
-            // multisampled image anymore. Therefore, the multisampled image must be
-            // discarded by using STORE_OP_DONT_CARE.
-            magma::op::clear, // Color clear, don't care about store
-            magma::op::dontCare, // Inapplicable
-            initialLayout,
-            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL); // Stay as color attachment
-        // Define that multisample depth attachment can be cleared and can store shader output
-        const magma::AttachmentDescription depthMsaaAttachment(fb.depthMsaa->getFormat(), fb.depthMsaa->getSamples(),
-            magma::op::clear, // Depth clear, don't care about store
-            magma::op::dontCare, // Don't care about stencil
-            initialLayout,
-            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL); // Stay as depth/stencil attachment
+        const RenderGraph::Resource depthMsaa = renderGraph->createImage("depth MSAA", depthFormat, extent, sampleCount);
+        const RenderGraph::Resource colorResolve = renderGraph->createImage("color resolve", VK_FORMAT_R8G8B8A8_UNORM, extent);
+        // Graph creates render passes and framebuffers, layout transitions and barriers
+        rtPass = &renderGraph->addPass("render to MSAA texture",
+            [this](std::shared_ptr<magma::CommandBuffer> cmdBuffer, const RenderGraph::Pass& pass)
+            {
+                recordOffscreenPass(cmdBuffer, pass);
+            })
+            .writeColor(colorMsaa)
+            .writeDepth(depthMsaa);
     #if MSAA_EXPLICIT_RESOLVE
-        // Render pass defines attachment formats, load/store operations and final layouts
-        fb.renderPass = std::shared_ptr<magma::RenderPass>(new magma::RenderPass(
-            device, {colorMsaaAttachment, depthMsaaAttachment}));
-        // Framebuffer defines render pass, color/depth/stencil image views and dimensions
-        fb.framebuffer = std::shared_ptr<magma::Framebuffer>(new magma::Framebuffer(
-            fb.renderPass, {fb.colorMsaaView, fb.depthMsaaView}));
+        /* Normally multisample resolve happens in the vkEndRenderPass()
+           if resolve attachment is provided. Otherwise, we must resolve
+           a multisample color image to a non-multisample one using
+           vkCmdResolveImage() call. */
+        renderGraph->addPass("resolve",
+            [this, colorMsaa, colorResolve](std::shared_ptr<magma::CommandBuffer> cmdBuffer, const RenderGraph::Pass&)
+            {
+                cmdBuffer->resolveImage(renderGraph->getImage(colorMsaa), renderGraph->getImage(colorResolve));
+            })
+            .copyFrom(colorMsaa)
+            .copyTo(colorResolve);
     #else
-        // Define that resolve attachment doesn't care about clear and should be read-only image
-        const magma::AttachmentDescription colorResolveAttachment(fb.colorResolve->getFormat(), 1,
-            magma::op::store, // Don't care about clear as it will be used as MSAA resolve target
-            magma::op::dontCare,
-            initialLayout,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL); // Should be read-only in the shader when a render pass instance ends
-        // Render pass defines attachment formats, load/store operations and final layouts
-        fb.renderPass = std::shared_ptr<magma::RenderPass>(new magma::RenderPass(
-            device, {colorMsaaAttachment, depthMsaaAttachment, colorResolveAttachment}));
-        // Framebuffer defines render pass, color/depth/stencil image views and dimensions
-        fb.framebuffer = std::shared_ptr<magma::Framebuffer>(new magma::Framebuffer(
-            fb.renderPass, {fb.colorMsaaView, fb.depthMsaaView, fb.colorResolveView}));
+        rtPass->resolve(colorResolve);
     #endif // MSAA_EXPLICIT_RESOLVE
+        // Texture is sampled by onscreen pass
+        renderGraph->exportImage(colorResolve, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+        renderGraph->compile();
+        rtColorView = renderGraph->getImageView(colorResolve);
+        const RenderGraph::Statistics& stats = renderGraph->getStatistics();
+        std::cout << "Render graph: " << stats.passCount << " pass(es), " << stats.imageCount << " images in "
+            << stats.physicalImageCount << " physical ones, " << stats.barrierCount << " barriers, single submission per frame" << std::endl;
+        // MSAA attachments that are never stored don't need memory on tiler
+        if (stats.transientImageCount)
+        {
+            std::cout << stats.transientImageCount << " transient attachment(s), " << stats.lazilyAllocatedImageCount
+                << " of them in lazily allocated memory (" << stats.lazilyAllocatedMemorySize / 1024 << " KiB per framebuffer)" << std::endl;
+        }
+        else if (!stats.lazilyAllocated)
+        {
+            std::cout << "Lazily allocated memory isn't supported, MSAA attachments use device memory" << std::endl;
+        }
     }
 
     void createVertexBuffer()
@@ -198,7 +174,7 @@ public:
         rtDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
             setTableRt, VK_SHADER_STAGE_VERTEX_BIT,
             nullptr, shaderReflectionFactory, "triangle.o");
-        setTableTx.texture = {fb.colorResolveView, nearestSampler};
+        setTableTx.texture = {rtColorView, nearestSampler};
         txDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
             setTableTx, VK_SHADER_STAGE_FRAGMENT_BIT,
             nullptr, shaderReflectionFactory, "tex.o");
@@ -212,11 +188,11 @@ public:
             magma::renderstate::nullVertexInput,
             magma::renderstate::triangleList,
             magma::renderstate::fillCullBackCcw,
-            magma::MultisampleState(fb.sampleCount),
+            magma::MultisampleState(sampleCount),
             magma::renderstate::depthAlwaysDontWrite,
             magma::renderstate::dontBlendRgb,
             rtPipelineLayout,
-            fb.renderPass, 0,
+            rtPass->getRenderPass(), 0,
             pipelineCache);
         txPipelineLayout = std::make_shared<magma::PipelineLayout>(txDescriptorSet->getLayout());
         txPipeline = std::make_shared<GraphicsPipeline>(device,
@@ -232,48 +208,21 @@ public:
             pipelineCache);
     }
 
-    void msaaResolve(const Framebuffer& fb)
+    void recordOffscreenPass(std::shared_ptr<magma::CommandBuffer> cmdBuffer, const RenderGraph::Pass& pass)
     {
-        fb.colorMsaa->layoutTransition(VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, rtCmdBuffer);
-        fb.colorResolve->layoutTransition(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, rtCmdBuffer);
-        {
-            rtCmdBuffer->resolveImage(fb.colorMsaa, fb.colorResolve);
-        }
-        fb.colorMsaa->layoutTransition(VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, rtCmdBuffer);
-        fb.colorResolve->layoutTransition(VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, rtCmdBuffer);
-    }
-
-    void recordOffscreenCommandBuffer(const Framebuffer& fb)
-    {
-        /* VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT specifies that
-           a command buffer can be resubmitted to a queue while it is in
-           the pending state, and recorded into multiple primary command buffers. */
-        rtCmdBuffer = std::make_shared<magma::PrimaryCommandBuffer>(commandPools[0]);
-        rtCmdBuffer->begin(VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT);
-        {
-            rtCmdBuffer->beginRenderPass(fb.renderPass, fb.framebuffer,
-                {
-                    magma::ClearColor(0.35f, 0.53f, 0.7f, 1.f),
-                    magma::clear::depthOne
-                });
+        cmdBuffer->beginRenderPass(pass.getRenderPass(), pass.getFramebuffer(),
             {
-                rtCmdBuffer->setViewport(magma::Viewport(0, 0, fb.framebuffer->getExtent()));
-                rtCmdBuffer->setScissor(magma::Scissor(0, 0, fb.framebuffer->getExtent()));
-                rtCmdBuffer->bindDescriptorSet(rtPipeline, 0, rtDescriptorSet);
-                rtCmdBuffer->bindPipeline(rtPipeline);
-                rtCmdBuffer->draw(3, 0);
-            }
-            rtCmdBuffer->endRenderPass();
-        #if MSAA_EXPLICIT_RESOLVE
-            /* Normally multisample resolve happens in the vkEndRenderPass()
-               if resolve attachment is provided. Otherwise, we must resolve
-               a multisample color image to a non-multisample one using
-               vkCmdResolveImage() call. */
-            msaaResolve(fb);
-        #endif // MSAA_EXPLICIT_RESOLVE
+                magma::ClearColor(0.35f, 0.53f, 0.7f, 1.f),
+                magma::clear::depthOne
+            });
+        {
+            cmdBuffer->setViewport(magma::Viewport(0, 0, pass.getFramebuffer()->getExtent()));
+            cmdBuffer->setScissor(magma::Scissor(0, 0, pass.getFramebuffer()->getExtent()));
+            cmdBuffer->bindDescriptorSet(rtPipeline, 0, rtDescriptorSet);
+            cmdBuffer->bindPipeline(rtPipeline);
+            cmdBuffer->draw(3, 0);
         }
-        rtCmdBuffer->end();
-        rtSemaphore = std::make_shared<magma::Semaphore>(device);
+        cmdBuffer->endRenderPass();
     }
 
     void recordCommandBuffer(uint32_t index)
@@ -281,6 +230,7 @@ public:
         std::shared_ptr<magma::CommandBuffer> cmdBuffer = commandBuffers[index];
         cmdBuffer->begin();
         {
+            renderGraph->record(cmdBuffer);
             cmdBuffer->beginRenderPass(renderPass, framebuffers[index],
                 {
                     magma::clear::gray
@@ -1,10 +1,61 @@
+#include <cstddef>
 #include "../framework/vulkanApp.h"
+#include "../framework/utilities.h"
+#include "../framework/bezierMesh.h"
+#include "../framework/threadPool.h"
+#include "../framework/storageBuffers.h"
+#include "../framework/depthRasterizer.h"
+#include "../framework/timer.h"
+#include "../framework/bufferFromArray.h"
 #include "quadric/include/plane.h"
-#include "quadric/include/teapot.h"
+#include "../framework/teapot.h"
+#include "occlusionQueryRing.h"
+#include "depthPyramid.h"
+#include "predicateBuffer.h"
+#include "coherentCulling.h"
 
 // Use L button + mouse to rotate scene
+// Use Space to toggle between waiting for query result and reading it a few frames later
+// Use H to toggle between single occlusion query and Hi-Z culling of teapot field
+// Use S to toggle between single occlusion query and CPU software culling of teapot field
+// Use C to toggle between single occlusion query and conditional rendering of teapot
+// Use T to toggle between single occlusion query and temporally coherent query culling of teapot field
 class OcclusionQueryApp : public VulkanApp
 {
+    constexpr static float statisticsInterval = 2000.f; // Milliseconds
+    constexpr static uint32_t fieldDimension = 16; // Cube of teapots behind the plane
+    constexpr static uint32_t fieldObjectCount = fieldDimension * fieldDimension * fieldDimension;
+    constexpr static float fieldSpacing = .32f;
+    constexpr static float fieldScale = .04f;
+    constexpr static uint32_t cullGroupSize = 64; // Should match local_size_x of hiZCull.comp
+    constexpr static uint32_t rasterizerWidth = 256;
+    constexpr static uint32_t rasterizerHeight = 128;
+    constexpr static uint32_t proxyIndexCount = 36; // Box
+    constexpr static uint32_t retestInterval = 8; // Frames between queries of visible object
+
+    enum class Mode : uint32_t
+    {
+        Query = 0, HiZ, Software, Conditional, Coherent
+    };
+
+    // Matches uniform block of hiZCull.comp
+    struct HiZCullParameters
+    {
+        rapid::matrix viewProj;
+        rapid::float4 boundingSphere;
+        float depthSize[2];
+        float flipY;
+        uint32_t objectCount;
+    };
+
+    // Matches uniform block of instanced.vert
+    struct FieldTransforms
+    {
+        rapid::matrix objectTransform;
+        rapid::matrix viewProj;
+        rapid::float4 color;
+    };
+
     struct TransformSetTable : magma::DescriptorSetTable
     {
         magma::descriptor::DynamicUniformBuffer worldViewProj = 0;
@@ -17,17 +68,79 @@ class OcclusionQueryApp : public VulkanApp
         MAGMA_REFLECT(color)
     } setTable1;
 
+    struct HiZCullSetTable : magma::DescriptorSetTable
+    {
+        magma::descriptor::UniformBuffer pyramid = 0;
+        magma::descriptor::StorageBuffer pyramidLevels = 1;
+        magma::descriptor::UniformBuffer parameters = 2;
+        magma::descriptor::StorageBuffer objects = 3;
+        magma::descriptor::StorageBuffer visibleInstances = 4;
+        magma::descriptor::StorageBuffer drawCommand = 5;
+        MAGMA_REFLECT(pyramid, pyramidLevels, parameters, objects, visibleInstances, drawCommand)
+    } hiZCullSetTable;
+
+    struct FieldSetTable : magma::DescriptorSetTable
+    {
+        magma::descriptor::UniformBuffer transforms = 0;
+        MAGMA_REFLECT(transforms)
+    } fieldSetTable;
+
     std::unique_ptr<quadric::Plane> plane;
-    std::unique_ptr<quadric::Teapot> teapot;
-    std::shared_ptr<magma::OcclusionQuery> occlusionQuery;
+    std::unique_ptr<BezierPatchMesh> teapot;
+    std::unique_ptr<OcclusionQueryRing> occlusionQueries;
     std::shared_ptr<magma::DynamicUniformBuffer<rapid::matrix>> transformUniforms;
     std::shared_ptr<magma::DynamicUniformBuffer<rapid::vector4>> colorUniforms;
     std::shared_ptr<magma::DescriptorSet> descriptorSets[2];
     std::shared_ptr<magma::PipelineLayout> pipelineLayout;
     std::shared_ptr<magma::GraphicsPipeline> teapotPipeline;
     std::shared_ptr<magma::GraphicsPipeline> planePipeline;
+    std::shared_ptr<magma::GraphicsPipeline> proxyPipeline;
+    std::shared_ptr<magma::VertexBuffer> proxyVertices;
+    std::shared_ptr<magma::IndexBuffer> proxyIndices;
+#ifdef VK_EXT_conditional_rendering
+    std::shared_ptr<PredicateBuffer> predicates;
+#endif
+    std::unique_ptr<DepthPyramid> depthPyramid;
+    std::shared_ptr<magma::StorageBuffer> fieldOffsets;
+    std::shared_ptr<StorageVertexBuffer> visibleInstances;
+    std::shared_ptr<StorageIndirectBuffer> drawCommand;
+    std::shared_ptr<magma::DstTransferBuffer> drawCommandReadback[2];
+    std::shared_ptr<magma::UniformBuffer<HiZCullParameters>> hiZCullUniforms;
+    std::shared_ptr<magma::UniformBuffer<FieldTransforms>> fieldUniforms;
+    std::shared_ptr<magma::DescriptorSet> hiZCullDescriptorSet;
+    std::shared_ptr<magma::DescriptorSet> fieldDescriptorSet;
+    std::shared_ptr<magma::PipelineLayout> hiZCullPipelineLayout;
+    std::shared_ptr<magma::ComputePipeline> hiZCullPipeline;
+    std::shared_ptr<magma::PipelineLayout> fieldPipelineLayout;
+    std::shared_ptr<magma::GraphicsPipeline> fieldPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> fieldProxyPipeline;
+    std::unique_ptr<CoherentCulling> coherentCulling;
+    std::unique_ptr<DepthRasterizer> rasterizer;
+    std::unique_ptr<ThreadPool> threadPool;
+    std::shared_ptr<magma::DynamicVertexBuffer> fieldInstances[2];
+    std::vector<rapid::float4> fieldObjects;
 
     rapid::matrix viewProj;
+    rapid::matrix planeViewProj;
+    rapid::matrix fieldViewProj;
+    rapid::float4 fieldBoundingSphere;
+    Mode mode = Mode::Query;
+    uint32_t teapotQuery = 0;
+    uint32_t fieldQueryBase = 0;
+    bool conditionalRendering = false;
+    bool teapotVisible = true;
+    bool recordedVisibility[2] = {true, true};
+    bool rebuildCommandBuffers = false;
+    uint32_t visibleObjectCount = 0;
+    uint32_t softwareVisibleCounts[2] = {0, 0};
+    bool waitForResult = false;
+    float statisticsTime = 0.f;
+    uint32_t statisticsFrames = 0;
+    Timer cullTimer;
+    float rasterizationTime = 0.f;
+    float testTime = 0.f;
+    uint64_t issuedQueryCount = 0;
+    uint64_t drawnObjectCount = 0;
 
 public:
     OcclusionQueryApp(const AppEntry& entry):
@@ -37,41 +150,309 @@ public:
         setupView();
         createOcclusionQuery();
         createMeshes();
+        createProxy();
+        createField();
         createUniformBuffer();
         setupDescriptorSet();
         setupPipeline();
+        setupHiZCullPipeline();
         recordCommandBuffer(FrontBuffer);
         recordCommandBuffer(BackBuffer);
+        timer->run();
     }
 
     void render(uint32_t bufferIndex) override
     {
+        if (rebuildCommandBuffers)
+        {
+            waitFences[1 - bufferIndex]->wait();
+            recordCommandBuffer(FrontBuffer);
+            recordCommandBuffer(BackBuffer);
+            rebuildCommandBuffers = false;
+        }
         updatePerspectiveTransform();
-        submitCommandBuffer(bufferIndex);
-        constexpr bool waitForResult = true;
-        showOcclusionResult(waitForResult);
+        if (Mode::HiZ == mode)
+        {   // Culling doesn't need any readback, count of survivors is read only for statistics
+            readVisibleCount(bufferIndex);
+            submitCommandBuffer(bufferIndex);
+        }
+        else if (Mode::Software == mode)
+        {   // Command buffer has been released by fence, so it is safe to record it again
+            cullFieldOnCpu(bufferIndex);
+            recordCommandBuffer(bufferIndex);
+            submitCommandBuffer(bufferIndex);
+        }
+        else if (Mode::Coherent == mode)
+        {   // Fence has been waited, so results of the previous submission are available
+            if (occlusionQueries->fetchResults(bufferIndex))
+                coherentCulling->update(bufferIndex, occlusionQueries->getResults() + fieldQueryBase);
+            scheduleField(bufferIndex);
+            recordCommandBuffer(bufferIndex);
+            submitCommandBuffer(bufferIndex);
+            occlusionQueries->submitted(bufferIndex);
+        }
+        else
+        {
+            if (!waitForResult) // Slice of this command buffer is going to be reset
+                occlusionQueries->fetchResults(bufferIndex);
+            if ((Mode::Conditional == mode) && !conditionalRendering)
+                updateTeapotVisibility(bufferIndex);
+            submitCommandBuffer(bufferIndex);
+            occlusionQueries->submitted(bufferIndex);
+            if (waitForResult) // CPU and GPU are serialized
+                occlusionQueries->waitResults(bufferIndex);
+            showOcclusionResult();
+        }
+        updateStatistics(timer->millisecondsElapsed());
     }
 
-    void showOcclusionResult(bool waitForResult)
+    void onKeyDown(char key, int repeat, uint32_t flags) override
     {
-        uint64_t sampleCount = 0;
-        if (waitForResult)
-            sampleCount = occlusionQuery->getResults<uint64_t>(0, 1, true).front();
-        else
+        switch (key)
+        {
+        case AppKey::Space:
+            waitForResult = !waitForResult;
+            statisticsTime = 0.f;
+            statisticsFrames = 0;
+            std::cout << "Query result: " << (waitForResult ? "wait for GPU" : "read without waiting") << std::endl;
+            break;
+        case 'H': case 'h':
+            mode = (Mode::HiZ == mode) ? Mode::Query : Mode::HiZ;
+            onModeChanged();
+            break;
+        case 'S': case 's':
+            mode = (Mode::Software == mode) ? Mode::Query : Mode::Software;
+            onModeChanged();
+            break;
+        case 'C': case 'c':
+            mode = (Mode::Conditional == mode) ? Mode::Query : Mode::Conditional;
+            onModeChanged();
+            break;
+        case 'T': case 't':
+            mode = (Mode::Coherent == mode) ? Mode::Query : Mode::Coherent;
+            coherentCulling->reset();
+            onModeChanged();
+            break;
+        }
+        VulkanApp::onKeyDown(key, repeat, flags);
+    }
+
+    void onModeChanged()
+    {
+        rebuildCommandBuffers = true;
+        statisticsTime = 0.f;
+        statisticsFrames = 0;
+        rasterizationTime = 0.f;
+        testTime = 0.f;
+        issuedQueryCount = 0;
+        drawnObjectCount = 0;
+        switch (mode)
         {
-            const magma::QueryPool::Result<uint64_t, uint64_t> result = occlusionQuery->getResultsWithAvailability<uint64_t>(0, 1).front();
-            if (result.availability > 0)
-                sampleCount = result.result;
-            std::cout << "Query result: ";
-            if (result.availability > 0)
-                std::cout << sampleCount << std::endl;
-            else // Not ready
-                std::cout << "---" << std::endl;
-        }
-        const std::tstring caption = TEXT("11 - Occlusion query samples passed : ") + std::to_tstring(sampleCount);
+        case Mode::HiZ: std::cout << "Mode: Hi-Z culling" << std::endl; break;
+        case Mode::Software: std::cout << "Mode: software occlusion culling" << std::endl; break;
+        case Mode::Coherent: std::cout << "Mode: coherent occlusion culling" << std::endl; break;
+        case Mode::Conditional:
+            std::cout << "Mode: " << (conditionalRendering ? "conditional rendering" : "CPU skips draw (VK_EXT_conditional_rendering not supported)")
+                << std::endl;
+            break;
+        default: std::cout << "Mode: occlusion query" << std::endl;
+        }
+    }
+
+    void createLogicalDevice() override
+    {
+        const std::vector<float> defaultQueuePriorities = {1.f};
+        const magma::DeviceQueueDescriptor graphicsQueue(physicalDevice, VK_QUEUE_GRAPHICS_BIT, defaultQueuePriorities);
+        const magma::DeviceQueueDescriptor transferQueue(physicalDevice, VK_QUEUE_TRANSFER_BIT, defaultQueuePriorities);
+        std::vector<magma::DeviceQueueDescriptor> queueDescriptors;
+        queueDescriptors.push_back(graphicsQueue);
+        if (transferQueue.queueFamilyIndex != graphicsQueue.queueFamilyIndex)
+            queueDescriptors.push_back(transferQueue);
+
+        VkPhysicalDeviceFeatures features = {0};
+        features.fillModeNonSolid = VK_TRUE;
+        features.occlusionQueryPrecise = VK_TRUE;
+
+        std::vector<const char*> enabledExtensions;
+        enabledExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        if (extensions->AMD_negative_viewport_height)
+            enabledExtensions.push_back(VK_AMD_NEGATIVE_VIEWPORT_HEIGHT_EXTENSION_NAME);
+        else if (extensions->KHR_maintenance1)
+            enabledExtensions.push_back(VK_KHR_MAINTENANCE1_EXTENSION_NAME);
+        std::vector<void *> extendedFeatures;
+#ifdef VK_EXT_conditional_rendering
+        VkPhysicalDeviceConditionalRenderingFeaturesEXT conditionalRenderingFeatures = {};
+        conditionalRenderingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_CONDITIONAL_RENDERING_FEATURES_EXT;
+        conditionalRenderingFeatures.conditionalRendering = VK_TRUE;
+        conditionalRendering = extensions->EXT_conditional_rendering;
+        if (conditionalRendering)
+        {
+            enabledExtensions.push_back(VK_EXT_CONDITIONAL_RENDERING_EXTENSION_NAME);
+            extendedFeatures.push_back(&conditionalRenderingFeatures);
+        }
+#endif // VK_EXT_conditional_rendering
+        const std::vector<const char*> noLayers;
+        device = physicalDevice->createDevice(queueDescriptors, noLayers, enabledExtensions, features, extendedFeatures);
+    }
+
+    void createFramebuffer() override
+    {   // Depth attachment is sampled to build depth pyramid
+        const VkSurfaceCapabilitiesKHR surfaceCaps = physicalDevice->getSurfaceCapabilities(surface);
+        const VkFormat depthFormat = utilities::getSupportedDepthFormat(physicalDevice, false, true);
+        constexpr bool sampled = true;
+        depthStencil = std::make_shared<magma::DepthStencilAttachment>(device, depthFormat, surfaceCaps.currentExtent, 1, 1, sampled);
+        depthStencilView = std::make_shared<magma::ImageView>(depthStencil);
+        for (const auto& image : swapchain->getImages())
+        {
+            const std::vector<std::shared_ptr<magma::ImageView>> attachments = {
+                std::make_shared<magma::ImageView>(image),
+                depthStencilView
+            };
+            framebuffers.push_back(std::make_shared<magma::Framebuffer>(renderPass, attachments));
+        }
+    }
+
+    void createDescriptorPool() override
+    {   // Hi-Z culling needs more descriptors than basic samples
+        constexpr uint32_t maxDescriptorSets = 8;
+        descriptorPool = std::make_shared<magma::DescriptorPool>(device, maxDescriptorSets,
+            std::vector<magma::descriptor::DescriptorPool>{
+                magma::descriptor::UniformBufferPool(8),
+                magma::descriptor::DynamicUniformBufferPool(4),
+                magma::descriptor::StorageBufferPool(8),
+                magma::descriptor::CombinedImageSamplerPool(4)
+            });
+    }
+
+    void showOcclusionResult()
+    {
+        const uint64_t sampleCount = occlusionQueries->getResult(teapotQuery);
+        std::tstring caption = TEXT("11 - Occlusion query samples passed : ") + std::to_tstring(sampleCount);
+        if (!occlusionQueries->hasResults())
+            caption += TEXT(" (not ready)");
+        else if (!waitForResult)
+            caption += TEXT(" (") + std::to_tstring(occlusionQueries->getLatency()) + TEXT(" frame(s) late)");
         setWindowCaption(caption);
     }
 
+    void updateTeapotVisibility(uint32_t index)
+    {   // Without conditional rendering draw is skipped by command buffer that doesn't contain it
+        if (occlusionQueries->hasResults())
+            teapotVisible = occlusionQueries->getResult(teapotQuery) > 0;
+        if (recordedVisibility[index] != teapotVisible)
+            recordCommandBuffer(index); // Released by fence
+    }
+
+    void readVisibleCount(uint32_t index)
+    {   // Fence of this command buffer was waited before render()
+        magma::helpers::mapScoped<VkDrawIndexedIndirectCommand>(drawCommandReadback[index],
+            [this](const VkDrawIndexedIndirectCommand *drawIndexed)
+            {
+                visibleObjectCount = drawIndexed->instanceCount;
+            });
+    }
+
+    void updateStatistics(float dt)
+    {
+        statisticsTime += dt;
+        ++statisticsFrames;
+        if (statisticsTime < statisticsInterval)
+            return;
+        if (Mode::HiZ == mode)
+        {
+            std::cout << "Hi-Z culling: " << statisticsTime/statisticsFrames << " ms per frame, "
+                << visibleObjectCount << " of " << fieldObjectCount << " teapots visible" << std::endl;
+        }
+        else if (Mode::Software == mode)
+        {
+            const DepthRasterizer::Statistics& stats = rasterizer->getStatistics();
+            std::cout << "Software culling: " << statisticsTime/statisticsFrames << " ms per frame, "
+                << rasterizationTime/statisticsFrames << " ms rasterization (" << stats.triangleCount << " triangles, "
+                << stats.binnedCount << " binned), " << testTime/statisticsFrames << " ms test, "
+                << 100.f * (fieldObjectCount - visibleObjectCount)/fieldObjectCount << "% culled" << std::endl;
+            rasterizationTime = 0.f;
+            testTime = 0.f;
+        }
+        else if (Mode::Coherent == mode)
+        {   // Compared with query of each object every frame
+            const double queriesPerFrame = static_cast<double>(issuedQueryCount)/statisticsFrames;
+            std::cout << "Coherent culling: " << statisticsTime/statisticsFrames << " ms per frame, "
+                << drawnObjectCount/statisticsFrames << " of " << fieldObjectCount << " teapots drawn, "
+                << queriesPerFrame << " queries per frame, "
+                << 100. * (1. - queriesPerFrame/fieldObjectCount) << "% fewer than query per object" << std::endl;
+            issuedQueryCount = 0;
+            drawnObjectCount = 0;
+        }
+        else if ((Mode::Conditional == mode) && conditionalRendering)
+        {   // CPU doesn't know whether teapot has been drawn
+            std::cout << "Conditional rendering: " << statisticsTime/statisticsFrames << " ms per frame" << std::endl;
+        }
+        else
+        {
+            std::cout << (waitForResult ? "Wait for result: " : "Read result later: ")
+                << statisticsTime/statisticsFrames << " ms per frame";
+            if (Mode::Conditional == mode)
+                std::cout << ", teapot " << (teapotVisible ? "drawn" : "skipped");
+            std::cout << std::endl;
+        }
+        statisticsTime = 0.f;
+        statisticsFrames = 0;
+    }
+
+    void cullFieldOnCpu(uint32_t index)
+    {   // Same quad as quadric::Plane, which doesn't keep its vertices on CPU
+        constexpr float halfSize = 3.f;
+        const float occluderVertices[4][3] = {
+            {-halfSize, 0.f, -halfSize}, {halfSize, 0.f, -halfSize},
+            {halfSize, 0.f, halfSize}, {-halfSize, 0.f, halfSize}
+        };
+        const uint16_t occluderIndices[6] = {0, 1, 2, 0, 2, 3};
+        cullTimer.run();
+        rasterizer->clear();
+        rasterizer->addOccluder(occluderVertices[0], sizeof(occluderVertices[0]), occluderIndices, 6, planeViewProj);
+        rasterizer->rasterize(threadPool.get());
+        rasterizationTime += cullTimer.millisecondsElapsed();
+        // Boxes enclose bounding spheres of teapots
+        const float radius = fieldBoundingSphere.w;
+        uint32_t visibleCount = 0;
+        magma::helpers::mapScoped<rapid::float4>(fieldInstances[index],
+            [this, radius, &visibleCount](rapid::float4 *instances)
+            {
+                for (const rapid::float4& offset : fieldObjects)
+                {
+                    const float center[3] = {
+                        fieldBoundingSphere.x + offset.x,
+                        fieldBoundingSphere.y + offset.y,
+                        fieldBoundingSphere.z + offset.z
+                    };
+                    const float boxMin[3] = {center[0] - radius, center[1] - radius, center[2] - radius};
+                    const float boxMax[3] = {center[0] + radius, center[1] + radius, center[2] + radius};
+                    if (rasterizer->testBox(boxMin, boxMax, fieldViewProj))
+                        instances[visibleCount++] = offset;
+                }
+            });
+        testTime += cullTimer.millisecondsElapsed();
+        softwareVisibleCounts[index] = visibleCount;
+        visibleObjectCount = visibleCount;
+    }
+
+    void scheduleField(uint32_t index)
+    {   // Drawn objects first, then queried ones, then boxes of occluded ones
+        coherentCulling->schedule(index);
+        magma::helpers::mapScoped<rapid::float4>(fieldInstances[index],
+            [this](rapid::float4 *instances)
+            {
+                for (const auto *objects : {&coherentCulling->getDrawnObjects(),
+                    &coherentCulling->getQueriedObjects(), &coherentCulling->getProxyObjects()})
+                {
+                    for (uint32_t object : *objects)
+                        *instances++ = fieldObjects[object];
+                }
+            });
+        issuedQueryCount += coherentCulling->getQueryCount();
+        drawnObjectCount += coherentCulling->getVisibleCount();
+    }
+
     void setupView()
     {
         const rapid::vector3 eye(0.f, 0.f, 10.f);
@@ -91,14 +472,38 @@ public:
         const rapid::matrix yaw = rapid::rotationY(rapid::radians(spinX/2.f));
         const rapid::matrix transPlane = rapid::translation(0.f, 0.f, 2.f);
         const rapid::matrix transMesh = rapid::translation(0.f, -2.f, 0.f);
+        const rapid::matrix zUpToYUp = rapid::rotationX(rapid::radians(-90.f));
         const rapid::matrix worldPlane = rapid::rotationX(rapid::radians(90.f)) * transPlane * pitch * yaw;
-        const rapid::matrix worldMesh = transMesh * pitch * yaw;
+        // Quantized positions are decoded by world transform for free
+        const rapid::matrix worldMesh = teapot->getDequantizationMatrix() * zUpToYUp * transMesh * pitch * yaw;
+        planeViewProj = worldPlane * viewProj;
         magma::helpers::mapScoped<rapid::matrix>(transformUniforms,
-            [this, &worldPlane, &worldMesh](magma::helpers::AlignedUniformArray<rapid::matrix>& transforms)
+            [this, &worldMesh](magma::helpers::AlignedUniformArray<rapid::matrix>& transforms)
             {
-                transforms[0] = worldPlane * viewProj;
+                transforms[0] = planeViewProj;
                 transforms[1] = worldMesh * viewProj;
             });
+        if ((Mode::HiZ == mode) || (Mode::Software == mode) || (Mode::Coherent == mode))
+        {   // Field rotates with the plane, so rotation is a part of view
+            fieldViewProj = pitch * yaw * viewProj;
+            magma::helpers::mapScoped(fieldUniforms,
+                [this, &zUpToYUp](auto *block)
+                {
+                    block->objectTransform = teapot->getDequantizationMatrix() * zUpToYUp * rapid::scaling(fieldScale, fieldScale, fieldScale);
+                    block->viewProj = fieldViewProj;
+                    block->color = rapid::float4(1.f, 0.f, 0.f, 1.f);
+                });
+            magma::helpers::mapScoped(hiZCullUniforms,
+                [this](auto *block)
+                {
+                    block->viewProj = fieldViewProj;
+                    block->boundingSphere = fieldBoundingSphere;
+                    block->depthSize[0] = static_cast<float>(width);
+                    block->depthSize[1] = static_cast<float>(height);
+                    block->flipY = negateViewport ? -1.f : 1.f;
+                    block->objectCount = fieldObjectCount;
+                });
+        }
     }
 
     void createOcclusionQuery()
@@ -109,15 +514,109 @@ public:
           In this case, some implementations may only return zero or one,
           indifferent to the actual number of samples passing the per-fragment tests. */
         constexpr bool precise = false;
-        occlusionQuery = std::make_shared<magma::OcclusionQuery>(device, 1, precise);
+        // Room for query per object of teapot field
+        constexpr uint32_t maxQueryCount = fieldObjectCount + 1;
+        // Each command buffer has its own slice of queries
+        const uint32_t frameCount = static_cast<uint32_t>(commandBuffers.size());
+        occlusionQueries = std::make_unique<OcclusionQueryRing>(device, maxQueryCount, frameCount, precise);
+        teapotQuery = occlusionQueries->allocate();
+        fieldQueryBase = occlusionQueries->allocate(fieldObjectCount);
+        coherentCulling = std::make_unique<CoherentCulling>(fieldObjectCount, frameCount, retestInterval);
     }
 
     void createMeshes()
     {
         constexpr bool twoSided = true;
         plane = std::make_unique<quadric::Plane>(6.f, 6.f, twoSided, cmdBufferCopy);
-        constexpr uint16_t subdivisionDegree = 16;
-        teapot = std::make_unique<quadric::Teapot>(subdivisionDegree, cmdBufferCopy);
+        threadPool = std::make_unique<ThreadPool>();
+        constexpr uint32_t subdivisionDegree = 16;
+        BezierPatchMesh::Options options;
+        options.optimize = true;
+        options.quantize = true;
+        options.threadPool = threadPool.get();
+        // Tessellation and optimization are performed only once, next time mesh is loaded from cache
+        options.cacheDirectory = "cache";
+        teapot = std::make_unique<BezierPatchMesh>(teapotPatches, kTeapotNumPatches, teapotVertices,
+            subdivisionDegree, cmdBufferCopy, options);
+        const mesh::CacheStatistics& before = teapot->getUnoptimizedStatistics();
+        const mesh::CacheStatistics& after = teapot->getOptimizedStatistics();
+        std::cout << "Teapot: " << teapot->getVertexCount() << " vertices, " << teapot->getIndexCount()/3 << " triangles, "
+            << (teapot->loadedFromCache() ? "loaded from cache" : "generated") << " in " << teapot->getSetupTime() << " ms" << std::endl
+            << "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+        const VkDeviceSize floatSize = teapot->getVertexCount() * sizeof(BezierPatchMesh::Vertex);
+        std::cout << "Vertex buffer: " << teapot->getVertexBufferSize() << " bytes (" << floatSize << " bytes as float, "
+            << static_cast<float>(floatSize)/teapot->getVertexBufferSize() << "x less fetch bandwidth)" << std::endl;
+    }
+
+    void createProxy()
+    {   // Unit cube is transformed to bounding box of teapot by dequantization
+        const float vertices[8][3] = {
+            {-1.f, -1.f, -1.f}, {1.f, -1.f, -1.f}, {-1.f, 1.f, -1.f}, {1.f, 1.f, -1.f},
+            {-1.f, -1.f, 1.f}, {1.f, -1.f, 1.f}, {-1.f, 1.f, 1.f}, {1.f, 1.f, 1.f}
+        };
+        const uint16_t indices[proxyIndexCount] = {
+            0, 2, 1, 1, 2, 3, // -Z
+            4, 5, 6, 5, 7, 6, // +Z
+            0, 1, 4, 1, 5, 4, // -Y
+            2, 6, 3, 3, 6, 7, // +Y
+            0, 4, 2, 2, 4, 6, // -X
+            1, 3, 5, 3, 7, 5  // +X
+        };
+        proxyVertices = vertexBufferFromArray<magma::VertexBuffer>(cmdBufferCopy, vertices);
+        proxyIndices = indexBufferFromArray(cmdBufferCopy, indices);
+#ifdef VK_EXT_conditional_rendering
+        if (conditionalRendering)
+        {   // Teapot is drawn until the first result is copied
+            predicates = std::make_shared<PredicateBuffer>(device, 1);
+            const uint32_t visible = 1;
+            cmdImageCopy->begin();
+            cmdImageCopy->updateBuffer(predicates, sizeof(uint32_t), &visible);
+            cmdImageCopy->end();
+            submitCopyImageCommands();
+        }
+#endif // VK_EXT_conditional_rendering
+    }
+
+    void createField()
+    {   // Teapots are placed behind the plane, so that most of them are occluded
+        fieldObjects.reserve(fieldObjectCount);
+        const float origin = -fieldSpacing * (fieldDimension - 1) * .5f;
+        for (uint32_t z = 0; z < fieldDimension; ++z)
+        {
+            for (uint32_t y = 0; y < fieldDimension; ++y)
+            {
+                for (uint32_t x = 0; x < fieldDimension; ++x)
+                {
+                    fieldObjects.emplace_back(origin + x * fieldSpacing, origin + y * fieldSpacing,
+                        -z * fieldSpacing, 0.f);
+                }
+            }
+        }
+        fieldOffsets = std::make_shared<magma::StorageBuffer>(cmdBufferCopy,
+            fieldObjectCount * sizeof(rapid::float4), fieldObjects.data());
+        visibleInstances = std::make_shared<StorageVertexBuffer>(device, fieldObjectCount * sizeof(rapid::float4));
+        drawCommand = std::make_shared<StorageIndirectBuffer>(device, sizeof(VkDrawIndexedIndirectCommand));
+        for (auto& readback : drawCommandReadback)
+        {
+            readback = std::make_shared<magma::DstTransferBuffer>(device, sizeof(VkDrawIndexedIndirectCommand));
+            magma::helpers::mapScoped<VkDrawIndexedIndirectCommand>(readback,
+                [](VkDrawIndexedIndirectCommand *drawIndexed)
+                {
+                    *drawIndexed = {};
+                });
+        }
+        // Bounding sphere in scaled object space, Z up is rotated to Y up as (x, z, -y)
+        const rapid::float4 sphere = teapot->getBoundingSphere();
+        fieldBoundingSphere = rapid::float4(sphere.x * fieldScale, sphere.z * fieldScale, -sphere.y * fieldScale,
+            sphere.w * fieldScale);
+        const VkExtent2D extent = {width, height};
+        depthPyramid = std::make_unique<DepthPyramid>(depthStencilView, extent, cmdBufferCopy,
+            descriptorPool, pipelineCache, shaderReflectionFactory);
+        // Per-instance attributes of CPU culled field are rewritten every frame
+        const bool barStagedMemory = device->getDeviceFeatures()->hasLocalHostVisibleMemory();
+        for (auto& instances : fieldInstances)
+            instances = std::make_shared<magma::DynamicVertexBuffer>(device, fieldObjectCount * sizeof(rapid::float4), barStagedMemory);
+        rasterizer = std::make_unique<DepthRasterizer>(rasterizerWidth, rasterizerHeight);
     }
 
     void createUniformBuffer()
@@ -131,6 +630,8 @@ public:
             colors[0] = rapid::vector4(0.f, 0.f, 1.f, 1.f);
             colors[1] = rapid::vector4(1.f, 0.f, 0.f, 1.f);
         });
+        hiZCullUniforms = std::make_shared<magma::UniformBuffer<HiZCullParameters>>(device);
+        fieldUniforms = std::make_shared<magma::UniformBuffer<FieldTransforms>>(device);
     }
 
     void setupDescriptorSet()
@@ -143,6 +644,19 @@ public:
         descriptorSets[1] = std::make_shared<magma::DescriptorSet>(descriptorPool,
             setTable1, VK_SHADER_STAGE_VERTEX_BIT,
             nullptr, shaderReflectionFactory, "transform.o", 1);
+        hiZCullSetTable.pyramid = depthPyramid->getParameters();
+        hiZCullSetTable.pyramidLevels = depthPyramid->getBuffer();
+        hiZCullSetTable.parameters = hiZCullUniforms;
+        hiZCullSetTable.objects = fieldOffsets;
+        hiZCullSetTable.visibleInstances = visibleInstances;
+        hiZCullSetTable.drawCommand = drawCommand;
+        hiZCullDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
+            hiZCullSetTable, VK_SHADER_STAGE_COMPUTE_BIT,
+            nullptr, shaderReflectionFactory, "hiZCull.o");
+        fieldSetTable.transforms = fieldUniforms;
+        fieldDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
+            fieldSetTable, VK_SHADER_STAGE_VERTEX_BIT,
+            nullptr, shaderReflectionFactory, "instanced.o");
     }
 
     void setupPipeline()
@@ -176,14 +690,226 @@ public:
             pipelineLayout,
             renderPass, 0,
             pipelineCache);
+        // Bounding box is tested against depth of occluder, without color and depth writes
+        const magma::VertexInputState proxyVertexInput(
+            magma::VertexInputBinding(0, sizeof(float) * 3),
+            std::initializer_list<magma::VertexInputAttribute>{
+                magma::VertexInputAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0)
+            });
+        const magma::ColorBlendState dontWriteColor(magma::ColorBlendAttachmentState(0));
+        proxyPipeline = std::make_shared<GraphicsPipeline>(device,
+            "proxy.o", "fill.o",
+            proxyVertexInput,
+            magma::renderstate::triangleList,
+            negateViewport ? magma::renderstate::fillCullNoneCcw
+                           : magma::renderstate::fillCullNoneCw,
+            magma::renderstate::dontMultisample,
+            magma::renderstate::depthLessOrEqualDontWrite,
+            dontWriteColor,
+            pipelineLayout,
+            renderPass, 0,
+            pipelineCache);
+        // Second binding advances once per instance
+        const magma::VertexInputState fieldProxyVertexInput(
+            {
+                magma::VertexInputBinding(0, sizeof(float) * 3),
+                magma::VertexInputBinding(1, sizeof(rapid::float4), VK_VERTEX_INPUT_RATE_INSTANCE)
+            },
+            {
+                magma::VertexInputAttribute(0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0),
+                magma::VertexInputAttribute(3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 0)
+            });
+        const magma::VertexInputState fieldVertexInput(
+            {
+                magma::VertexInputBinding(0, sizeof(BezierPatchMesh::QuantizedVertex)),
+                magma::VertexInputBinding(1, sizeof(rapid::float4), VK_VERTEX_INPUT_RATE_INSTANCE)
+            },
+            {
+                magma::VertexInputAttribute(0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(BezierPatchMesh::QuantizedVertex, position)),
+                magma::VertexInputAttribute(3, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 0)
+            });
+        fieldPipelineLayout = std::make_shared<magma::PipelineLayout>(fieldDescriptorSet->getLayout());
+        fieldPipeline = std::make_shared<GraphicsPipeline>(device,
+            "instanced.o", "fill.o",
+            fieldVertexInput,
+            magma::renderstate::triangleList,
+            negateViewport ? magma::renderstate::fillCullBackCcw
+                           : magma::renderstate::fillCullBackCw,
+            magma::renderstate::dontMultisample,
+            magma::renderstate::depthLessOrEqual,
+            magma::renderstate::dontBlendRgb,
+            fieldPipelineLayout,
+            renderPass, 0,
+            pipelineCache);
+        // Unit cube is transformed to bounding box of teapot by the same object transform
+        fieldProxyPipeline = std::make_shared<GraphicsPipeline>(device,
+            "instanced.o", "fill.o",
+            fieldProxyVertexInput,
+            magma::renderstate::triangleList,
+            negateViewport ? magma::renderstate::fillCullNoneCcw
+                           : magma::renderstate::fillCullNoneCw,
+            magma::renderstate::dontMultisample,
+            magma::renderstate::depthLessOrEqualDontWrite,
+            dontWriteColor,
+            fieldPipelineLayout,
+            renderPass, 0,
+            pipelineCache);
+    }
+
+    void setupHiZCullPipeline()
+    {
+        hiZCullPipelineLayout = std::make_shared<magma::PipelineLayout>(hiZCullDescriptorSet->getLayout());
+        const aligned_vector<char> bytecode = utilities::loadBinaryFile("hiZCull.o");
+        auto cullShader = std::make_shared<magma::ShaderModule>(device, (const magma::SpirvWord *)bytecode.data(), bytecode.size());
+        hiZCullPipeline = std::make_shared<magma::ComputePipeline>(device,
+            magma::ComputeShaderStage(cullShader, "main"),
+            hiZCullPipelineLayout, nullptr, pipelineCache);
+    }
+
+    void cullField(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t index)
+    {   // Reset instance count, it is incremented by each survivor
+        VkDrawIndexedIndirectCommand drawIndexed;
+        drawIndexed.indexCount = teapot->getIndexCount();
+        drawIndexed.instanceCount = 0;
+        drawIndexed.firstIndex = 0;
+        drawIndexed.vertexOffset = 0;
+        drawIndexed.firstInstance = 0;
+        // Previous frame should consume draw command before it is overwritten
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            magma::BufferMemoryBarrier(drawCommand,
+                magma::MemoryBarrier(VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_TRANSFER_WRITE_BIT)));
+        cmdBuffer->updateBuffer(drawCommand, sizeof(VkDrawIndexedIndirectCommand), &drawIndexed);
+        const std::vector<magma::BufferMemoryBarrier> computeBarriers = {
+            {drawCommand, magma::MemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)},
+            {visibleInstances, magma::MemoryBarrier(VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT)}
+        };
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            {}, computeBarriers, {});
+        // Pyramid of the previous frame is tested, so that culling doesn't wait for depth pre-pass
+        cmdBuffer->bindDescriptorSet(hiZCullPipeline, 0, hiZCullDescriptorSet);
+        cmdBuffer->bindPipeline(hiZCullPipeline);
+        cmdBuffer->dispatch((fieldObjectCount + cullGroupSize - 1)/cullGroupSize, 1, 1);
+        // Draw command and per-instance attributes should be written before they are fetched
+        const std::vector<magma::BufferMemoryBarrier> drawBarriers = {
+            {drawCommand, magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT)},
+            {visibleInstances, magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT)}
+        };
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            {}, drawBarriers, {});
+        // Count of survivors is only for statistics
+        cmdBuffer->copyBuffer(drawCommand, drawCommandReadback[index], 0, 0, sizeof(VkDrawIndexedIndirectCommand));
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            magma::BufferMemoryBarrier(drawCommandReadback[index], magma::barrier::transferWriteHostRead));
+        // Depth pyramid of the previous frame should be built before depth attachment is cleared
+        VkImageSubresourceRange subresourceRange;
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+        subresourceRange.baseMipLevel = 0;
+        subresourceRange.levelCount = 1;
+        subresourceRange.baseArrayLayer = 0;
+        subresourceRange.layerCount = 1;
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+            magma::ImageMemoryBarrier(depthStencil,
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                subresourceRange));
     }
 
+    void drawTeapotConditionally(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t index)
+    {
+        cmdBuffer->bindPipeline(teapotPipeline);
+        cmdBuffer->bindDescriptorSets(teapotPipeline, 0, {descriptorSets[0], descriptorSets[1]},
+            {
+                transformUniforms->getDynamicOffset(1),
+                colorUniforms->getDynamicOffset(1)
+            });
+#ifdef VK_EXT_conditional_rendering
+        if (conditionalRendering)
+        {   // Predicate has been copied from query of the previous frame
+            cmdBuffer->beginConditionalRendering(predicates);
+            {
+                teapot->draw(cmdBuffer);
+            }
+            cmdBuffer->endConditionalRendering();
+        }
+        else
+#endif // VK_EXT_conditional_rendering
+        if (teapotVisible)
+            teapot->draw(cmdBuffer);
+        recordedVisibility[index] = teapotVisible;
+        // Hidden teapot doesn't write samples, so visibility is tested by its bounding box
+        cmdBuffer->bindPipeline(proxyPipeline);
+        cmdBuffer->bindVertexBuffer(0, proxyVertices);
+        cmdBuffer->bindIndexBuffer(proxyIndices);
+        occlusionQueries->beginQuery(cmdBuffer, index, teapotQuery);
+        {
+            cmdBuffer->drawIndexed(proxyIndexCount, 0, 0);
+        }
+        occlusionQueries->endQuery(cmdBuffer, index, teapotQuery);
+    }
+
+    void drawFieldCoherently(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t index)
+    {
+        const uint32_t drawnCount = static_cast<uint32_t>(coherentCulling->getDrawnObjects().size());
+        const uint32_t queriedCount = static_cast<uint32_t>(coherentCulling->getQueriedObjects().size());
+        const uint32_t proxyCount = static_cast<uint32_t>(coherentCulling->getProxyObjects().size());
+        cmdBuffer->bindPipeline(fieldPipeline);
+        cmdBuffer->bindDescriptorSet(fieldPipeline, 0, fieldDescriptorSet);
+        teapot->bind(cmdBuffer);
+        cmdBuffer->bindVertexBuffer(1, fieldInstances[index]);
+        if (drawnCount)
+            teapot->drawInstanced(cmdBuffer, drawnCount);
+        uint32_t query = fieldQueryBase;
+        uint32_t instance = drawnCount;
+        for (uint32_t i = 0; i < queriedCount; ++i, ++query, ++instance)
+        {   // Visible object is re-tested by its own draw
+            occlusionQueries->beginQuery(cmdBuffer, index, query);
+            {
+                teapot->drawInstanced(cmdBuffer, 1, instance);
+            }
+            occlusionQueries->endQuery(cmdBuffer, index, query);
+        }
+        if (!proxyCount)
+            return;
+        // Boxes of occluded objects are tested after all visible objects have written depth
+        cmdBuffer->bindPipeline(fieldProxyPipeline);
+        cmdBuffer->bindVertexBuffer(0, proxyVertices);
+        cmdBuffer->bindIndexBuffer(proxyIndices);
+        for (uint32_t i = 0; i < proxyCount; ++i, ++query, ++instance)
+        {
+            occlusionQueries->beginQuery(cmdBuffer, index, query);
+            {
+                cmdBuffer->drawIndexedInstanced(proxyIndexCount, 1, 0, 0, instance);
+            }
+            occlusionQueries->endQuery(cmdBuffer, index, query);
+        }
+    }
+
+#ifdef VK_EXT_conditional_rendering
+    void copyPredicate(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t index)
+    {   // Conditional rendering of this frame should read predicate before it is overwritten
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            magma::BufferMemoryBarrier(predicates,
+                magma::MemoryBarrier(VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT, VK_ACCESS_TRANSFER_WRITE_BIT)));
+        occlusionQueries->copyResults(cmdBuffer, index, predicates, teapotQuery, 1);
+        // Predicate should be written before the next frame begins conditional rendering
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_CONDITIONAL_RENDERING_BIT_EXT,
+            magma::BufferMemoryBarrier(predicates,
+                magma::MemoryBarrier(VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_CONDITIONAL_RENDERING_READ_BIT_EXT)));
+    }
+#endif // VK_EXT_conditional_rendering
+
     void recordCommandBuffer(uint32_t index)
     {
         std::shared_ptr<magma::CommandBuffer> cmdBuffer = commandBuffers[index];
         cmdBuffer->begin();
-        {
-            cmdBuffer->resetQueryPool(occlusionQuery, 0, occlusionQuery->getQueryCount());
+        {   // Dispatch can't be recorded inside render pass
+            if (Mode::HiZ == mode)
+                cullField(cmdBuffer, index);
+            else if ((Mode::Query == mode) || (Mode::Conditional == mode)) // Field queries are not issued
+                occlusionQueries->reset(cmdBuffer, index, teapotQuery, 1);
+            else if (Mode::Coherent == mode) // Only queries issued by this frame
+                occlusionQueries->reset(cmdBuffer, index, fieldQueryBase, coherentCulling->getQueryCount());
             cmdBuffer->beginRenderPass(renderPass, framebuffers[index],
                 {
                     magma::clear::gray,
@@ -196,20 +922,49 @@ public:
                 cmdBuffer->bindPipeline(planePipeline);
                 cmdBuffer->bindDescriptorSets(planePipeline, 0, {descriptorSets[0], descriptorSets[1]}, {0, 0});
                 plane->draw(cmdBuffer);
-                // Occludee
-                cmdBuffer->bindPipeline(teapotPipeline);
-                cmdBuffer->bindDescriptorSets(teapotPipeline, 0, {descriptorSets[0], descriptorSets[1]},
+                if (Mode::HiZ == mode)
+                {   // Instance count is written by compute shader
+                    cmdBuffer->bindPipeline(fieldPipeline);
+                    cmdBuffer->bindDescriptorSet(fieldPipeline, 0, fieldDescriptorSet);
+                    teapot->bind(cmdBuffer);
+                    cmdBuffer->bindVertexBuffer(1, visibleInstances);
+                    cmdBuffer->drawIndexedIndirect(drawCommand, 1, sizeof(VkDrawIndexedIndirectCommand));
+                }
+                else if (Mode::Software == mode)
+                {   // Compact list of visible instances is written before recording
+                    cmdBuffer->bindPipeline(fieldPipeline);
+                    cmdBuffer->bindDescriptorSet(fieldPipeline, 0, fieldDescriptorSet);
+                    teapot->bind(cmdBuffer);
+                    cmdBuffer->bindVertexBuffer(1, fieldInstances[index]);
+                    if (softwareVisibleCounts[index])
+                        teapot->drawInstanced(cmdBuffer, softwareVisibleCounts[index]);
+                }
+                else if (Mode::Conditional == mode)
+                    drawTeapotConditionally(cmdBuffer, index);
+                else if (Mode::Coherent == mode)
+                    drawFieldCoherently(cmdBuffer, index);
+                else
+                {   // Occludee
+                    cmdBuffer->bindPipeline(teapotPipeline);
+                    cmdBuffer->bindDescriptorSets(teapotPipeline, 0, {descriptorSets[0], descriptorSets[1]},
+                        {
+                            transformUniforms->getDynamicOffset(1),
+                            colorUniforms->getDynamicOffset(1)
+                        });
+                    occlusionQueries->beginQuery(cmdBuffer, index, teapotQuery);
                     {
-                        transformUniforms->getDynamicOffset(1),
-                        colorUniforms->getDynamicOffset(1)
-                    });
-                cmdBuffer->beginQuery(occlusionQuery, 0);
-                {
-                    teapot->draw(cmdBuffer);
+                        teapot->draw(cmdBuffer);
+                    }
+                    occlusionQueries->endQuery(cmdBuffer, index, teapotQuery);
                 }
-                cmdBuffer->endQuery(occlusionQuery, 0);
             }
             cmdBuffer->endRenderPass();
+            if (Mode::HiZ == mode)
+                depthPyramid->build(cmdBuffer);
+#ifdef VK_EXT_conditional_rendering
+            else if ((Mode::Conditional == mode) && conditionalRendering)
+                copyPredicate(cmdBuffer, index);
+#endif
         }
         cmdBuffer->end();
     }
@@ -0,0 +1,50 @@
+#include <algorithm>
+#include "coherentCulling.h"
+
+CoherentCulling::CoherentCulling(uint32_t objectCount, uint32_t frameCount, uint32_t retestInterval):
+    retestInterval(std::max(retestInterval, 1U)),
+    visibility(objectCount, 1), // Until the first test object is assumed to be visible
+    issuedObjects(frameCount)
+{
+    drawnObjects.reserve(objectCount);
+    queriedObjects.reserve(objectCount);
+    proxyObjects.reserve(objectCount);
+    for (auto& objects : issuedObjects)
+        objects.reserve(objectCount);
+}
+
+void CoherentCulling::update(uint32_t frameIndex, const uint64_t *results)
+{
+    const std::vector<uint32_t>& objects = issuedObjects[frameIndex];
+    for (size_t i = 0, count = objects.size(); i < count; ++i)
+        visibility[objects[i]] = results[i] > 0;
+}
+
+void CoherentCulling::schedule(uint32_t frameIndex)
+{
+    drawnObjects.clear();
+    queriedObjects.clear();
+    proxyObjects.clear();
+    const uint32_t objectCount = getObjectCount();
+    for (uint32_t i = 0; i < objectCount; ++i)
+    {
+        if (!visibility[i])
+            proxyObjects.push_back(i);
+        else if ((frameNumber + i) % retestInterval == 0)
+            queriedObjects.push_back(i);
+        else
+            drawnObjects.push_back(i);
+    }
+    std::vector<uint32_t>& issued = issuedObjects[frameIndex];
+    issued.assign(queriedObjects.begin(), queriedObjects.end());
+    issued.insert(issued.end(), proxyObjects.begin(), proxyObjects.end());
+    ++frameNumber;
+}
+
+void CoherentCulling::reset() noexcept
+{
+    std::fill(visibility.begin(), visibility.end(), 1);
+    for (auto& objects : issuedObjects)
+        objects.clear();
+    frameNumber = 0;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/* Temporally coherent occlusion culling of many objects. Visibility of
+   each object persists between frames. Visible objects are drawn every
+   frame, but are queried only once per retestInterval frames; phases of
+   objects are shifted, so that re-tests are spread evenly over frames.
+   Occluded objects aren't drawn, their bounding boxes are queried every
+   frame instead. Results arrive when command buffer of frame is reused,
+   so that object appears with latency of frames in flight. */
+class CoherentCulling
+{
+public:
+    explicit CoherentCulling(uint32_t objectCount,
+        uint32_t frameCount,
+        uint32_t retestInterval);
+    /* Applies results of the last submission of frame, where result
+       of i-th query belongs to i-th object issued by schedule(). */
+    void update(uint32_t frameIndex, const uint64_t *results);
+    // Builds lists of objects of frame, queries are issued in order of queried and proxy objects
+    void schedule(uint32_t frameIndex);
+    // Visible objects drawn without query
+    const std::vector<uint32_t>& getDrawnObjects() const noexcept { return drawnObjects; }
+    // Visible objects drawn inside of query
+    const std::vector<uint32_t>& getQueriedObjects() const noexcept { return queriedObjects; }
+    // Occluded objects tested by bounding box
+    const std::vector<uint32_t>& getProxyObjects() const noexcept { return proxyObjects; }
+    uint32_t getQueryCount() const noexcept { return static_cast<uint32_t>(queriedObjects.size() + proxyObjects.size()); }
+    uint32_t getVisibleCount() const noexcept { return static_cast<uint32_t>(drawnObjects.size() + queriedObjects.size()); }
+    uint32_t getObjectCount() const noexcept { return static_cast<uint32_t>(visibility.size()); }
+    uint32_t getRetestInterval() const noexcept { return retestInterval; }
+    void reset() noexcept;
+
+private:
+    const uint32_t retestInterval;
+    std::vector<uint8_t> visibility;
+    std::vector<std::vector<uint32_t>> issuedObjects; // Per frame in flight, object of each query
+    std::vector<uint32_t> drawnObjects;
+    std::vector<uint32_t> queriedObjects;
+    std::vector<uint32_t> proxyObjects;
+    uint64_t frameNumber = 0;
+};
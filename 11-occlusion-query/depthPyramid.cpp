@@ -0,0 +1,86 @@
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include "depthPyramid.h"
+#include "../framework/shaderReflectionFactory.h"
+#include "../framework/utilities.h"
+
+DepthPyramid::DepthPyramid(std::shared_ptr<magma::ImageView> depthView, const VkExtent2D& extent,
+    std::shared_ptr<magma::CommandBuffer> cmdBuffer, std::shared_ptr<magma::DescriptorPool> descriptorPool,
+    std::shared_ptr<magma::PipelineCache> pipelineCache, std::shared_ptr<ShaderReflectionFactory> shaderReflectionFactory):
+    depthView(std::move(depthView)),
+    levelCount(0),
+    groupCountX((extent.width + TileSize - 1)/TileSize),
+    groupCountY((extent.height + TileSize - 1)/TileSize)
+{
+    std::shared_ptr<magma::Device> device = cmdBuffer->getDevice();
+    Parameters pyramid = {};
+    // Each texel of level covers 2x2 texels of previous one, texels at odd edge are clamped
+    uint32_t width = extent.width, height = extent.height;
+    uint32_t offset = 0;
+    do
+    {
+        if (MaxLevels == levelCount)
+            throw std::runtime_error("depth attachment is too large for pyramid");
+        width = std::max((width + 1)/2, 1U);
+        height = std::max((height + 1)/2, 1U);
+        pyramid.levels[levelCount][0] = offset;
+        pyramid.levels[levelCount][1] = width;
+        pyramid.levels[levelCount][2] = height;
+        offset += width * height;
+        ++levelCount;
+    } while (width > 1 || height > 1);
+    pyramid.levelCount = levelCount;
+    pyramid.groupCount = groupCountX * groupCountY;
+    parameters = std::make_shared<magma::UniformBuffer<Parameters>>(device);
+    magma::helpers::mapScoped(parameters,
+        [&pyramid](auto *block)
+        {
+            *block = pyramid;
+        });
+    // Header with group counter is followed by levels; until the first build nothing is occluded
+    constexpr uint32_t headerSize = 4;
+    std::vector<float> data(headerSize + offset, 1.f);
+    std::fill(data.begin(), data.begin() + headerSize, 0.f);
+    buffer = std::make_shared<magma::StorageBuffer>(std::move(cmdBuffer), data.size() * sizeof(float), data.data());
+    sampler = std::make_shared<magma::Sampler>(device, magma::sampler::magMinMipNearestClampToEdge);
+    setTable.parameters = parameters;
+    setTable.depth = {this->depthView, sampler};
+    setTable.pyramid = buffer;
+    descriptorSet = std::make_shared<magma::DescriptorSet>(std::move(descriptorPool),
+        setTable, VK_SHADER_STAGE_COMPUTE_BIT,
+        nullptr, std::move(shaderReflectionFactory), "buildPyramid.o");
+    pipelineLayout = std::make_shared<magma::PipelineLayout>(descriptorSet->getLayout());
+    const aligned_vector<char> bytecode = utilities::loadBinaryFile("buildPyramid.o");
+    auto shader = std::make_shared<magma::ShaderModule>(device, (const magma::SpirvWord *)bytecode.data(), bytecode.size());
+    pipeline = std::make_shared<magma::ComputePipeline>(std::move(device),
+        magma::ComputeShaderStage(shader, "main"),
+        pipelineLayout, nullptr, std::move(pipelineCache));
+}
+
+void DepthPyramid::build(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+{
+    VkImageSubresourceRange subresourceRange;
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    subresourceRange.baseMipLevel = 0;
+    subresourceRange.levelCount = 1;
+    subresourceRange.baseArrayLayer = 0;
+    subresourceRange.layerCount = 1;
+    // Depth should be written by render pass before it is fetched
+    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        magma::ImageMemoryBarrier(depthView->getImage(),
+            VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            subresourceRange));
+    // Culling pass should read previous pyramid before it is overwritten
+    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        magma::BufferMemoryBarrier(buffer,
+            magma::MemoryBarrier(VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)));
+    cmdBuffer->bindDescriptorSet(pipeline, 0, descriptorSet);
+    cmdBuffer->bindPipeline(pipeline);
+    cmdBuffer->dispatch(groupCountX, groupCountY, 1);
+    // Pyramid should be written before culling pass of the next frame
+    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+        magma::BufferMemoryBarrier(buffer,
+            magma::MemoryBarrier(VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT)));
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include "magma/magma.h"
+
+class ShaderReflectionFactory;
+
+/* Hierarchical depth buffer for occlusion culling. Texel of level 0 holds
+   maximum of 2x2 texels of depth attachment, texel of each next level
+   holds maximum of 2x2 texels of previous one, down to 1x1. Levels are
+   packed into storage buffer and built by single compute dispatch:
+   each workgroup reduces 64x64 tile of depth attachment through six levels
+   in shared memory, then the last workgroup to finish reduces the rest. */
+class DepthPyramid
+{
+public:
+    constexpr static uint32_t MaxLevels = 16;
+    constexpr static uint32_t TileSize = 64; // Should match buildPyramid.comp
+
+    // Matches uniform block of buildPyramid.comp and hiZCull.comp
+    struct Parameters
+    {
+        uint32_t levels[MaxLevels][4]; // Offset in floats, width, height
+        uint32_t levelCount;
+        uint32_t groupCount;
+    };
+
+    explicit DepthPyramid(std::shared_ptr<magma::ImageView> depthView,
+        const VkExtent2D& extent,
+        std::shared_ptr<magma::CommandBuffer> cmdBuffer,
+        std::shared_ptr<magma::DescriptorPool> descriptorPool,
+        std::shared_ptr<magma::PipelineCache> pipelineCache,
+        std::shared_ptr<ShaderReflectionFactory> shaderReflectionFactory);
+    /* Should be recorded after render pass that writes depth attachment.
+       Depth attachment is left in shader read-only layout. */
+    void build(std::shared_ptr<magma::CommandBuffer> cmdBuffer);
+    const std::shared_ptr<magma::StorageBuffer>& getBuffer() const noexcept { return buffer; }
+    const std::shared_ptr<magma::UniformBuffer<Parameters>>& getParameters() const noexcept { return parameters; }
+    uint32_t getLevelCount() const noexcept { return levelCount; }
+
+private:
+    struct DescriptorSetTable : magma::DescriptorSetTable
+    {
+        magma::descriptor::UniformBuffer parameters = 0;
+        magma::descriptor::CombinedImageSampler depth = 1;
+        magma::descriptor::StorageBuffer pyramid = 2;
+        MAGMA_REFLECT(parameters, depth, pyramid)
+    } setTable;
+
+    std::shared_ptr<magma::ImageView> depthView;
+    std::shared_ptr<magma::Sampler> sampler;
+    std::shared_ptr<magma::StorageBuffer> buffer;
+    std::shared_ptr<magma::UniformBuffer<Parameters>> parameters;
+    std::shared_ptr<magma::DescriptorSet> descriptorSet;
+    std::shared_ptr<magma::PipelineLayout> pipelineLayout;
+    std::shared_ptr<magma::ComputePipeline> pipeline;
+    uint32_t levelCount;
+    uint32_t groupCountX;
+    uint32_t groupCountY;
+};
@@ -0,0 +1,23 @@
+#version 450
+
+layout(binding = 0) uniform Transforms {
+    mat4 objectTransform; // Dequantization and scale
+    mat4 viewProj;
+    vec4 color;
+};
+
+layout(location = 0) in vec4 position;
+// Per-instance
+layout(location = 3) in vec4 offset;
+
+layout(location = 0) out vec4 oColor;
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main()
+{
+    vec4 pos = objectTransform * position;
+    oColor = color;
+    gl_Position = viewProj * vec4(pos.xyz + offset.xyz, 1.);
+}
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <stdexcept>
+#include "occlusionQueryRing.h"
+
+OcclusionQueryRing::OcclusionQueryRing(std::shared_ptr<magma::Device> device, uint32_t maxQueryCount, uint32_t frameCount,
+    bool precise):
+    queryPool(std::make_shared<magma::OcclusionQuery>(std::move(device), maxQueryCount * frameCount, precise)),
+    maxQueryCount(maxQueryCount),
+    frameCount(frameCount),
+    results(maxQueryCount, 0),
+    submitFrames(frameCount, 0),
+    resetRanges(frameCount)
+{}
+
+uint32_t OcclusionQueryRing::allocate(uint32_t count /* 1 */)
+{
+    if (queryCount + count > maxQueryCount)
+        throw std::runtime_error("out of occlusion queries");
+    const uint32_t first = queryCount;
+    queryCount += count;
+    return first;
+}
+
+void OcclusionQueryRing::clear() noexcept
+{
+    queryCount = 0;
+    std::fill(results.begin(), results.end(), 0);
+    std::fill(submitFrames.begin(), submitFrames.end(), 0);
+    std::fill(resetRanges.begin(), resetRanges.end(), Range());
+    resultFrame = 0;
+}
+
+void OcclusionQueryRing::reset(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t frameIndex)
+{   // Only allocated range of slice is reset
+    reset(std::move(cmdBuffer), frameIndex, 0, queryCount);
+}
+
+void OcclusionQueryRing::reset(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t frameIndex,
+    uint32_t firstQuery, uint32_t count)
+{
+    if (firstQuery + count > queryCount)
+        throw std::out_of_range("query range is not allocated");
+    // Results of previous recording of slice are discarded
+    submitFrames[frameIndex] = 0;
+    resetRanges[frameIndex].first = firstQuery;
+    resetRanges[frameIndex].count = count;
+    if (count)
+        cmdBuffer->resetQueryPool(queryPool, frameIndex * maxQueryCount + firstQuery, count);
+}
+
+void OcclusionQueryRing::beginQuery(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t frameIndex, uint32_t query)
+{
+    cmdBuffer->beginQuery(queryPool, frameIndex * maxQueryCount + query);
+}
+
+void OcclusionQueryRing::endQuery(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t frameIndex, uint32_t query)
+{
+    cmdBuffer->endQuery(queryPool, frameIndex * maxQueryCount + query);
+}
+
+void OcclusionQueryRing::copyResults(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t frameIndex,
+    std::shared_ptr<magma::Buffer> buffer, uint32_t firstQuery, uint32_t count, VkDeviceSize offset /* 0 */)
+{
+    constexpr bool wait = true;
+    cmdBuffer->copyQueryResults<uint32_t>(queryPool, std::move(buffer), wait,
+        frameIndex * maxQueryCount + firstQuery, count, offset);
+}
+
+bool OcclusionQueryRing::fetchResults(uint32_t frameIndex)
+{   // Reading of queries that were never reset is invalid
+    const Range& range = resetRanges[frameIndex];
+    if (!range.count || !submitFrames[frameIndex] || submitFrames[frameIndex] <= resultFrame)
+        return false;
+    const std::vector<magma::QueryPool::Result<uint64_t, uint64_t>> slice =
+        queryPool->getResultsWithAvailability<uint64_t>(frameIndex * maxQueryCount + range.first, range.count);
+    for (const auto& result : slice)
+    {   // Partial results of slice are not mixed with older ones
+        if (!result.availability)
+            return false;
+    }
+    for (uint32_t i = 0; i < range.count; ++i)
+        results[range.first + i] = slice[i].result;
+    resultFrame = submitFrames[frameIndex];
+    return true;
+}
+
+void OcclusionQueryRing::waitResults(uint32_t frameIndex)
+{
+    const Range& range = resetRanges[frameIndex];
+    if (!range.count || !submitFrames[frameIndex])
+        return;
+    constexpr bool wait = true;
+    const std::vector<uint64_t> slice = queryPool->getResults<uint64_t>(frameIndex * maxQueryCount + range.first, range.count, wait);
+    std::copy(slice.begin(), slice.end(), results.begin() + range.first);
+    resultFrame = submitFrames[frameIndex];
+}
+
+void OcclusionQueryRing::submitted(uint32_t frameIndex) noexcept
+{
+    submitFrames[frameIndex] = ++frameNumber;
+}
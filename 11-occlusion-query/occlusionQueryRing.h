@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+#include "magma/magma.h"
+
+/* Occlusion queries for several frames in flight. Query pool is divided
+   into slices, one per frame in flight, and each frame begins and ends
+   its queries in its own slice. Objects allocate query indices once,
+   the same index is used in every slice; only allocated range of slice
+   is reset and read back, by single command and single call.
+   Results of slice are read without waiting just before it is reused,
+   i.e. frameCount frames later, and the latest available result of each
+   query is kept, so that CPU never stalls on GPU. */
+class OcclusionQueryRing
+{
+public:
+    explicit OcclusionQueryRing(std::shared_ptr<magma::Device> device,
+        uint32_t maxQueryCount,
+        uint32_t frameCount,
+        bool precise);
+    /* Returns index of the first of count queries. Command buffers
+       should be recorded again to reset newly allocated queries. */
+    uint32_t allocate(uint32_t count = 1);
+    // Frees all queries, results are discarded
+    void clear() noexcept;
+    uint32_t getQueryCount() const noexcept { return queryCount; }
+    uint32_t getMaxQueryCount() const noexcept { return maxQueryCount; }
+    uint32_t getFrameCount() const noexcept { return frameCount; }
+    /* Should be recorded outside of render pass. Each query of allocated
+       range should be begun and ended after reset, otherwise results
+       of slice never become available. */
+    void reset(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t frameIndex);
+    // Resets part of allocated range, e.g. if only first queries of object range are issued by frame
+    void reset(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t frameIndex, uint32_t firstQuery, uint32_t count);
+    void beginQuery(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t frameIndex, uint32_t query);
+    void endQuery(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t frameIndex, uint32_t query);
+    /* Records copy of 32-bit results into buffer, should be recorded outside
+       of render pass. GPU waits for results of queries, CPU doesn't. */
+    void copyResults(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t frameIndex,
+        std::shared_ptr<magma::Buffer> buffer, uint32_t firstQuery, uint32_t count, VkDeviceSize offset = 0);
+    /* Call before command buffer of frame is submitted again. Reads results
+       of its previous submission if they are available, returns true if read. */
+    bool fetchResults(uint32_t frameIndex);
+    // Blocks until results of the last submission of frame are ready
+    void waitResults(uint32_t frameIndex);
+    void submitted(uint32_t frameIndex) noexcept;
+    // Latest available number of samples passed
+    uint64_t getResult(uint32_t query) const noexcept { return results[query]; }
+    // Latest available results of all allocated queries
+    const uint64_t *getResults() const noexcept { return results.data(); }
+    // Number of frames submitted after the one that produced the latest result
+    uint64_t getLatency() const noexcept { return resultFrame ? frameNumber - resultFrame : 0; }
+    bool hasResults() const noexcept { return resultFrame > 0; }
+
+private:
+    struct Range
+    {
+        uint32_t first = 0;
+        uint32_t count = 0;
+    };
+
+    std::shared_ptr<magma::OcclusionQuery> queryPool;
+    const uint32_t maxQueryCount;
+    const uint32_t frameCount;
+    uint32_t queryCount = 0;
+    std::vector<uint64_t> results;
+    std::vector<uint64_t> submitFrames; // Zero if slice wasn't submitted
+    std::vector<Range> resetRanges; // Queries reset in slice by its last recording
+    uint64_t frameNumber = 0;
+    uint64_t resultFrame = 0;
+};
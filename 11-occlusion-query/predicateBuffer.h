@@ -0,0 +1,18 @@
+#pragma once
+#include "magma/magma.h"
+
+#ifdef VK_EXT_conditional_rendering
+/* Predicates of conditional rendering, one 32-bit value per draw block.
+   Written by copy of query results, so that hidden objects are skipped
+   by GPU without readback. */
+class PredicateBuffer : public magma::Buffer
+{
+public:
+    explicit PredicateBuffer(std::shared_ptr<magma::Device> device, uint32_t predicateCount):
+        magma::Buffer(std::move(device), predicateCount * sizeof(uint32_t),
+            VK_BUFFER_USAGE_CONDITIONAL_RENDERING_BIT_EXT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            magma::Buffer::Descriptor(), magma::Sharing(), nullptr)
+    {}
+};
+#endif // VK_EXT_conditional_rendering
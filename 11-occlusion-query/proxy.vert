@@ -0,0 +1,18 @@
+#version 450
+
+layout(set = 0, binding = 0) uniform Transform {
+    mat4 worldViewProj;
+};
+
+layout(location = 0) in vec4 position;
+
+layout(location = 0) out vec4 oColor;
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+
+void main()
+{   // Color writes are disabled, only depth test matters
+    oColor = vec4(1.);
+    gl_Position = worldViewProj * position;
+}
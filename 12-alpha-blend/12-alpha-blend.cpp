@@ -1,9 +1,40 @@
 #include "../framework/vulkanApp.h"
 #include "../framework/utilities.h"
+#include "../framework/threadPool.h"
 #include "quadric/include/cube.h"
+#include "transparentQueue.h"
 
+// Use O to toggle between two-pass blending and weighted blended order-independent transparency
+// Use Q to toggle between single cube and sorted draw queue of cube field
+// Use 1, 2, 3, 4 to change number of cubes in the field
 class AlphaBlendApp : public VulkanApp
 {
+    constexpr static float statisticsInterval = 1000.f; // ms
+    constexpr static float cameraDistance = 4.f;
+    constexpr static float fieldExtent = 3.f;
+    constexpr static uint32_t minFieldSide = 4; // Cubes along each axis, doubled by each size
+
+    enum class Mode
+    {
+        TwoPass = 0, WeightedBlended, Sorted
+    };
+
+    // Back faces of cube should be drawn before its front faces
+    enum FieldPipeline : uint32_t
+    {
+        CullFront = 0, CullBack, FieldPipelineCount
+    };
+
+    struct Framebuffer
+    {
+        std::shared_ptr<magma::ColorAttachment> accum;
+        std::shared_ptr<magma::ImageView> accumView;
+        std::shared_ptr<magma::ColorAttachment> revealage;
+        std::shared_ptr<magma::ImageView> revealageView;
+        std::shared_ptr<magma::RenderPass> renderPass;
+        std::shared_ptr<magma::Framebuffer> framebuffer;
+    } oit;
+
     struct DescriptorSetTable : magma::DescriptorSetTable
     {
         magma::descriptor::UniformBuffer worldViewProj = 0;
@@ -11,6 +42,13 @@ class AlphaBlendApp : public VulkanApp
         MAGMA_REFLECT(worldViewProj, diffuse)
     } setTable;
 
+    struct CompositeDescriptorSetTable : magma::DescriptorSetTable
+    {
+        magma::descriptor::CombinedImageSampler accum = 0;
+        magma::descriptor::CombinedImageSampler revealage = 1;
+        MAGMA_REFLECT(accum, revealage)
+    } setTableComposite;
+
     std::unique_ptr<quadric::Cube> mesh;
     std::shared_ptr<magma::ImageView> logo;
     std::shared_ptr<magma::Sampler> anisotropicSampler;
@@ -19,8 +57,28 @@ class AlphaBlendApp : public VulkanApp
     std::shared_ptr<magma::PipelineLayout> pipelineLayout;
     std::shared_ptr<magma::GraphicsPipeline> cullFrontPipeline;
     std::shared_ptr<magma::GraphicsPipeline> cullBackPipeline;
+    std::shared_ptr<magma::GraphicsPipeline> oitPipeline;
+    std::shared_ptr<magma::Sampler> nearestSampler;
+    std::shared_ptr<magma::DescriptorSet> compositeDescriptorSet;
+    std::shared_ptr<magma::PipelineLayout> compositePipelineLayout;
+    std::shared_ptr<magma::GraphicsPipeline> compositePipeline;
+    std::shared_ptr<magma::PipelineLayout> fieldPipelineLayout;
+    std::shared_ptr<magma::GraphicsPipeline> fieldPipelines[FieldPipelineCount];
+    std::unique_ptr<ThreadPool> threadPool;
+    std::unique_ptr<TransparentQueue> drawQueue;
+    aligned_vector<rapid::matrix> objectTransforms;
 
     rapid::matrix viewProj;
+    rapid::matrix world;
+    float fieldAngle = 0.f;
+    uint32_t fieldSize = 1;
+    Mode mode = Mode::TwoPass;
+    bool rebuildCommandBuffers = false;
+    Timer sortTimer;
+    float statisticsTime = 0.f;
+    float sortTime = 0.f;
+    uint32_t statisticsFrames = 0;
+    uint64_t pipelineBinds = 0;
 
 public:
     AlphaBlendApp(const AppEntry& entry):
@@ -32,9 +90,15 @@ public:
         loadTextures();
         createUniformBuffers();
         createSampler();
+        createOitFramebuffer({width, height});
         setupDescriptorSet();
-        cullFrontPipeline = setupPipeline(negateViewport ? magma::renderstate::fillCullFrontCcw : magma::renderstate::fillCullFrontCw);
-        cullBackPipeline = setupPipeline(negateViewport ? magma::renderstate::fillCullBackCcw : magma::renderstate::fillCullBackCw);
+        setupCompositeDescriptorSet();
+        cullFrontPipeline = setupPipeline("transform.o", negateViewport ? magma::renderstate::fillCullFrontCcw : magma::renderstate::fillCullFrontCw, pipelineLayout);
+        cullBackPipeline = setupPipeline("transform.o", negateViewport ? magma::renderstate::fillCullBackCcw : magma::renderstate::fillCullBackCw, pipelineLayout);
+        setupOitPipelines();
+        setupFieldPipelines();
+        threadPool = std::make_unique<ThreadPool>();
+        drawQueue = std::make_unique<TransparentQueue>();
         recordCommandBuffer(FrontBuffer);
         recordCommandBuffer(BackBuffer);
         timer->run();
@@ -42,13 +106,99 @@ public:
 
     void render(uint32_t bufferIndex) override
     {
-        updatePerspectiveTransform();
+        if (rebuildCommandBuffers)
+        {
+            waitFences[1 - bufferIndex]->wait();
+            recordCommandBuffer(FrontBuffer);
+            recordCommandBuffer(BackBuffer);
+            rebuildCommandBuffers = false;
+        }
+        const float dt = timer->millisecondsElapsed();
+        updatePerspectiveTransform(dt);
+        if (Mode::Sorted == mode)
+        {   // Command buffer has been released by fence, so it is safe to record it again
+            buildDrawQueue();
+            recordCommandBuffer(bufferIndex);
+        }
         submitCommandBuffer(bufferIndex);
+        updateStatistics(dt);
+    }
+
+    void onKeyDown(char key, int repeat, uint32_t flags) override
+    {
+        switch (key)
+        {
+        case 'O': case 'o':
+            mode = (Mode::WeightedBlended == mode) ? Mode::TwoPass : Mode::WeightedBlended;
+            onModeChanged();
+            break;
+        case 'Q': case 'q':
+            mode = (Mode::Sorted == mode) ? Mode::TwoPass : Mode::Sorted;
+            onModeChanged();
+            break;
+        case '1': case '2': case '3': case '4':
+            fieldSize = key - '1';
+            onModeChanged();
+            break;
+        }
+        VulkanApp::onKeyDown(key, repeat, flags);
+    }
+
+    void onModeChanged()
+    {
+        rebuildCommandBuffers = true;
+        statisticsTime = 0.f;
+        sortTime = 0.f;
+        statisticsFrames = 0;
+        pipelineBinds = 0;
+        switch (mode)
+        {
+        case Mode::TwoPass:
+            std::cout << "Transparency: two-pass (back faces, then front faces)" << std::endl;
+            break;
+        case Mode::WeightedBlended:
+            std::cout << "Transparency: weighted blended OIT (one draw to accumulation and revealage, full-screen composite)" << std::endl;
+            break;
+        case Mode::Sorted:
+            std::cout << "Transparency: sorted draw queue of " << getFieldObjectCount() << " cubes" << std::endl;
+            break;
+        }
+    }
+
+    void updateStatistics(float dt)
+    {   // Two-pass blending writes 4 bytes per layer, OIT writes 8 + 1 bytes per layer and reads 9 bytes per pixel
+        statisticsTime += dt;
+        ++statisticsFrames;
+        if (statisticsTime < statisticsInterval)
+            return;
+        switch (mode)
+        {
+        case Mode::TwoPass:
+            std::cout << "Two-pass: " << statisticsTime/statisticsFrames << " ms per frame" << std::endl;
+            break;
+        case Mode::WeightedBlended:
+            std::cout << "Weighted blended: " << statisticsTime/statisticsFrames << " ms per frame" << std::endl;
+            break;
+        case Mode::Sorted:
+            {
+                const uint32_t drawCount = drawQueue->getDrawCount();
+                const float sortTimePerFrame = sortTime/statisticsFrames;
+                std::cout << "Sorted: " << drawCount << " draws, sort " << sortTimePerFrame << " ms ("
+                    << sortTimePerFrame * 1e6f/drawCount << " ns per draw, " << drawQueue->getPassCount() << " passes on "
+                    << threadPool->getThreadCount() << " threads), " << pipelineBinds/statisticsFrames << " pipeline binds, "
+                    << statisticsTime/statisticsFrames << " ms per frame" << std::endl;
+            }
+            break;
+        }
+        statisticsTime = 0.f;
+        sortTime = 0.f;
+        statisticsFrames = 0;
+        pipelineBinds = 0;
     }
 
     void setupView()
     {
-        const rapid::vector3 eye(0.f, 0.f, 4.f);
+        const rapid::vector3 eye(0.f, 0.f, cameraDistance);
         const rapid::vector3 center(0.f, 0.f, 0.f);
         const rapid::vector3 up(0.f, 1.f, 0.f);
         constexpr float fov = rapid::radians(60.f);
@@ -59,23 +209,66 @@ public:
         viewProj = view * proj;
     }
 
-    void updatePerspectiveTransform()
+    void updatePerspectiveTransform(float dt)
     {
         constexpr float speed = 0.05f;
+        constexpr float fieldSpeed = 0.01f;
         static float angle = 0.f;
-        angle += timer->millisecondsElapsed() * speed;
+        angle += dt * speed;
+        fieldAngle += rapid::radians(dt * fieldSpeed);
         const float radians = rapid::radians(angle);
         const rapid::matrix pitch = rapid::rotationX(radians);
         const rapid::matrix yaw = rapid::rotationY(radians);
         const rapid::matrix roll = rapid::rotationZ(radians);
-        const rapid::matrix world = pitch * yaw * roll;
+        world = pitch * yaw * roll;
         magma::helpers::mapScoped(uniformWorldViewProj,
-            [this, &world](auto *worldViewProj)
+            [this](auto *worldViewProj)
             {
                 *worldViewProj = world * viewProj;
             });
     }
 
+    uint32_t getFieldSide() const noexcept
+    {
+        return minFieldSide << fieldSize;
+    }
+
+    uint32_t getFieldObjectCount() const noexcept
+    {
+        const uint32_t side = getFieldSide();
+        return side * side * side;
+    }
+
+    void buildDrawQueue()
+    {   // Each cube spins around its center, field slowly rotates around vertical axis
+        const uint32_t side = getFieldSide();
+        const float spacing = fieldExtent/side;
+        const float scale = spacing * 0.3f;
+        const rapid::matrix cubeWorld = rapid::scaling(scale, scale, scale) * world;
+        const float s = sinf(fieldAngle), c = cosf(fieldAngle);
+        objectTransforms.resize(getFieldObjectCount());
+        drawQueue->clear();
+        uint32_t object = 0;
+        for (uint32_t z = 0; z < side; ++z)
+        for (uint32_t y = 0; y < side; ++y)
+        for (uint32_t x = 0; x < side; ++x, ++object)
+        {
+            const float px = (x + 0.5f) * spacing - fieldExtent * 0.5f;
+            const float py = (y + 0.5f) * spacing - fieldExtent * 0.5f;
+            const float pz = (z + 0.5f) * spacing - fieldExtent * 0.5f;
+            const float wx = px * c + pz * s;
+            const float wz = pz * c - px * s;
+            objectTransforms[object] = cubeWorld * rapid::translation(wx, py, wz) * viewProj;
+            // Camera looks down -Z axis
+            const float viewDepth = cameraDistance - wz;
+            drawQueue->push(viewDepth, FieldPipeline::CullFront, 0, object);
+            drawQueue->push(viewDepth, FieldPipeline::CullBack, 0, object);
+        }
+        sortTimer.run();
+        drawQueue->sort(threadPool.get());
+        sortTime += sortTimer.millisecondsElapsed();
+    }
+
     void createMesh()
     {
         mesh = std::make_unique<quadric::Cube>(cmdBufferCopy);
@@ -143,6 +336,34 @@ public:
     void createSampler()
     {
         anisotropicSampler = std::make_shared<magma::Sampler>(device, magma::sampler::magMinLinearMipAnisotropicClampToEdge);
+        nearestSampler = std::make_shared<magma::Sampler>(device, magma::sampler::magMinMipNearestClampToEdge);
+    }
+
+    void createOitFramebuffer(const VkExtent2D& extent)
+    {
+        constexpr bool sampled = true;
+        // Sum of weighted premultiplied colors needs range and precision of half float
+        oit.accum = std::make_shared<magma::ColorAttachment>(device, VK_FORMAT_R16G16B16A16_SFLOAT, extent, 1, 1, sampled);
+        oit.accumView = std::make_shared<magma::ImageView>(oit.accum);
+        // Product of (1 - alpha) is fine with 8 bits
+        oit.revealage = std::make_shared<magma::ColorAttachment>(device, VK_FORMAT_R8_UNORM, extent, 1, 1, sampled);
+        oit.revealageView = std::make_shared<magma::ImageView>(oit.revealage);
+        /* Both targets are cleared, written by transparent geometry and read by composite pass.
+           Initial layout is set by barrier in accumulateTransparency(). */
+        const magma::AttachmentDescription accumAttachment(oit.accum->getFormat(), 1,
+            magma::op::clearStore,
+            magma::op::dontCare,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        const magma::AttachmentDescription revealageAttachment(oit.revealage->getFormat(), 1,
+            magma::op::clearStore,
+            magma::op::dontCare,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+        oit.renderPass = std::shared_ptr<magma::RenderPass>(new magma::RenderPass(
+            device, {accumAttachment, revealageAttachment}));
+        oit.framebuffer = std::shared_ptr<magma::Framebuffer>(new magma::Framebuffer(
+            oit.renderPass, {oit.accumView, oit.revealageView}));
     }
 
     void setupDescriptorSet()
@@ -155,17 +376,71 @@ public:
         pipelineLayout = std::make_shared<magma::PipelineLayout>(descriptorSet->getLayout());
     }
 
-    std::shared_ptr<magma::GraphicsPipeline> setupPipeline(const magma::RasterizationState& rasterizationState) const
+    void setupCompositeDescriptorSet()
+    {
+        setTableComposite.accum = {oit.accumView, nearestSampler};
+        setTableComposite.revealage = {oit.revealageView, nearestSampler};
+        compositeDescriptorSet = std::make_shared<magma::DescriptorSet>(descriptorPool,
+            setTableComposite, VK_SHADER_STAGE_FRAGMENT_BIT,
+            nullptr, shaderReflectionFactory, "composite.o");
+        compositePipelineLayout = std::make_shared<magma::PipelineLayout>(compositeDescriptorSet->getLayout());
+    }
+
+    std::shared_ptr<magma::GraphicsPipeline> setupPipeline(const char *vertexShaderFileName,
+        const magma::RasterizationState& rasterizationState,
+        std::shared_ptr<magma::PipelineLayout> layout) const
     {
         return std::make_shared<GraphicsPipeline>(device,
-            "transform.o", "texture.o",
+            vertexShaderFileName, "texture.o",
             mesh->getVertexInput(),
             magma::renderstate::triangleList,
             rasterizationState,
             magma::renderstate::dontMultisample,
             magma::renderstate::depthAlwaysDontWrite,
             magma::renderstate::blendNormalRgb,
+            std::move(layout),
+            renderPass, 0,
+            pipelineCache);
+    }
+
+    void setupFieldPipelines()
+    {   // Transform of each cube is pushed before its draw
+        constexpr magma::pushconstant::VertexConstantRange<rapid::matrix> pushConstantRange;
+        fieldPipelineLayout = std::make_shared<magma::PipelineLayout>(descriptorSet->getLayout(), pushConstantRange);
+        fieldPipelines[CullFront] = setupPipeline("field.o",
+            negateViewport ? magma::renderstate::fillCullFrontCcw : magma::renderstate::fillCullFrontCw, fieldPipelineLayout);
+        fieldPipelines[CullBack] = setupPipeline("field.o",
+            negateViewport ? magma::renderstate::fillCullBackCcw : magma::renderstate::fillCullBackCw, fieldPipelineLayout);
+    }
+
+    void setupOitPipelines()
+    {   // Colors are summed, revealage is multiplied by (1 - alpha)
+        const magma::MultiColorBlendState accumulateBlend({
+            magma::ColorBlendAttachmentState(VK_BLEND_FACTOR_ONE, VK_BLEND_FACTOR_ONE, VK_BLEND_OP_ADD),
+            magma::ColorBlendAttachmentState(VK_BLEND_FACTOR_ZERO, VK_BLEND_FACTOR_ONE_MINUS_SRC_COLOR, VK_BLEND_OP_ADD,
+                VK_COLOR_COMPONENT_R_BIT)
+        });
+        // Both faces in one pass, submission order doesn't matter
+        oitPipeline = std::make_shared<GraphicsPipeline>(device,
+            "transform.o", "oit.o",
+            mesh->getVertexInput(),
+            magma::renderstate::triangleList,
+            negateViewport ? magma::renderstate::fillCullNoneCcw : magma::renderstate::fillCullNoneCw,
+            magma::renderstate::dontMultisample,
+            magma::renderstate::depthAlwaysDontWrite,
+            accumulateBlend,
             pipelineLayout,
+            oit.renderPass, 0,
+            pipelineCache);
+        compositePipeline = std::make_shared<GraphicsPipeline>(device,
+            "fullscreen.o", "composite.o",
+            magma::renderstate::nullVertexInput,
+            magma::renderstate::triangleList,
+            magma::renderstate::fillCullNoneCcw,
+            magma::renderstate::dontMultisample,
+            magma::renderstate::depthAlwaysDontWrite,
+            magma::renderstate::blendNormalRgb,
+            compositePipelineLayout,
             renderPass, 0,
             pipelineCache);
     }
@@ -175,6 +450,8 @@ public:
         std::shared_ptr<magma::CommandBuffer> cmdBuffer = commandBuffers[index];
         cmdBuffer->begin();
         {
+            if (Mode::WeightedBlended == mode)
+                accumulateTransparency(cmdBuffer);
             cmdBuffer->beginRenderPass(renderPass, framebuffers[index],
                 {
                     magma::ClearColor(0.35f, 0.53f, 0.7f, 1.f)
@@ -182,18 +459,83 @@ public:
             {
                 cmdBuffer->setViewport(0, 0, width, negateViewport ? -height : height);
                 cmdBuffer->setScissor(0, 0, width, height);
-                cmdBuffer->bindDescriptorSet(cullFrontPipeline, 0, descriptorSet);
-                // Draw back faced triangles
-                cmdBuffer->bindPipeline(cullFrontPipeline);
-                mesh->draw(cmdBuffer);
-                // Draw front faced triangles
-                cmdBuffer->bindPipeline(cullBackPipeline);
-                mesh->draw(cmdBuffer);
+                if (Mode::WeightedBlended == mode)
+                {   // Resolve weighted average over background
+                    cmdBuffer->bindDescriptorSet(compositePipeline, 0, compositeDescriptorSet);
+                    cmdBuffer->bindPipeline(compositePipeline);
+                    cmdBuffer->draw(3, 0);
+                }
+                else if (Mode::Sorted == mode)
+                    drawSortedField(cmdBuffer);
+                else
+                {
+                    cmdBuffer->bindDescriptorSet(cullFrontPipeline, 0, descriptorSet);
+                    // Draw back faced triangles
+                    cmdBuffer->bindPipeline(cullFrontPipeline);
+                    mesh->draw(cmdBuffer);
+                    // Draw front faced triangles
+                    cmdBuffer->bindPipeline(cullBackPipeline);
+                    mesh->draw(cmdBuffer);
+                }
             }
             cmdBuffer->endRenderPass();
         }
         cmdBuffer->end();
     }
+
+    void drawSortedField(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {   // Pipeline is bound only if it differs from the previous draw
+        cmdBuffer->bindDescriptorSet(fieldPipelines[CullFront], 0, descriptorSet);
+        uint32_t boundPipeline = FieldPipelineCount;
+        for (const TransparentQueue::DrawItem& draw : drawQueue->getDraws())
+        {
+            if (draw.pipeline != boundPipeline)
+            {
+                cmdBuffer->bindPipeline(fieldPipelines[draw.pipeline]);
+                boundPipeline = draw.pipeline;
+                ++pipelineBinds;
+            }
+            cmdBuffer->pushConstantBlock(fieldPipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, objectTransforms[draw.object]);
+            mesh->draw(cmdBuffer);
+        }
+    }
+
+    void accumulateTransparency(std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+    {
+        VkImageSubresourceRange subresourceRange;
+        subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        subresourceRange.baseMipLevel = 0;
+        subresourceRange.levelCount = 1;
+        subresourceRange.baseArrayLayer = 0;
+        subresourceRange.layerCount = 1;
+        /* Targets are shared between frames in flight, so clear should wait
+           until composite pass of the previous frame has read them
+           (write after read). Contents are discarded anyway. */
+        for (const auto& target : {oit.accum, oit.revealage})
+        {
+            cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                magma::ImageMemoryBarrier(target,
+                    VK_IMAGE_LAYOUT_UNDEFINED,
+                    VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+                    subresourceRange));
+        }
+        cmdBuffer->beginRenderPass(oit.renderPass, oit.framebuffer,
+            {
+                magma::ClearColor(0.f, 0.f, 0.f, 0.f), // Accumulation
+                magma::ClearColor(1.f, 1.f, 1.f, 1.f) // Revealage
+            });
+        {
+            cmdBuffer->setViewport(0, 0, width, negateViewport ? -height : height);
+            cmdBuffer->setScissor(0, 0, width, height);
+            cmdBuffer->bindDescriptorSet(oitPipeline, 0, descriptorSet);
+            cmdBuffer->bindPipeline(oitPipeline);
+            mesh->draw(cmdBuffer);
+        }
+        cmdBuffer->endRenderPass();
+        // Targets should be written before composite pass reads them
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+            magma::MemoryBarrier(VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT));
+    }
 };
 
 std::unique_ptr<IApplication> appFactory(const AppEntry& entry)
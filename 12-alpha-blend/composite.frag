@@ -0,0 +1,15 @@
+#version 450
+
+layout(binding = 0) uniform sampler2D accumTexture;
+layout(binding = 1) uniform sampler2D revealageTexture;
+
+layout(location = 0) out vec4 oColor;
+
+void main()
+{   // Targets have the same size as framebuffer
+    ivec2 coord = ivec2(gl_FragCoord.xy);
+    vec4 accum = texelFetch(accumTexture, coord, 0);
+    float revealage = texelFetch(revealageTexture, coord, 0).r;
+    // Weighted average color is blended over background by total coverage
+    oColor = vec4(accum.rgb/clamp(accum.a, 1e-4, 5e4), 1. - revealage);
+}
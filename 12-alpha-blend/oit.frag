@@ -0,0 +1,30 @@
+#version 450
+
+layout(binding = 1) uniform sampler2D diffuse;
+
+layout(location = 0) in vec2 texCoord;
+layout(location = 1) in vec3 faceColor;
+
+layout(location = 0) out vec4 oAccum;
+layout(location = 1) out float oRevealage;
+
+// Depth weight from McGuire, "Implementing Weighted, Blended Order-Independent Transparency" (2015),
+// which uses window-space depth instead of view-space depth of Eq. (7)-(10) of McGuire and Bavoil
+float weight(float z, float alpha)
+{
+    return clamp(pow(min(1., alpha * 10.) + 0.01, 3.) * 1e8 * pow(1. - z * 0.9, 3.), 1e-2, 3e3);
+}
+
+void main()
+{
+    vec4 color = texture(diffuse, texCoord);
+    float alpha = min(color.a + 0.1, 1.); // make geometry visible
+    vec3 rgb;
+    if (gl_FrontFacing)
+        rgb = min(color.rgb + texCoord.sts, 1.);
+    else
+        rgb = faceColor;
+    // Premultiplied color is summed, coverage is multiplied
+    oAccum = vec4(rgb * alpha, alpha) * weight(gl_FragCoord.z, alpha);
+    oRevealage = alpha;
+}
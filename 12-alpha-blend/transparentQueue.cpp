@@ -0,0 +1,37 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "transparentQueue.h"
+
+TransparentQueue::TransparentQueue(uint32_t depthBits /* 20 */):
+    depthBits(std::min(std::max(depthBits, 1U), 31U))
+{}
+
+void TransparentQueue::clear() noexcept
+{
+    draws.clear();
+    keys.clear();
+}
+
+void TransparentQueue::push(float viewDepth, uint32_t pipeline, uint32_t material, uint32_t object)
+{
+    if ((pipeline >> PipelineBits) || (material >> MaterialBits))
+        throw std::invalid_argument("pipeline or material index doesn't fit into sort key");
+    // Bits of non-negative float grow with its value, sign bit is always zero
+    uint32_t bits;
+    viewDepth = std::max(viewDepth, 0.f);
+    memcpy(&bits, &viewDepth, sizeof(float));
+    const uint32_t depth = bits >> (31 - depthBits);
+    const uint64_t farToNear = (1U << depthBits) - 1 - depth;
+    const uint64_t key = (farToNear << (PipelineBits + MaterialBits)) | (pipeline << MaterialBits) | material;
+    keys.push_back({key, static_cast<uint32_t>(draws.size())});
+    draws.push_back({pipeline, material, object});
+}
+
+void TransparentQueue::sort(ThreadPool *threadPool /* nullptr */)
+{
+    radixSort.sort(keys, threadPool);
+    sortedDraws.resize(draws.size());
+    for (size_t i = 0, count = keys.size(); i < count; ++i)
+        sortedDraws[i] = draws[keys[i].value];
+}
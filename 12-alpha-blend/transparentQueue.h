@@ -0,0 +1,44 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "../framework/radixSort.h"
+
+class ThreadPool;
+
+/* Queue of transparent draws that are submitted back to front.
+   Sort key holds view depth in its high bits, followed by pipeline
+   and material, so that draws of the same quantized depth are grouped
+   by state. Depth is quantized by dropping low mantissa bits of its
+   float representation, i.e. with constant relative precision; fewer
+   depth bits trade ordering accuracy for fewer state changes. */
+class TransparentQueue
+{
+public:
+    constexpr static uint32_t PipelineBits = 8;
+    constexpr static uint32_t MaterialBits = 16;
+
+    struct DrawItem
+    {
+        uint32_t pipeline;
+        uint32_t material;
+        uint32_t object;
+    };
+
+    explicit TransparentQueue(uint32_t depthBits = 20);
+    void clear() noexcept;
+    // Draws with larger view depth are submitted first
+    void push(float viewDepth, uint32_t pipeline, uint32_t material, uint32_t object);
+    void sort(ThreadPool *threadPool = nullptr);
+    // Sorted draws, valid after sort()
+    const std::vector<DrawItem>& getDraws() const noexcept { return sortedDraws; }
+    uint32_t getDrawCount() const noexcept { return static_cast<uint32_t>(draws.size()); }
+    uint32_t getDepthBits() const noexcept { return depthBits; }
+    uint32_t getPassCount() const noexcept { return radixSort.getPassCount(); }
+
+private:
+    const uint32_t depthBits;
+    std::vector<DrawItem> draws;
+    std::vector<RadixSort::Item> keys;
+    std::vector<DrawItem> sortedDraws;
+    RadixSort radixSort;
+};
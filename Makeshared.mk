@@ -19,9 +19,21 @@ LDFLAGS=$(LIB_DIR) -lpthread -lxcb -lvulkan -l$(MAGMA)
 
 FRAMEWORK=../framework
 FRAMEWORK_OBJS= \
+	$(FRAMEWORK)/bezierMesh.o \
+	$(FRAMEWORK)/cullingScene.o \
+	$(FRAMEWORK)/depthRasterizer.o \
 	$(FRAMEWORK)/graphicsPipeline.o \
+	$(FRAMEWORK)/imageArrayStreamer.o \
 	$(FRAMEWORK)/linearAllocator.o \
 	$(FRAMEWORK)/main.o \
+	$(FRAMEWORK)/meshCache.o \
+	$(FRAMEWORK)/meshlets.o \
+	$(FRAMEWORK)/meshOptimizer.o \
+	$(FRAMEWORK)/meshSimplifier.o \
+	$(FRAMEWORK)/radixSort.o \
+	$(FRAMEWORK)/renderGraph.o \
+	$(FRAMEWORK)/screenshotCapture.o \
+	$(FRAMEWORK)/threadPool.o \
 	$(FRAMEWORK)/utilities.o \
 	$(FRAMEWORK)/vulkanApp.o \
 	$(FRAMEWORK)/xcbApp.o
@@ -35,3 +47,6 @@ FRAMEWORK_OBJS= \
 %.o: %.frag
 	$(GLSLC) -V $*.frag -o $*.o
 
+%.o: %.comp
+	$(GLSLC) -V $*.comp -o $*.o
+
@@ -0,0 +1,550 @@
+#include <cmath>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <future>
+#include <iomanip>
+#include <sstream>
+#include <xmmintrin.h>
+#include "bezierMesh.h"
+#include "meshSimplifier.h"
+#include "quantization.h"
+#include "threadPool.h"
+#include "timer.h"
+
+namespace
+{
+inline void bernstein(float t, float b[4], float db[4]) noexcept
+{
+    const float s = 1.f - t;
+    b[0] = s * s * s;
+    b[1] = 3.f * t * s * s;
+    b[2] = 3.f * t * t * s;
+    b[3] = t * t * t;
+    db[0] = -3.f * s * s;
+    db[1] = 3.f * s * s - 6.f * t * s;
+    db[2] = 6.f * t * s - 3.f * t * t;
+    db[3] = 3.f * t * t;
+}
+
+inline void evaluatePatch(const float cp[16][3], float u, float v, float p[3], float n[3]) noexcept
+{
+    float bu[4], dbu[4], bv[4], dbv[4];
+    bernstein(u, bu, dbu);
+    bernstein(v, bv, dbv);
+    float du[3] = {0.f, 0.f, 0.f}, dv[3] = {0.f, 0.f, 0.f};
+    p[0] = p[1] = p[2] = 0.f;
+    for (int i = 0; i < 4; ++i)
+    {
+        for (int j = 0; j < 4; ++j)
+        {
+            const float *c = cp[i * 4 + j];
+            const float w = bv[i] * bu[j];
+            const float wu = bv[i] * dbu[j];
+            const float wv = dbv[i] * bu[j];
+            for (int k = 0; k < 3; ++k)
+            {
+                p[k] += w * c[k];
+                du[k] += wu * c[k];
+                dv[k] += wv * c[k];
+            }
+        }
+    }
+    n[0] = du[1] * dv[2] - du[2] * dv[1];
+    n[1] = du[2] * dv[0] - du[0] * dv[2];
+    n[2] = du[0] * dv[1] - du[1] * dv[0];
+}
+
+inline void writeVertex(BezierPatchMesh::Vertex& vertex, const float p[3], const float n[3], float u, float v,
+    const float /* center */[3], const float /* invHalfExtent */[3]) noexcept
+{
+    vertex.position = rapid::float3(p[0], p[1], p[2]);
+    vertex.normal = rapid::float3(n[0], n[1], n[2]);
+    vertex.texCoord = rapid::float2(u, v);
+}
+
+inline void writeVertex(BezierPatchMesh::QuantizedVertex& vertex, const float p[3], const float n[3], float u, float v,
+    const float center[3], const float invHalfExtent[3]) noexcept
+{
+    for (int i = 0; i < 3; ++i)
+        vertex.position[i] = quantization::snorm16((p[i] - center[i]) * invHalfExtent[i]);
+    vertex.position[3] = 32767;
+    vertex.normal = quantization::packNormal1010102(n[0], n[1], n[2]);
+    vertex.texCoord[0] = quantization::half(u);
+    vertex.texCoord[1] = quantization::half(v);
+}
+} // namespace
+
+BezierPatchMesh::BezierPatchMesh(const uint32_t patches[][16], uint32_t numPatches, const float controlPoints[][3],
+    uint32_t subdivisionDegree, std::shared_ptr<magma::CommandBuffer> cmdBuffer, const Options& options):
+    numPatches(numPatches),
+    subdivisionDegree(subdivisionDegree),
+    quantize(options.quantize),
+    vertexInput(0, {
+        {0, &Vertex::position},
+        {1, &Vertex::normal},
+        {2, &Vertex::texCoord}}),
+    dequantization(rapid::identity()),
+    tessellationTime(0.f),
+    setupTime(0.f),
+    cached(false),
+    cacheKey(0)
+{
+    const bool optimize = options.optimize;
+    const bool buildMeshlets = options.buildMeshlets;
+    const uint32_t lodCount = std::max(1U, std::min(options.lodCount, mesh::MaxLods));
+    const std::string& cacheDirectory = options.cacheDirectory;
+    ThreadPool *threadPool = options.threadPool;
+    Timer setupTimer;
+    setupTimer.run();
+    // Basis is the same for all patches, so compute it once for each row/column of samples
+    const uint32_t rowSize = subdivisionDegree + 1;
+    const uint32_t stride = (rowSize + 3) & ~3;
+    basis.resize(stride * 8, 0.f);
+    for (uint32_t i = 0; i < rowSize; ++i)
+    {
+        float b[4], db[4];
+        bernstein(static_cast<float>(i)/subdivisionDegree, b, db);
+        for (int k = 0; k < 4; ++k)
+        {
+            basis[k * stride + i] = b[k];
+            basis[(4 + k) * stride + i] = db[k];
+        }
+    }
+    // Patch lies inside of convex hull of its control points,
+    // so quantization bounds are known before tessellation
+    float minBound[3] = {INFINITY, INFINITY, INFINITY};
+    float maxBound[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t i = 0; i < numPatches; ++i)
+    {
+        for (int j = 0; j < 16; ++j)
+        {
+            const float *c = controlPoints[patches[i][j] - 1];
+            for (int k = 0; k < 3; ++k)
+            {
+                minBound[k] = std::min(minBound[k], c[k]);
+                maxBound[k] = std::max(maxBound[k], c[k]);
+            }
+        }
+    }
+    float halfExtent[3];
+    for (int k = 0; k < 3; ++k)
+    {
+        center[k] = (minBound[k] + maxBound[k]) * .5f;
+        halfExtent[k] = std::max((maxBound[k] - minBound[k]) * .5f, 1e-6f);
+        invHalfExtent[k] = 1.f/halfExtent[k];
+    }
+    if (quantize)
+    {   // Maps [-1, 1] back to object space
+        dequantization = rapid::scaling(halfExtent[0], halfExtent[1], halfExtent[2]) *
+            rapid::translation(center[0], center[1], center[2]);
+        quantizedVertexInput = std::make_unique<magma::VertexInputState>(
+            magma::VertexInputBinding(0, sizeof(QuantizedVertex)),
+            std::initializer_list<magma::VertexInputAttribute>{
+                magma::VertexInputAttribute(0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(QuantizedVertex, position)),
+                // SNORM variant isn't guaranteed to be supported for vertex buffers, shaders decode n * 2 - 1
+                magma::VertexInputAttribute(1, 0, VK_FORMAT_A2B10G10R10_UNORM_PACK32, offsetof(QuantizedVertex, normal)),
+                magma::VertexInputAttribute(2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(QuantizedVertex, texCoord))
+            });
+    }
+    vertexCount = numPatches * rowSize * rowSize;
+    indexCount = numPatches * subdivisionDegree * subdivisionDegree * 6;
+    totalIndexCount = indexCount;
+    lods.push_back({0, indexCount, 0.f});
+    if (!cacheDirectory.empty())
+    {
+        cacheKey = computeKey(patches, controlPoints, optimize, lodCount, buildMeshlets);
+        std::ostringstream filename;
+        filename << cacheDirectory << "/bezier-" << std::hex << std::setw(16) << std::setfill('0') << cacheKey << ".mesh";
+        std::unique_ptr<mesh::MappedFile> file = mesh::loadCache(filename.str(), cacheKey);
+        if (file)
+        {   // Make sure that file has the same vertex layout
+            const mesh::FileHeader& header = file->getHeader();
+            const mesh::FileHeader expected = getFileHeader();
+            cached = (header.vertexStride == expected.vertexStride) &&
+                (header.attributeCount == expected.attributeCount) &&
+                !memcmp(header.attributes, expected.attributes, sizeof(mesh::VertexAttribute) * header.attributeCount);
+        }
+        if (cached)
+            upload(*file, std::move(cmdBuffer));
+        else
+        {
+            mesh::createDirectory(cacheDirectory);
+            cacheFilename = filename.str();
+        }
+    }
+    if (!cached)
+    {
+        if (!optimize && (1 == lodCount) && !buildMeshlets)
+            upload(patches, controlPoints, std::move(cmdBuffer), threadPool);
+        else
+        {
+            std::vector<Vertex> vertices(vertexCount);
+            std::vector<uint32_t> indices(indexCount);
+            Timer timer;
+            timer.run();
+            tessellate(patches, controlPoints, vertices.data(), indices.data(), threadPool);
+            tessellationTime = timer.millisecondsElapsed();
+            if (optimize)
+            {
+                unoptimizedStats = mesh::analyzeVertexCache(indices, vertexCount);
+                mesh::optimizeVertexCache(indices, vertexCount);
+                mesh::optimizeOverdraw(indices, &vertices[0].position.x, sizeof(Vertex), vertexCount);
+            }
+            if (buildMeshlets)
+            {   // Clustering reorders triangles, but growth by adjacent triangles keeps them cache-friendly
+                meshlets = mesh::buildMeshlets(indices.data(), indexCount, &vertices[0].position.x,
+                    sizeof(Vertex), vertexCount);
+            }
+            generateLods(indices, vertices, lodCount, optimize, threadPool);
+            if (optimize)
+            {   // Vertices are ordered by the most detailed level, which is first in index buffer
+                vertexCount = mesh::optimizeVertexFetch(indices, vertices.data(), vertexCount, sizeof(Vertex));
+                vertices.resize(vertexCount);
+                const std::vector<uint32_t> lod0(indices.begin(), indices.begin() + indexCount);
+                optimizedStats = mesh::analyzeVertexCache(lod0, vertexCount);
+            }
+            upload(vertices, indices, std::move(cmdBuffer));
+        }
+    }
+    setupTime = setupTimer.millisecondsElapsed();
+}
+
+const magma::VertexInputState& BezierPatchMesh::getVertexInput() const noexcept
+{
+    if (quantize)
+        return *quantizedVertexInput;
+    return vertexInput;
+}
+
+rapid::float4 BezierPatchMesh::getBoundingSphere() const noexcept
+{
+    float radiusSq = 0.f;
+    for (int k = 0; k < 3; ++k)
+        radiusSq += 1.f/(invHalfExtent[k] * invHalfExtent[k]);
+    return rapid::float4(center[0], center[1], center[2], sqrtf(radiusSq));
+}
+
+void BezierPatchMesh::bind(std::shared_ptr<magma::CommandBuffer> cmdBuffer) const
+{
+    cmdBuffer->bindVertexBuffer(0, vertexBuffer);
+    cmdBuffer->bindIndexBuffer(indexBuffer);
+}
+
+void BezierPatchMesh::draw(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t lod /* 0 */) const
+{
+    const mesh::LevelOfDetail& level = lods[std::min(lod, getLodCount() - 1)];
+    bind(cmdBuffer);
+    cmdBuffer->drawIndexed(level.indexCount, level.firstIndex, 0);
+}
+
+void BezierPatchMesh::drawInstanced(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t instanceCount,
+    uint32_t firstInstance /* 0 */, uint32_t lod /* 0 */) const
+{
+    const mesh::LevelOfDetail& level = lods[std::min(lod, getLodCount() - 1)];
+    cmdBuffer->drawIndexedInstanced(level.indexCount, instanceCount, level.firstIndex, 0, firstInstance);
+}
+
+template<typename VertexType>
+void BezierPatchMesh::tessellate(const uint32_t patches[][16], const float controlPoints[][3],
+    VertexType *vertices, uint32_t *indices, ThreadPool *threadPool) const
+{
+    const uint32_t rowSize = subdivisionDegree + 1;
+    const uint32_t stride = (rowSize + 3) & ~3;
+    const uint32_t patchVertexCount = rowSize * rowSize;
+    const uint32_t patchIndexCount = subdivisionDegree * subdivisionDegree * 6;
+    const float step = 1.f/subdivisionDegree;
+    auto tessellatePatch = [&](uint32_t patchIndex)
+    {
+        float cp[16][3];
+        for (int i = 0; i < 16; ++i)
+        {
+            const float *c = controlPoints[patches[patchIndex][i] - 1];
+            cp[i][0] = c[0]; cp[i][1] = c[1]; cp[i][2] = c[2];
+        }
+        VertexType *patchVertices = vertices + patchIndex * patchVertexCount;
+        for (uint32_t i = 0; i < rowSize; ++i)
+        {   // Reduce patch to cubic curve (and its derivative) along u at given v
+            __m128 c[4][3], dc[4][3];
+            for (int j = 0; j < 4; ++j)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    float sum = 0.f, dsum = 0.f;
+                    for (int m = 0; m < 4; ++m)
+                    {
+                        sum += basis[m * stride + i] * cp[m * 4 + j][k];
+                        dsum += basis[(4 + m) * stride + i] * cp[m * 4 + j][k];
+                    }
+                    c[j][k] = _mm_set1_ps(sum);
+                    dc[j][k] = _mm_set1_ps(dsum);
+                }
+            }
+            // Evaluate four samples along u at once
+            for (uint32_t j0 = 0; j0 < rowSize; j0 += 4)
+            {
+                __m128 p[3], du[3], dv[3];
+                for (int k = 0; k < 3; ++k)
+                    p[k] = du[k] = dv[k] = _mm_setzero_ps();
+                for (int m = 0; m < 4; ++m)
+                {
+                    const __m128 b = _mm_loadu_ps(&basis[m * stride + j0]);
+                    const __m128 db = _mm_loadu_ps(&basis[(4 + m) * stride + j0]);
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        p[k] = _mm_add_ps(p[k], _mm_mul_ps(b, c[m][k]));
+                        du[k] = _mm_add_ps(du[k], _mm_mul_ps(db, c[m][k]));
+                        dv[k] = _mm_add_ps(dv[k], _mm_mul_ps(b, dc[m][k]));
+                    }
+                }
+                __m128 n[3];
+                n[0] = _mm_sub_ps(_mm_mul_ps(du[1], dv[2]), _mm_mul_ps(du[2], dv[1]));
+                n[1] = _mm_sub_ps(_mm_mul_ps(du[2], dv[0]), _mm_mul_ps(du[0], dv[2]));
+                n[2] = _mm_sub_ps(_mm_mul_ps(du[0], dv[1]), _mm_mul_ps(du[1], dv[0]));
+                const __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], n[0]), _mm_mul_ps(n[1], n[1])), _mm_mul_ps(n[2], n[2]));
+                const __m128 invLength = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(lengthSq));
+                alignas(16) float positions[3][4], normals[3][4], lengths[4];
+                for (int k = 0; k < 3; ++k)
+                {
+                    _mm_store_ps(positions[k], p[k]);
+                    _mm_store_ps(normals[k], _mm_mul_ps(n[k], invLength));
+                }
+                _mm_store_ps(lengths, lengthSq);
+                const uint32_t count = std::min(4U, rowSize - j0);
+                for (uint32_t l = 0; l < count; ++l)
+                {
+                    const uint32_t j = j0 + l;
+                    const float u = j * step, v = i * step;
+                    const float position[3] = {positions[0][l], positions[1][l], positions[2][l]};
+                    float normal[3] = {normals[0][l], normals[1][l], normals[2][l]};
+                    if (lengths[l] < 1e-12f)
+                    {   // Collapsed edge (lid or bottom pole), take normal slightly inside of the patch
+                        constexpr float eps = 1e-3f;
+                        float q[3];
+                        evaluatePatch(cp, u < .5f ? u + eps : u - eps, v < .5f ? v + eps : v - eps, q, normal);
+                        const float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+                        for (int k = 0; k < 3; ++k)
+                            normal[k] /= length;
+                    }
+                    writeVertex(patchVertices[i * rowSize + j], position, normal, u, v, center, invHalfExtent);
+                }
+            }
+        }
+        // Counter-clockwise when viewed from outside
+        const uint32_t baseVertex = patchIndex * patchVertexCount;
+        uint32_t *patchIndices = indices + patchIndex * patchIndexCount;
+        for (uint32_t i = 0; i < subdivisionDegree; ++i)
+        {
+            for (uint32_t j = 0; j < subdivisionDegree; ++j)
+            {
+                const uint32_t a = baseVertex + i * rowSize + j;
+                const uint32_t b = a + rowSize;
+                *patchIndices++ = a;
+                *patchIndices++ = a + 1;
+                *patchIndices++ = b;
+                *patchIndices++ = a + 1;
+                *patchIndices++ = b + 1;
+                *patchIndices++ = b;
+            }
+        }
+    };
+    if (!threadPool)
+    {
+        for (uint32_t i = 0; i < numPatches; ++i)
+            tessellatePatch(i);
+        return;
+    }
+    // Patches write to disjoint ranges of vertices and indices, so no synchronization is needed
+    std::vector<std::future<void>> results;
+    results.reserve(numPatches);
+    for (uint32_t i = 0; i < numPatches; ++i)
+        results.push_back(threadPool->submit([&tessellatePatch, i]() { tessellatePatch(i); }));
+    for (auto& result : results)
+        result.get();
+}
+
+void BezierPatchMesh::generateLods(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+    uint32_t lodCount, bool optimize, ThreadPool *threadPool)
+{   // Each level halves triangle count and is simplified from the full mesh independently
+    // Patch borders are seams of texture coordinates, simplifier keeps them from stretching
+    constexpr uint32_t attributeCount = 5; // Normal and texture coordinates
+    static_assert(offsetof(Vertex, texCoord) == offsetof(Vertex, normal) + sizeof(float) * 3,
+        "normal and texture coordinates should be adjacent");
+    std::vector<std::vector<uint32_t>> lodIndices(lodCount);
+    std::vector<float> errors(lodCount, 0.f);
+    auto simplifyLevel = [&](uint32_t lod)
+    {
+        const uint32_t targetIndexCount = ((indexCount/3) >> lod) * 3;
+        lodIndices[lod] = indices;
+        errors[lod] = mesh::simplify(lodIndices[lod], &vertices[0].position.x, sizeof(Vertex),
+            vertexCount, targetIndexCount, &vertices[0].normal.x, sizeof(Vertex), attributeCount);
+        if (optimize)
+            mesh::optimizeVertexCache(lodIndices[lod], vertexCount);
+    };
+    std::vector<std::future<void>> results;
+    for (uint32_t lod = 1; lod < lodCount; ++lod)
+    {
+        if (threadPool)
+            results.push_back(threadPool->submit([&simplifyLevel, lod]() { simplifyLevel(lod); }));
+        else
+            simplifyLevel(lod);
+    }
+    for (auto& result : results)
+        result.get();
+    for (uint32_t lod = 1; lod < lodCount; ++lod)
+    {
+        lods.push_back({static_cast<uint32_t>(indices.size()),
+            static_cast<uint32_t>(lodIndices[lod].size()),
+            std::max(errors[lod], lods.back().error)});
+        indices.insert(indices.end(), lodIndices[lod].begin(), lodIndices[lod].end());
+    }
+    totalIndexCount = static_cast<uint32_t>(indices.size());
+}
+
+void BezierPatchMesh::upload(const uint32_t patches[][16], const float controlPoints[][3],
+    std::shared_ptr<magma::CommandBuffer> cmdBuffer, ThreadPool *threadPool)
+{
+    vertexBufferSize = vertexCount * (quantize ? sizeof(QuantizedVertex) : sizeof(Vertex));
+    const VkDeviceSize indexBufferSize = indexCount * sizeof(uint32_t);
+    auto tessellateInto = [&](uint8_t *vertices, uint32_t *indices)
+    {
+        Timer timer;
+        timer.run();
+        if (quantize)
+            tessellate(patches, controlPoints, reinterpret_cast<QuantizedVertex *>(vertices), indices, threadPool);
+        else
+            tessellate(patches, controlPoints, reinterpret_cast<Vertex *>(vertices), indices, threadPool);
+        tessellationTime = timer.millisecondsElapsed();
+    };
+    auto stagingBuffer = std::make_shared<magma::SrcTransferBuffer>(cmdBuffer->getDevice(), vertexBufferSize + indexBufferSize);
+    if (cacheFilename.empty())
+    {
+        magma::helpers::mapScoped<uint8_t>(stagingBuffer,
+            [&](uint8_t *data)
+            {   // Tessellate right into host visible memory, avoiding intermediate copy
+                tessellateInto(data, reinterpret_cast<uint32_t *>(data + vertexBufferSize));
+            });
+    }
+    else
+    {   // Staging memory may be write-combined, so cache is written from system memory
+        std::vector<uint8_t> vertices(static_cast<size_t>(vertexBufferSize));
+        std::vector<uint32_t> indices(indexCount);
+        tessellateInto(vertices.data(), indices.data());
+        saveCache(vertices.data(), indices.data());
+        magma::helpers::mapScoped<uint8_t>(stagingBuffer,
+            [&](uint8_t *data)
+            {
+                memcpy(data, vertices.data(), vertices.size());
+                memcpy(data + vertexBufferSize, indices.data(), static_cast<size_t>(indexBufferSize));
+            });
+    }
+    createBuffers(std::move(stagingBuffer), std::move(cmdBuffer));
+}
+
+void BezierPatchMesh::upload(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+    std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+{
+    vertexBufferSize = vertexCount * (quantize ? sizeof(QuantizedVertex) : sizeof(Vertex));
+    const VkDeviceSize indexBufferSize = totalIndexCount * sizeof(uint32_t);
+    std::vector<QuantizedVertex> quantizedVertices;
+    if (quantize)
+    {
+        quantizedVertices.resize(vertices.size());
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            const Vertex& vertex = vertices[i];
+            writeVertex(quantizedVertices[i], &vertex.position.x, &vertex.normal.x,
+                vertex.texCoord.x, vertex.texCoord.y, center, invHalfExtent);
+        }
+    }
+    const void *vertexData = quantize ? static_cast<const void *>(quantizedVertices.data()) : vertices.data();
+    if (!cacheFilename.empty())
+        saveCache(vertexData, indices.data());
+    auto stagingBuffer = std::make_shared<magma::SrcTransferBuffer>(cmdBuffer->getDevice(), vertexBufferSize + indexBufferSize);
+    magma::helpers::mapScoped<uint8_t>(stagingBuffer,
+        [&](uint8_t *data)
+        {
+            memcpy(data, vertexData, static_cast<size_t>(vertexBufferSize));
+            memcpy(data + vertexBufferSize, indices.data(), static_cast<size_t>(indexBufferSize));
+        });
+    createBuffers(std::move(stagingBuffer), std::move(cmdBuffer));
+}
+
+void BezierPatchMesh::upload(const mesh::MappedFile& file, std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+{
+    const mesh::FileHeader& header = file.getHeader();
+    vertexCount = header.vertexCount;
+    totalIndexCount = header.indexCount;
+    lods.assign(header.lods, header.lods + header.lodCount);
+    indexCount = lods.front().indexCount;
+    vertexBufferSize = header.vertexDataSize;
+    unoptimizedStats = header.unoptimizedStats;
+    optimizedStats = header.optimizedStats;
+    meshlets.assign(file.getMeshletData(), file.getMeshletData() + header.meshletCount);
+    auto stagingBuffer = std::make_shared<magma::SrcTransferBuffer>(cmdBuffer->getDevice(), header.vertexDataSize + header.indexDataSize);
+    magma::helpers::mapScoped<uint8_t>(stagingBuffer,
+        [&](uint8_t *data)
+        {   // Straight copy from mapped pages, no parsing or conversion
+            memcpy(data, file.getVertexData(), static_cast<size_t>(header.vertexDataSize));
+            memcpy(data + header.vertexDataSize, file.getIndexData(), static_cast<size_t>(header.indexDataSize));
+        });
+    createBuffers(std::move(stagingBuffer), std::move(cmdBuffer));
+}
+
+void BezierPatchMesh::createBuffers(std::shared_ptr<magma::SrcTransferBuffer> stagingBuffer,
+    std::shared_ptr<magma::CommandBuffer> cmdBuffer)
+{
+    vertexBuffer = std::make_shared<magma::VertexBuffer>(cmdBuffer, stagingBuffer, nullptr,
+        vertexBufferSize, 0);
+    vertexBuffer->setVertexCount(vertexCount);
+    indexBuffer = std::make_shared<magma::IndexBuffer>(std::move(cmdBuffer), std::move(stagingBuffer), VK_INDEX_TYPE_UINT32, nullptr,
+        totalIndexCount * sizeof(uint32_t), vertexBufferSize);
+}
+
+uint64_t BezierPatchMesh::computeKey(const uint32_t patches[][16], const float controlPoints[][3], bool optimize,
+    uint32_t lodCount, bool buildMeshlets) const noexcept
+{
+    uint64_t key = utilities::hashFnv1a(patches, sizeof(uint32_t) * 16 * numPatches);
+    for (uint32_t i = 0; i < numPatches; ++i)
+    {   // Number of control points is unknown, so hash only referenced ones
+        for (int j = 0; j < 16; ++j)
+            key = utilities::hashFnv1a(controlPoints[patches[i][j] - 1], sizeof(float) * 3, key);
+    }
+    const uint32_t parameters[] = {subdivisionDegree, optimize, quantize, lodCount, buildMeshlets};
+    return utilities::hashFnv1a(parameters, sizeof(parameters), key);
+}
+
+mesh::FileHeader BezierPatchMesh::getFileHeader() const noexcept
+{
+    mesh::FileHeader header = {};
+    header.key = cacheKey;
+    header.vertexCount = vertexCount;
+    header.indexCount = totalIndexCount;
+    header.lodCount = getLodCount();
+    std::copy(lods.begin(), lods.end(), header.lods);
+    header.meshletCount = static_cast<uint32_t>(meshlets.size());
+    header.attributeCount = 3;
+    if (quantize)
+    {
+        header.vertexStride = sizeof(QuantizedVertex);
+        header.attributes[0] = {0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(QuantizedVertex, position)};
+        header.attributes[1] = {1, VK_FORMAT_A2B10G10R10_UNORM_PACK32, offsetof(QuantizedVertex, normal)};
+        header.attributes[2] = {2, VK_FORMAT_R16G16_SFLOAT, offsetof(QuantizedVertex, texCoord)};
+    }
+    else
+    {
+        header.vertexStride = sizeof(Vertex);
+        header.attributes[0] = {0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, position)};
+        header.attributes[1] = {1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(Vertex, normal)};
+        header.attributes[2] = {2, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, texCoord)};
+    }
+    memcpy(header.transform, &dequantization, sizeof(header.transform));
+    header.unoptimizedStats = unoptimizedStats;
+    header.optimizedStats = optimizedStats;
+    return header;
+}
+
+void BezierPatchMesh::saveCache(const void *vertexData, const uint32_t *indexData) const
+{
+    mesh::saveCache(cacheFilename, getFileHeader(), vertexData, indexData, meshlets.data());
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include "magma/magma.h"
+#include "rapid/rapid.h"
+#include "meshOptimizer.h"
+#include "meshCache.h"
+
+class ThreadPool;
+
+/* Triangle mesh tessellated from bicubic Bezier patches on CPU.
+   Control point indices are 1-based, as in original Newell's teapot dataset.
+   Patches are evaluated four samples at once using SSE, one patch per task
+   if thread pool is provided. Without optimization, vertices and indices
+   are written directly into mapped staging memory (unless mesh is cached);
+   otherwise index order is optimized for vertex cache and overdraw before upload.
+   Quantized mesh stores positions as 16-bit relative to bounding box,
+   normals as 10:10:10:2 UNORM and texture coordinates as half floats;
+   dequantization matrix should be applied before world transform,
+   and vertex shader should decode normal as n * 2 - 1.
+   If cache directory is specified, generated mesh is saved there and
+   subsequent runs copy it from memory-mapped file instead.
+   Coarser levels of detail are simplified from the full tessellation
+   in parallel; they share vertex buffer and follow each other in index buffer.
+   If meshlets are requested, triangles of the most detailed level are
+   grouped into clusters for culling on GPU, see meshlets.h. */
+class BezierPatchMesh
+{
+public:
+    struct Vertex
+    {
+        rapid::float3 position;
+        rapid::float3 normal;
+        rapid::float2 texCoord;
+    };
+
+    struct QuantizedVertex
+    {
+        int16_t position[4]; // w = 1
+        uint32_t normal;
+        uint16_t texCoord[2];
+    };
+
+    struct Options
+    {
+        bool optimize = false;
+        bool quantize = false;
+        ThreadPool *threadPool = nullptr;
+        std::string cacheDirectory; // Mesh isn't cached if empty
+        uint32_t lodCount = 1;
+        bool buildMeshlets = false;
+    };
+
+    explicit BezierPatchMesh(const uint32_t patches[][16],
+        uint32_t numPatches,
+        const float controlPoints[][3],
+        uint32_t subdivisionDegree,
+        std::shared_ptr<magma::CommandBuffer> cmdBuffer,
+        const Options& options);
+    const magma::VertexInputState& getVertexInput() const noexcept;
+    const rapid::matrix& getDequantizationMatrix() const noexcept { return dequantization; }
+    bool quantized() const noexcept { return quantize; }
+    // Conservative, encloses bounding box of control points
+    rapid::float4 getBoundingSphere() const noexcept;
+    uint32_t getVertexCount() const noexcept { return vertexCount; }
+    // Index count of the most detailed level
+    uint32_t getIndexCount() const noexcept { return indexCount; }
+    uint32_t getLodCount() const noexcept { return static_cast<uint32_t>(lods.size()); }
+    const std::vector<mesh::LevelOfDetail>& getLods() const noexcept { return lods; }
+    // Cover the most detailed level, empty if not requested
+    const std::vector<mesh::Meshlet>& getMeshlets() const noexcept { return meshlets; }
+    VkDeviceSize getVertexBufferSize() const noexcept { return vertexBufferSize; }
+    // Time spent on CPU evaluation of patches, excluding optimization and upload
+    float getTessellationTime() const noexcept { return tessellationTime; }
+    // Time from start of construction to uploaded buffers
+    float getSetupTime() const noexcept { return setupTime; }
+    bool loadedFromCache() const noexcept { return cached; }
+    // Vertex cache efficiency in generator's order and after optimization (only for optimized mesh)
+    const mesh::CacheStatistics& getUnoptimizedStatistics() const noexcept { return unoptimizedStats; }
+    const mesh::CacheStatistics& getOptimizedStatistics() const noexcept { return optimizedStats; }
+    void bind(std::shared_ptr<magma::CommandBuffer> cmdBuffer) const;
+    void draw(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t lod = 0) const;
+    // Mesh should be bound before
+    void drawInstanced(std::shared_ptr<magma::CommandBuffer> cmdBuffer, uint32_t instanceCount, uint32_t firstInstance = 0,
+        uint32_t lod = 0) const;
+
+private:
+    template<typename VertexType>
+    void tessellate(const uint32_t patches[][16], const float controlPoints[][3],
+        VertexType *vertices, uint32_t *indices, ThreadPool *threadPool) const;
+    void generateLods(std::vector<uint32_t>& indices, const std::vector<Vertex>& vertices,
+        uint32_t lodCount, bool optimize, ThreadPool *threadPool);
+    void upload(const uint32_t patches[][16], const float controlPoints[][3],
+        std::shared_ptr<magma::CommandBuffer> cmdBuffer, ThreadPool *threadPool);
+    void upload(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+        std::shared_ptr<magma::CommandBuffer> cmdBuffer);
+    void upload(const mesh::MappedFile& file, std::shared_ptr<magma::CommandBuffer> cmdBuffer);
+    void createBuffers(std::shared_ptr<magma::SrcTransferBuffer> stagingBuffer,
+        std::shared_ptr<magma::CommandBuffer> cmdBuffer);
+    uint64_t computeKey(const uint32_t patches[][16], const float controlPoints[][3], bool optimize, uint32_t lodCount,
+        bool buildMeshlets) const noexcept;
+    mesh::FileHeader getFileHeader() const noexcept;
+    void saveCache(const void *vertexData, const uint32_t *indexData) const;
+
+    const uint32_t numPatches;
+    const uint32_t subdivisionDegree;
+    const bool quantize;
+    const magma::VertexInputStructure<Vertex> vertexInput;
+    std::unique_ptr<magma::VertexInputState> quantizedVertexInput;
+    float center[3];
+    float invHalfExtent[3];
+    rapid::matrix dequantization;
+    std::vector<float> basis; // Bernstein polynomials and their derivatives for each sample
+    std::shared_ptr<magma::VertexBuffer> vertexBuffer;
+    std::shared_ptr<magma::IndexBuffer> indexBuffer;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t totalIndexCount;
+    std::vector<mesh::LevelOfDetail> lods;
+    std::vector<mesh::Meshlet> meshlets;
+    VkDeviceSize vertexBufferSize;
+    float tessellationTime;
+    float setupTime;
+    bool cached;
+    uint64_t cacheKey;
+    std::string cacheFilename;
+    mesh::CacheStatistics unoptimizedStats;
+    mesh::CacheStatistics optimizedStats;
+};
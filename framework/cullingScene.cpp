@@ -0,0 +1,426 @@
+#include <algorithm>
+#include <smmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include "cullingScene.h"
+#include "threadPool.h"
+
+namespace
+{
+constexpr uint32_t LeafBit = 0x80000000;
+constexpr uint32_t LeafSize = 8; // Smaller ranges are tested object by object
+constexpr uint32_t MaxDepth = 128; // Depth of radix tree is limited by key length
+
+enum class Visibility
+{
+    Outside, Intersect, Inside
+};
+
+inline uint32_t countLeadingZeros(uint64_t x) noexcept
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63 - index;
+#else
+    return __builtin_clzll(x);
+#endif
+}
+
+// Inserts two zero bits after each of 10 low bits
+inline uint32_t expandBits(uint32_t v) noexcept
+{
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+inline uint32_t quantize(float x) noexcept
+{
+    return static_cast<uint32_t>(std::min(std::max(x * 1024.f, 0.f), 1023.f));
+}
+
+void parallelFor(ThreadPool *threadPool, uint32_t count, const std::function<void(uint32_t first, uint32_t last)>& func)
+{
+    if (threadPool)
+        threadPool->parallelFor(count, func);
+    else
+        func(0, count);
+}
+} // namespace
+
+/* Planes are extracted from columns of view-projection matrix
+   (Gribb-Hartmann), normals point inside of the frustum. */
+struct CullingScene::Frustum
+{
+    float planes[6][4];
+    // Planes 0-3 and 4-5 (last one repeated) in SoA layout for node tests
+    __m128 nx[2], ny[2], nz[2], d[2];
+    __m128 ax[2], ay[2], az[2];
+
+    explicit Frustum(const rapid::matrix& viewProj) noexcept
+    {
+        __m128 c0 = viewProj.r[0], c1 = viewProj.r[1], c2 = viewProj.r[2], c3 = viewProj.r[3];
+        _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+        const __m128 p[6] = {
+            _mm_add_ps(c3, c0), _mm_sub_ps(c3, c0),
+            _mm_add_ps(c3, c1), _mm_sub_ps(c3, c1),
+            c2, // Vulkan depth range is [0, 1]
+            _mm_sub_ps(c3, c2)
+        };
+        for (int i = 0; i < 6; ++i)
+        {
+            const __m128 length = _mm_sqrt_ps(_mm_dp_ps(p[i], p[i], 0x7F));
+            _mm_storeu_ps(planes[i], _mm_div_ps(p[i], length));
+        }
+        const __m128 signMask = _mm_set1_ps(-0.f);
+        for (int k = 0; k < 2; ++k)
+        {
+            const float *p0 = planes[k * 4];
+            const float *p1 = planes[k * 4 + 1];
+            const float *p2 = planes[std::min(k * 4 + 2, 5)];
+            const float *p3 = planes[std::min(k * 4 + 3, 5)];
+            nx[k] = _mm_setr_ps(p0[0], p1[0], p2[0], p3[0]);
+            ny[k] = _mm_setr_ps(p0[1], p1[1], p2[1], p3[1]);
+            nz[k] = _mm_setr_ps(p0[2], p1[2], p2[2], p3[2]);
+            d[k] = _mm_setr_ps(p0[3], p1[3], p2[3], p3[3]);
+            ax[k] = _mm_andnot_ps(signMask, nx[k]);
+            ay[k] = _mm_andnot_ps(signMask, ny[k]);
+            az[k] = _mm_andnot_ps(signMask, nz[k]);
+        }
+    }
+
+    Visibility test(const float center[3], const float extent[3]) const noexcept
+    {
+        const __m128 cx = _mm_set1_ps(center[0]), cy = _mm_set1_ps(center[1]), cz = _mm_set1_ps(center[2]);
+        const __m128 ex = _mm_set1_ps(extent[0]), ey = _mm_set1_ps(extent[1]), ez = _mm_set1_ps(extent[2]);
+        const __m128 zero = _mm_setzero_ps();
+        int intersect = 0;
+        for (int k = 0; k < 2; ++k)
+        {   // Signed distance of box center and projected radius of box
+            const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[k], cx), _mm_mul_ps(ny[k], cy)),
+                _mm_add_ps(_mm_mul_ps(nz[k], cz), d[k]));
+            const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[k], ex), _mm_mul_ps(ay[k], ey)),
+                _mm_mul_ps(az[k], ez));
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), zero)))
+                return Visibility::Outside;
+            intersect |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, radius), zero));
+        }
+        return intersect ? Visibility::Intersect : Visibility::Inside;
+    }
+};
+
+void CullingScene::reserve(uint32_t count)
+{
+    for (auto *bounds : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ})
+        bounds->reserve(count);
+}
+
+void CullingScene::clear() noexcept
+{
+    for (auto *bounds : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ})
+        bounds->clear();
+    nodes.clear();
+    objectIndices.clear();
+}
+
+void CullingScene::addObject(const float boxMin[3], const float boxMax[3])
+{
+    minX.push_back(boxMin[0]); minY.push_back(boxMin[1]); minZ.push_back(boxMin[2]);
+    maxX.push_back(boxMax[0]); maxY.push_back(boxMax[1]); maxZ.push_back(boxMax[2]);
+}
+
+void CullingScene::build(ThreadPool *threadPool /* nullptr */)
+{
+    const uint32_t count = getObjectCount();
+    nodes.clear();
+    if (!count)
+        return;
+    sortByMortonCode(threadPool);
+    // Sorted boxes, padding allows to load four objects at any position
+    for (auto *array : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+        array->assign(count + 3, 0.f);
+    objectIndices.resize(count);
+    parallelFor(threadPool, count,
+        [this](uint32_t first, uint32_t last)
+        {
+            for (uint32_t i = first; i < last; ++i)
+            {
+                const uint32_t j = static_cast<uint32_t>(keys[i]);
+                objectIndices[i] = j;
+                centerX[i] = (minX[j] + maxX[j]) * .5f;
+                centerY[i] = (minY[j] + maxY[j]) * .5f;
+                centerZ[i] = (minZ[j] + maxZ[j]) * .5f;
+                extentX[i] = (maxX[j] - minX[j]) * .5f;
+                extentY[i] = (maxY[j] - minY[j]) * .5f;
+                extentZ[i] = (maxZ[j] - minZ[j]) * .5f;
+            }
+        });
+    if (count < 2)
+        return;
+    // Every internal node is found independently from sorted keys
+    nodes.resize(count - 1);
+    parents.resize(2 * count - 1);
+    parallelFor(threadPool, count - 1,
+        [this](uint32_t first, uint32_t last)
+        {
+            for (uint32_t i = first; i < last; ++i)
+                buildNode(i);
+        });
+    // Bounds are propagated from leaves, second visitor of node merges its children
+    std::unique_ptr<std::atomic<uint32_t>[]> visits(new std::atomic<uint32_t>[count - 1]);
+    for (uint32_t i = 0; i < count - 1; ++i)
+        visits[i].store(0, std::memory_order_relaxed);
+    std::atomic<uint32_t> *visitCounters = visits.get();
+    parallelFor(threadPool, count,
+        [this, visitCounters](uint32_t first, uint32_t last)
+        {
+            for (uint32_t i = first; i < last; ++i)
+                computeBounds(i, visitCounters);
+        });
+}
+
+void CullingScene::sortByMortonCode(ThreadPool *threadPool)
+{
+    const uint32_t count = getObjectCount();
+    float sceneMin[3] = {minX[0] + maxX[0], minY[0] + maxY[0], minZ[0] + maxZ[0]};
+    float sceneMax[3] = {sceneMin[0], sceneMin[1], sceneMin[2]};
+    for (uint32_t i = 1; i < count; ++i)
+    {   // Doubled centroids
+        const float c[3] = {minX[i] + maxX[i], minY[i] + maxY[i], minZ[i] + maxZ[i]};
+        for (int k = 0; k < 3; ++k)
+        {
+            sceneMin[k] = std::min(sceneMin[k], c[k]);
+            sceneMax[k] = std::max(sceneMax[k], c[k]);
+        }
+    }
+    float scale[3];
+    for (int k = 0; k < 3; ++k)
+        scale[k] = (sceneMax[k] > sceneMin[k]) ? 1.f/(sceneMax[k] - sceneMin[k]) : 0.f;
+    keys.resize(count);
+    parallelFor(threadPool, count,
+        [&](uint32_t first, uint32_t last)
+        {
+            for (uint32_t i = first; i < last; ++i)
+            {
+                const uint32_t x = quantize((minX[i] + maxX[i] - sceneMin[0]) * scale[0]);
+                const uint32_t y = quantize((minY[i] + maxY[i] - sceneMin[1]) * scale[1]);
+                const uint32_t z = quantize((minZ[i] + maxZ[i] - sceneMin[2]) * scale[2]);
+                const uint64_t code = (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+                // Object index makes keys unique, which is required by radix tree
+                keys[i] = (code << 32) | i;
+            }
+        });
+    // LSD radix sort of 30-bit codes, stable passes keep indices in ascending order
+    constexpr uint32_t radixBits = 10;
+    constexpr uint32_t bucketCount = 1 << radixBits;
+    std::vector<uint64_t> sorted(count);
+    std::vector<uint32_t> offsets(bucketCount);
+    for (uint32_t shift = 32; shift < 62; shift += radixBits)
+    {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (uint64_t key : keys)
+            ++offsets[(key >> shift) & (bucketCount - 1)];
+        uint32_t sum = 0;
+        for (uint32_t& offset : offsets)
+        {
+            const uint32_t bucketSize = offset;
+            offset = sum;
+            sum += bucketSize;
+        }
+        for (uint64_t key : keys)
+            sorted[offsets[(key >> shift) & (bucketCount - 1)]++] = key;
+        keys.swap(sorted);
+    }
+}
+
+void CullingScene::buildNode(uint32_t index) noexcept
+{   // Karras, "Maximizing Parallelism in the Construction of BVHs, Octrees, and k-d Trees"
+    const int count = static_cast<int>(keys.size());
+    const int i = static_cast<int>(index);
+    auto delta = [this, count, i](int j) -> int
+    {   // Length of common prefix
+        if (j < 0 || j >= count)
+            return -1;
+        return countLeadingZeros(keys[i] ^ keys[j]);
+    };
+    // Direction of range
+    const int d = (delta(i + 1) - delta(i - 1)) > 0 ? 1 : -1;
+    const int deltaMin = delta(i - d);
+    int lengthMax = 2;
+    while (delta(i + lengthMax * d) > deltaMin)
+        lengthMax *= 2;
+    int length = 0;
+    for (int t = lengthMax/2; t >= 1; t /= 2)
+    {
+        if (delta(i + (length + t) * d) > deltaMin)
+            length += t;
+    }
+    const int j = i + length * d;
+    // Binary search for split position
+    const int deltaNode = delta(j);
+    int split = 0;
+    int t = length;
+    do
+    {
+        t = (t + 1)/2;
+        if (delta(i + (split + t) * d) > deltaNode)
+            split += t;
+    } while (t > 1);
+    const uint32_t gamma = static_cast<uint32_t>(i + split * d + std::min(d, 0));
+    Node& node = nodes[index];
+    node.first = static_cast<uint32_t>(std::min(i, j));
+    node.last = static_cast<uint32_t>(std::max(i, j));
+    const uint32_t internalCount = static_cast<uint32_t>(count - 1);
+    if (node.first == gamma)
+    {
+        node.left = gamma | LeafBit;
+        parents[internalCount + gamma] = index;
+    }
+    else
+    {
+        node.left = gamma;
+        parents[gamma] = index;
+    }
+    if (node.last == gamma + 1)
+    {
+        node.right = (gamma + 1) | LeafBit;
+        parents[internalCount + gamma + 1] = index;
+    }
+    else
+    {
+        node.right = gamma + 1;
+        parents[gamma + 1] = index;
+    }
+}
+
+void CullingScene::computeBounds(uint32_t leaf, std::atomic<uint32_t> *visits) noexcept
+{
+    auto getBounds = [this](uint32_t child, float boxMin[3], float boxMax[3])
+    {
+        if (child & LeafBit)
+        {
+            const uint32_t i = child & ~LeafBit;
+            boxMin[0] = centerX[i] - extentX[i]; boxMax[0] = centerX[i] + extentX[i];
+            boxMin[1] = centerY[i] - extentY[i]; boxMax[1] = centerY[i] + extentY[i];
+            boxMin[2] = centerZ[i] - extentZ[i]; boxMax[2] = centerZ[i] + extentZ[i];
+        }
+        else
+        {
+            const Node& node = nodes[child];
+            for (int k = 0; k < 3; ++k)
+            {
+                boxMin[k] = node.center[k] - node.extent[k];
+                boxMax[k] = node.center[k] + node.extent[k];
+            }
+        }
+    };
+    const uint32_t internalCount = static_cast<uint32_t>(nodes.size());
+    uint32_t parent = parents[internalCount + leaf];
+    while (true)
+    {   // First visitor leaves, sequentially consistent increment makes bounds of sibling visible
+        if (visits[parent].fetch_add(1) == 0)
+            return;
+        Node& node = nodes[parent];
+        float leftMin[3], leftMax[3], rightMin[3], rightMax[3];
+        getBounds(node.left, leftMin, leftMax);
+        getBounds(node.right, rightMin, rightMax);
+        for (int k = 0; k < 3; ++k)
+        {
+            const float boxMin = std::min(leftMin[k], rightMin[k]);
+            const float boxMax = std::max(leftMax[k], rightMax[k]);
+            node.center[k] = (boxMin + boxMax) * .5f;
+            node.extent[k] = (boxMax - boxMin) * .5f;
+        }
+        if (0 == parent)
+            return;
+        parent = parents[parent];
+    }
+}
+
+void CullingScene::cull(const rapid::matrix& viewProj, std::vector<uint32_t>& visibleObjects,
+    Statistics *statistics /* nullptr */) const
+{
+    visibleObjects.clear();
+    const uint32_t count = getObjectCount();
+    if (!count || objectIndices.size() != count)
+        return;
+    const Frustum frustum(viewProj);
+    uint32_t nodesVisited = 0;
+    if (nodes.empty())
+        cullLeafRange(frustum, 0, count - 1, visibleObjects);
+    else
+    {
+        uint32_t stack[MaxDepth];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize)
+        {
+            const Node& node = nodes[stack[--stackSize]];
+            ++nodesVisited;
+            const Visibility visibility = frustum.test(node.center, node.extent);
+            if (Visibility::Outside == visibility)
+                continue;
+            if (Visibility::Inside == visibility)
+            {   // Whole subtree is contiguous range of sorted objects
+                visibleObjects.insert(visibleObjects.end(),
+                    objectIndices.begin() + node.first, objectIndices.begin() + node.last + 1);
+                continue;
+            }
+            if (node.last - node.first < LeafSize)
+            {
+                cullLeafRange(frustum, node.first, node.last, visibleObjects);
+                continue;
+            }
+            for (uint32_t child : {node.right, node.left})
+            {
+                if (child & LeafBit)
+                    cullLeafRange(frustum, child & ~LeafBit, child & ~LeafBit, visibleObjects);
+                else
+                    stack[stackSize++] = child;
+            }
+        }
+    }
+    if (statistics)
+    {
+        statistics->visibleCount = static_cast<uint32_t>(visibleObjects.size());
+        statistics->culledCount = count - statistics->visibleCount;
+        statistics->nodesVisited = nodesVisited;
+    }
+}
+
+void CullingScene::cullLeafRange(const Frustum& frustum, uint32_t first, uint32_t last,
+    std::vector<uint32_t>& visibleObjects) const
+{   // Four objects against one plane at a time
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 signMask = _mm_set1_ps(-0.f);
+    for (uint32_t i = first; i <= last; i += 4)
+    {
+        const __m128 cx = _mm_loadu_ps(&centerX[i]), cy = _mm_loadu_ps(&centerY[i]), cz = _mm_loadu_ps(&centerZ[i]);
+        const __m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (const float *plane : frustum.planes)
+        {
+            const __m128 nx = _mm_set1_ps(plane[0]), ny = _mm_set1_ps(plane[1]), nz = _mm_set1_ps(plane[2]);
+            const __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+                _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane[3])));
+            const __m128 radius = _mm_add_ps(_mm_add_ps(
+                _mm_mul_ps(_mm_andnot_ps(signMask, nx), ex),
+                _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)),
+                _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez));
+            visible = _mm_and_ps(visible, _mm_cmpge_ps(_mm_add_ps(dist, radius), zero));
+        }
+        const uint32_t remaining = last - i + 1;
+        int mask = _mm_movemask_ps(visible);
+        if (remaining < 4)
+            mask &= (1 << remaining) - 1;
+        for (uint32_t j = 0; mask; ++j, mask >>= 1)
+        {
+            if (mask & 1)
+                visibleObjects.push_back(objectIndices[i + j]);
+        }
+    }
+}
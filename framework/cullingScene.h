@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include "rapid/rapid.h"
+#include "utilities.h"
+
+class ThreadPool;
+
+/* Static set of axis-aligned bounding boxes for CPU-side visibility.
+   Boxes are kept as structure of arrays in Morton order, hierarchy
+   is a linear BVH (binary radix tree of Karras) where every node covers
+   contiguous range of objects, so that internal nodes are built
+   in parallel and fully visible subtrees are emitted without traversal.
+   Nodes and small leaf ranges are tested against frustum planes with SSE. */
+class CullingScene
+{
+public:
+    struct Statistics
+    {
+        uint32_t visibleCount = 0;
+        uint32_t culledCount = 0;
+        uint32_t nodesVisited = 0;
+    };
+
+    void reserve(uint32_t count);
+    void clear() noexcept;
+    void addObject(const float boxMin[3], const float boxMax[3]);
+    void build(ThreadPool *threadPool = nullptr);
+    // Returns indices of visible objects in order of Morton code
+    void cull(const rapid::matrix& viewProj, std::vector<uint32_t>& visibleObjects,
+        Statistics *statistics = nullptr) const;
+    uint32_t getObjectCount() const noexcept { return static_cast<uint32_t>(minX.size()); }
+    uint32_t getNodeCount() const noexcept { return static_cast<uint32_t>(nodes.size()); }
+
+private:
+    struct Node
+    {
+        float center[3];
+        uint32_t first;
+        float extent[3];
+        uint32_t last;
+        uint32_t left;
+        uint32_t right;
+    };
+
+    struct Frustum;
+
+    void sortByMortonCode(ThreadPool *threadPool);
+    void buildNode(uint32_t i) noexcept;
+    void computeBounds(uint32_t leaf, std::atomic<uint32_t> *visits) noexcept;
+    void cullLeafRange(const Frustum& frustum, uint32_t first, uint32_t last,
+        std::vector<uint32_t>& visibleObjects) const;
+
+    // Source boxes in order of insertion
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+    // Sorted boxes, padded to multiple of 4
+    aligned_vector<float> centerX, centerY, centerZ;
+    aligned_vector<float> extentX, extentY, extentZ;
+    std::vector<uint64_t> keys; // Morton code in high bits, object index in low bits
+    std::vector<uint32_t> objectIndices;
+    std::vector<Node> nodes;
+    std::vector<uint32_t> parents; // Internal nodes first, then leaves
+};
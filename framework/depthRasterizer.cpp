@@ -0,0 +1,304 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <smmintrin.h>
+#include "depthRasterizer.h"
+#include "threadPool.h"
+
+namespace
+{
+constexpr float MinArea = 1e-6f; // Degenerate triangles are skipped
+constexpr float MinW = 1e-5f;
+
+// Row vector convention, v * M
+inline void transformPoint(const rapid::matrix& m, float x, float y, float z, float clip[4]) noexcept
+{
+    __m128 v = _mm_mul_ps(_mm_set1_ps(x), m.r[0]);
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(y), m.r[1]));
+    v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(z), m.r[2]));
+    v = _mm_add_ps(v, m.r[3]);
+    _mm_storeu_ps(clip, v);
+}
+
+void parallelFor(ThreadPool *threadPool, uint32_t count, const std::function<void(uint32_t first, uint32_t last)>& func)
+{
+    if (threadPool)
+        threadPool->parallelFor(count, func);
+    else
+        func(0, count);
+}
+} // namespace
+
+DepthRasterizer::DepthRasterizer(uint32_t width, uint32_t height):
+    width(width),
+    height(height),
+    tileCountX(width/TileWidth),
+    tileCountY(height/TileHeight),
+    depth(width * height, 1.f),
+    bins(tileCountX * tileCountY)
+{
+    if (!width || !height || (width % TileWidth) || (height % TileHeight))
+        throw std::invalid_argument("depth buffer size should be multiple of tile size");
+}
+
+void DepthRasterizer::clear() noexcept
+{
+    std::fill(depth.begin(), depth.end(), 1.f);
+    triangles.clear();
+}
+
+void DepthRasterizer::addOccluder(const float *positions, uint32_t stride,
+    const uint16_t *indices, uint32_t indexCount, const rapid::matrix& worldViewProj)
+{
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(positions);
+    for (uint32_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        float clip[3][4];
+        for (int k = 0; k < 3; ++k)
+        {
+            const float *v = reinterpret_cast<const float *>(bytes + indices[i + k] * stride);
+            transformPoint(worldViewProj, v[0], v[1], v[2], clip[k]);
+        }
+        // Trivial reject if all vertices are outside of the same frustum plane
+        bool outside = false;
+        for (int axis = 0; axis < 2 && !outside; ++axis)
+        {
+            outside = (clip[0][axis] > clip[0][3] && clip[1][axis] > clip[1][3] && clip[2][axis] > clip[2][3]) ||
+                (clip[0][axis] < -clip[0][3] && clip[1][axis] < -clip[1][3] && clip[2][axis] < -clip[2][3]);
+        }
+        if (outside || (clip[0][2] < 0.f && clip[1][2] < 0.f && clip[2][2] < 0.f))
+            continue;
+        if (clip[0][2] < 0.f || clip[1][2] < 0.f || clip[2][2] < 0.f)
+            clipTriangle(clip);
+        else
+            setupTriangle(clip);
+    }
+}
+
+void DepthRasterizer::rasterize(ThreadPool *threadPool /* nullptr */)
+{
+    binTriangles();
+    parallelFor(threadPool, tileCountX * tileCountY,
+        [this](uint32_t first, uint32_t last)
+        {
+            for (uint32_t tile = first; tile < last; ++tile)
+                rasterizeTile(tile);
+        });
+}
+
+bool DepthRasterizer::testBox(const float boxMin[3], const float boxMax[3], const rapid::matrix& viewProj) const noexcept
+{
+    float m[4][4];
+    for (int i = 0; i < 4; ++i)
+        _mm_storeu_ps(m[i], viewProj.r[i]);
+    // Transform eight corners as two groups of four
+    const __m128 x = _mm_setr_ps(boxMin[0], boxMax[0], boxMin[0], boxMax[0]);
+    const __m128 y = _mm_setr_ps(boxMin[1], boxMin[1], boxMax[1], boxMax[1]);
+    __m128 minX = _mm_set1_ps(FLT_MAX), minY = minX, minZ = minX;
+    __m128 maxX = _mm_set1_ps(-FLT_MAX), maxY = maxX;
+    for (int k = 0; k < 2; ++k)
+    {
+        const __m128 z = _mm_set1_ps(k ? boxMax[2] : boxMin[2]);
+        __m128 clip[4];
+        for (int c = 0; c < 4; ++c)
+        {
+            clip[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(m[0][c])), _mm_mul_ps(y, _mm_set1_ps(m[1][c]))),
+                _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(m[2][c])), _mm_set1_ps(m[3][c])));
+        }
+        // Box that crosses plane of the eye is treated as visible
+        if (_mm_movemask_ps(_mm_cmple_ps(clip[3], _mm_set1_ps(MinW))))
+            return true;
+        const __m128 invW = _mm_div_ps(_mm_set1_ps(1.f), clip[3]);
+        const __m128 sx = _mm_mul_ps(clip[0], invW);
+        const __m128 sy = _mm_mul_ps(clip[1], invW);
+        minX = _mm_min_ps(minX, sx); maxX = _mm_max_ps(maxX, sx);
+        minY = _mm_min_ps(minY, sy); maxY = _mm_max_ps(maxY, sy);
+        minZ = _mm_min_ps(minZ, _mm_mul_ps(clip[2], invW));
+    }
+    float lo[3][4], hi[2][4];
+    _mm_storeu_ps(lo[0], minX); _mm_storeu_ps(lo[1], minY); _mm_storeu_ps(lo[2], minZ);
+    _mm_storeu_ps(hi[0], maxX); _mm_storeu_ps(hi[1], maxY);
+    const float ndcMinX = std::min(std::min(lo[0][0], lo[0][1]), std::min(lo[0][2], lo[0][3]));
+    const float ndcMinY = std::min(std::min(lo[1][0], lo[1][1]), std::min(lo[1][2], lo[1][3]));
+    const float nearestZ = std::min(std::min(lo[2][0], lo[2][1]), std::min(lo[2][2], lo[2][3]));
+    const float ndcMaxX = std::max(std::max(hi[0][0], hi[0][1]), std::max(hi[0][2], hi[0][3]));
+    const float ndcMaxY = std::max(std::max(hi[1][0], hi[1][1]), std::max(hi[1][2], hi[1][3]));
+    if (ndcMaxX < -1.f || ndcMinX > 1.f || ndcMaxY < -1.f || ndcMinY > 1.f || nearestZ > 1.f)
+        return false; // Out of frustum
+    // All pixels touched by screen rectangle
+    const int x0 = std::max(static_cast<int>(std::floor((ndcMinX * .5f + .5f) * width)), 0);
+    const int y0 = std::max(static_cast<int>(std::floor((ndcMinY * .5f + .5f) * height)), 0);
+    const int x1 = std::min(static_cast<int>(std::floor((ndcMaxX * .5f + .5f) * width)), static_cast<int>(width) - 1);
+    const int y1 = std::min(static_cast<int>(std::floor((ndcMaxY * .5f + .5f) * height)), static_cast<int>(height) - 1);
+    const __m128 z = _mm_set1_ps(nearestZ);
+    const __m128i lane = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i first = _mm_set1_epi32(x0 - 1), last = _mm_set1_epi32(x1 + 1);
+    for (int py = y0; py <= y1; ++py)
+    {
+        const float *row = depth.data() + py * width;
+        for (int px = x0 & ~3; px <= x1; px += 4)
+        {
+            const __m128i index = _mm_add_epi32(_mm_set1_epi32(px), lane);
+            const __m128 inside = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(index, first), _mm_cmplt_epi32(index, last)));
+            // Passes less or equal test against occluder
+            const __m128 pass = _mm_and_ps(_mm_cmple_ps(z, _mm_load_ps(row + px)), inside);
+            if (_mm_movemask_ps(pass))
+                return true;
+        }
+    }
+    return false;
+}
+
+void DepthRasterizer::setupTriangle(const float clip[3][4])
+{
+    Triangle tri;
+    for (int k = 0; k < 3; ++k)
+    {
+        const float invW = 1.f/clip[k][3];
+        tri.x[k] = (clip[k][0] * invW * .5f + .5f) * width;
+        tri.y[k] = (clip[k][1] * invW * .5f + .5f) * height;
+        tri.z[k] = clip[k][2] * invW;
+    }
+    const float area = (tri.x[1] - tri.x[0]) * (tri.y[2] - tri.y[0]) - (tri.x[2] - tri.x[0]) * (tri.y[1] - tri.y[0]);
+    if (std::fabs(area) < MinArea)
+        return;
+    if (area < 0.f)
+    {   // Both windings are rasterized with positive edge functions inside
+        std::swap(tri.x[1], tri.x[2]);
+        std::swap(tri.y[1], tri.y[2]);
+        std::swap(tri.z[1], tri.z[2]);
+    }
+    triangles.push_back(tri);
+}
+
+void DepthRasterizer::clipTriangle(const float clip[3][4])
+{   // Sutherland-Hodgman against near plane z = 0, gives at most four vertices
+    float polygon[4][4];
+    int count = 0;
+    for (int k = 0; k < 3; ++k)
+    {
+        const float *a = clip[k];
+        const float *b = clip[(k + 1) % 3];
+        if (a[2] >= 0.f)
+            std::copy(a, a + 4, polygon[count++]);
+        if ((a[2] >= 0.f) != (b[2] >= 0.f))
+        {
+            const float t = a[2]/(a[2] - b[2]);
+            for (int c = 0; c < 4; ++c)
+                polygon[count][c] = a[c] + (b[c] - a[c]) * t;
+            ++count;
+        }
+    }
+    for (int k = 1; k + 1 < count; ++k)
+    {
+        const float fan[3][4] = {
+            {polygon[0][0], polygon[0][1], polygon[0][2], polygon[0][3]},
+            {polygon[k][0], polygon[k][1], polygon[k][2], polygon[k][3]},
+            {polygon[k + 1][0], polygon[k + 1][1], polygon[k + 1][2], polygon[k + 1][3]}
+        };
+        setupTriangle(fan);
+    }
+}
+
+void DepthRasterizer::binTriangles()
+{
+    for (auto& bin : bins)
+        bin.clear();
+    stats.triangleCount = static_cast<uint32_t>(triangles.size());
+    stats.binnedCount = 0;
+    for (uint32_t i = 0; i < stats.triangleCount; ++i)
+    {   /* Bounding box of pixel centers is a conservative superset:
+           rasterizeTile() writes only pixels that are fully covered. */
+        const Triangle& tri = triangles[i];
+        const float minX = std::min(std::min(tri.x[0], tri.x[1]), tri.x[2]);
+        const float minY = std::min(std::min(tri.y[0], tri.y[1]), tri.y[2]);
+        const float maxX = std::max(std::max(tri.x[0], tri.x[1]), tri.x[2]);
+        const float maxY = std::max(std::max(tri.y[0], tri.y[1]), tri.y[2]);
+        const int x0 = std::max(static_cast<int>(std::ceil(minX - .5f)), 0);
+        const int y0 = std::max(static_cast<int>(std::ceil(minY - .5f)), 0);
+        const int x1 = std::min(static_cast<int>(std::floor(maxX - .5f)), static_cast<int>(width) - 1);
+        const int y1 = std::min(static_cast<int>(std::floor(maxY - .5f)), static_cast<int>(height) - 1);
+        if (x0 > x1 || y0 > y1)
+            continue;
+        for (int ty = y0/TileHeight; ty <= y1/static_cast<int>(TileHeight); ++ty)
+        {
+            for (int tx = x0/TileWidth; tx <= x1/static_cast<int>(TileWidth); ++tx)
+            {
+                bins[ty * tileCountX + tx].push_back(i);
+                ++stats.binnedCount;
+            }
+        }
+    }
+}
+
+void DepthRasterizer::rasterizeTile(uint32_t tile) noexcept
+{
+    const int tileX0 = (tile % tileCountX) * TileWidth;
+    const int tileY0 = (tile / tileCountX) * TileHeight;
+    for (uint32_t i : bins[tile])
+    {
+        const Triangle& tri = triangles[i];
+        // Edge functions E(x, y) = A * x + B * y + C are positive inside
+        float a[3], b[3], c[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            const int j = (k + 1) % 3;
+            a[k] = tri.y[k] - tri.y[j];
+            b[k] = tri.x[j] - tri.x[k];
+            c[k] = -(a[k] * tri.x[k] + b[k] * tri.y[k]);
+        }
+        // Edge opposite to vertex k is the one that starts after it
+        const float invArea = 1.f/(c[0] + c[1] + c[2]);
+        const float za = (a[1] * tri.z[0] + a[2] * tri.z[1] + a[0] * tri.z[2]) * invArea;
+        const float zb = (b[1] * tri.z[0] + b[2] * tri.z[1] + b[0] * tri.z[2]) * invArea;
+        // Farthest depth of plane over pixel instead of depth at its center, so that occluder is conservative
+        const float zc = (c[1] * tri.z[0] + c[2] * tri.z[1] + c[0] * tri.z[2]) * invArea + .5f * (std::fabs(za) + std::fabs(zb));
+        for (int k = 0; k < 3; ++k)
+        {   // Distance to edge in pixels, shrunk by half-pixel extent along edge normal,
+            // so that pixel passes at its center only if the whole pixel is inside
+            const float invLength = 1.f/std::sqrt(a[k] * a[k] + b[k] * b[k]);
+            a[k] *= invLength;
+            b[k] *= invLength;
+            c[k] = c[k] * invLength - .5f * (std::fabs(a[k]) + std::fabs(b[k]));
+        }
+        const float minX = std::min(std::min(tri.x[0], tri.x[1]), tri.x[2]);
+        const float minY = std::min(std::min(tri.y[0], tri.y[1]), tri.y[2]);
+        const float maxX = std::max(std::max(tri.x[0], tri.x[1]), tri.x[2]);
+        const float maxY = std::max(std::max(tri.y[0], tri.y[1]), tri.y[2]);
+        const int x0 = std::max(static_cast<int>(std::ceil(minX - .5f)), tileX0) & ~3;
+        const int y0 = std::max(static_cast<int>(std::ceil(minY - .5f)), tileY0);
+        const int x1 = std::min(static_cast<int>(std::floor(maxX - .5f)), tileX0 + static_cast<int>(TileWidth) - 1);
+        const int y1 = std::min(static_cast<int>(std::floor(maxY - .5f)), tileY0 + static_cast<int>(TileHeight) - 1);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 step = _mm_setr_ps(.5f, 1.5f, 2.5f, 3.5f);
+        __m128 stepE[3];
+        for (int k = 0; k < 3; ++k)
+            stepE[k] = _mm_set1_ps(a[k] * 4.f);
+        const __m128 stepZ = _mm_set1_ps(za * 4.f);
+        for (int py = y0; py <= y1; ++py)
+        {
+            const float cy = py + .5f;
+            const __m128 cx = _mm_add_ps(_mm_set1_ps(static_cast<float>(x0)), step);
+            __m128 e[3];
+            for (int k = 0; k < 3; ++k)
+                e[k] = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(a[k])), _mm_set1_ps(b[k] * cy + c[k]));
+            __m128 z = _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(za)), _mm_set1_ps(zb * cy + zc));
+            float *row = depth.data() + py * width;
+            for (int px = x0; px <= x1; px += 4)
+            {
+                const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)),
+                    _mm_cmpge_ps(e[2], zero));
+                if (_mm_movemask_ps(inside))
+                {
+                    const __m128 d = _mm_load_ps(row + px);
+                    _mm_store_ps(row + px, _mm_blendv_ps(d, _mm_min_ps(d, z), inside));
+                }
+                for (int k = 0; k < 3; ++k)
+                    e[k] = _mm_add_ps(e[k], stepE[k]);
+                z = _mm_add_ps(z, stepZ);
+            }
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "rapid/rapid.h"
+#include "utilities.h"
+
+class ThreadPool;
+
+/* Low resolution software depth buffer for CPU-side occlusion culling.
+   Occluder triangles are transformed and clipped against near plane,
+   binned into screen tiles and rasterized tile by tile in parallel,
+   four pixels at a time with SSE. Only pixels fully covered by triangle
+   are written, and each of them keeps the farthest depth of occluder
+   over its area, so that occludee is rejected only if its nearest depth
+   is behind of all pixels covered by its screen rectangle.
+   Depth is in Vulkan range [0, 1], less or equal test is assumed. */
+class DepthRasterizer
+{
+public:
+    constexpr static uint32_t TileWidth = 32;
+    constexpr static uint32_t TileHeight = 16;
+
+    struct Statistics
+    {
+        uint32_t triangleCount = 0; // After clipping
+        uint32_t binnedCount = 0; // Sum of triangles over tiles
+    };
+
+    // Width should be multiple of TileWidth, height should be multiple of TileHeight
+    explicit DepthRasterizer(uint32_t width, uint32_t height);
+    void clear() noexcept;
+    // Triangles are rasterized regardless of their winding
+    void addOccluder(const float *positions, uint32_t stride,
+        const uint16_t *indices, uint32_t indexCount,
+        const rapid::matrix& worldViewProj);
+    void rasterize(ThreadPool *threadPool = nullptr);
+    // Returns false if box is out of screen or behind of rasterized occluders
+    bool testBox(const float boxMin[3], const float boxMax[3], const rapid::matrix& viewProj) const noexcept;
+    uint32_t getWidth() const noexcept { return width; }
+    uint32_t getHeight() const noexcept { return height; }
+    const float *getDepth() const noexcept { return depth.data(); }
+    const Statistics& getStatistics() const noexcept { return stats; }
+
+private:
+    struct Triangle
+    {
+        float x[3], y[3];
+        float z[3];
+    };
+
+    void setupTriangle(const float clip[3][4]);
+    void clipTriangle(const float clip[3][4]);
+    void binTriangles();
+    void rasterizeTile(uint32_t tile) noexcept;
+
+    const uint32_t width;
+    const uint32_t height;
+    const uint32_t tileCountX;
+    const uint32_t tileCountY;
+    aligned_vector<float> depth; // Row-major, tiles are only units of work
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<uint32_t>> bins;
+    Statistics stats;
+};
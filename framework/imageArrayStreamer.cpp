@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <stdexcept>
+#include "imageArrayStreamer.h"
+
+ImageArrayStreamer::ImageArrayStreamer(std::shared_ptr<magma::Image2DArray> imageArray_,
+    std::shared_ptr<magma::CommandPool> cmdPool, uint32_t framesInFlight /* 2 */, uint32_t slotCount /* 2 */):
+    imageArray(std::move(imageArray_)),
+    layerCount(imageArray->getArrayLayers()/2),
+    framesInFlight(framesInFlight),
+    physicalLayers(layerCount),
+    retiredFrames(layerCount, 0),
+    slots(std::max(slotCount, 1U))
+{
+    if (imageArray->getArrayLayers() % 2)
+        throw std::invalid_argument("image array should have even number of layers");
+    // Initially front copy of each layer is in the first half of array
+    for (uint32_t layer = 0; layer < layerCount; ++layer)
+        physicalLayers[layer] = layer;
+    for (Slot& slot : slots)
+    {
+        slot.cmdBuffer = std::make_shared<magma::PrimaryCommandBuffer>(cmdPool);
+        slot.fence = std::make_shared<magma::Fence>(imageArray->getDevice());
+    }
+}
+
+bool ImageArrayStreamer::update()
+{
+    bool published = false;
+    for (Slot& slot : slots)
+    {
+        if (!slot.submitted || slot.fence->getStatus() != VK_SUCCESS)
+            continue;
+        // Copy has been completed, so updated layers can be swapped
+        for (uint32_t layer : slot.layers)
+        {
+            physicalLayers[layer] = (physicalLayers[layer] + layerCount) % (layerCount * 2);
+            retiredFrames[layer] = frameIndex;
+        }
+        slot.layers.clear();
+        slot.submitted = false;
+        published = true;
+    }
+    return published;
+}
+
+bool ImageArrayStreamer::canUpdate(uint32_t layer) const noexcept
+{
+    if (slots[recordingSlot].submitted)
+        return false;
+    for (const Slot& slot : slots)
+    {
+        if (std::find(slot.layers.begin(), slot.layers.end(), layer) != slot.layers.end())
+            return false;
+    }
+    return frameIndex >= retiredFrames[layer] + framesInFlight;
+}
+
+void ImageArrayStreamer::updateLayer(uint32_t layer, uint32_t baseMipLevel,
+    std::shared_ptr<magma::SrcTransferBuffer> buffer, const std::vector<magma::Image::Mip>& mipMaps)
+{
+    if (!canUpdate(layer))
+        throw std::runtime_error("back copy of the layer is in use");
+    Slot& slot = slots[recordingSlot];
+    std::shared_ptr<magma::CommandBuffer> cmdBuffer = slot.cmdBuffer;
+    if (slot.layers.empty())
+        cmdBuffer->begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    const uint32_t frontLayer = physicalLayers[layer];
+    const uint32_t backLayer = (frontLayer + layerCount) % (layerCount * 2);
+    const uint32_t mipLevels = imageArray->getMipLevels();
+    if (baseMipLevel >= mipLevels)
+        throw std::out_of_range("base mip level out of range");
+    const uint32_t levelCount = std::min(static_cast<uint32_t>(mipMaps.size()), mipLevels - baseMipLevel);
+    VkImageSubresourceRange backRange;
+    backRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    backRange.baseMipLevel = 0;
+    backRange.levelCount = mipLevels;
+    backRange.baseArrayLayer = backLayer;
+    backRange.layerCount = 1;
+    // Whole back layer is overwritten, so its previous contents are discarded.
+    // Only affected subresources change their layout, the rest of array stays sampled.
+    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        magma::ImageMemoryBarrier(imageArray,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            backRange));
+    std::vector<VkBufferImageCopy> regions;
+    regions.reserve(levelCount);
+    for (uint32_t i = 0; i < levelCount; ++i)
+    {
+        VkBufferImageCopy region;
+        region.bufferOffset = mipMaps[i].bufferOffset;
+        region.bufferRowLength = 0; // Tightly packed
+        region.bufferImageHeight = 0;
+        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.imageSubresource.mipLevel = baseMipLevel + i;
+        region.imageSubresource.baseArrayLayer = backLayer;
+        region.imageSubresource.layerCount = 1;
+        region.imageOffset = VkOffset3D{0, 0, 0};
+        region.imageExtent = mipMaps[i].extent;
+        regions.push_back(region);
+    }
+    cmdBuffer->copyBufferToImage(std::move(buffer), imageArray, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regions);
+    // Mips outside of updated range are copied from front layer, so that layer
+    // doesn't mix contents of different updates after swap
+    copyFrontMips(cmdBuffer, frontLayer, backLayer, 0, baseMipLevel);
+    copyFrontMips(cmdBuffer, frontLayer, backLayer, baseMipLevel + levelCount, mipLevels);
+    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        magma::ImageMemoryBarrier(imageArray,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            backRange));
+    slot.layers.push_back(layer);
+}
+
+void ImageArrayStreamer::copyFrontMips(std::shared_ptr<magma::CommandBuffer> cmdBuffer,
+    uint32_t frontLayer, uint32_t backLayer, uint32_t firstLevel, uint32_t lastLevel)
+{
+    if (firstLevel >= lastLevel)
+        return;
+    VkImageSubresourceRange frontRange;
+    frontRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    frontRange.baseMipLevel = firstLevel;
+    frontRange.levelCount = lastLevel - firstLevel;
+    frontRange.baseArrayLayer = frontLayer;
+    frontRange.layerCount = 1;
+    // Front layer may be sampled by frames in flight, which are submitted to the same queue before
+    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        magma::ImageMemoryBarrier(imageArray,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            frontRange));
+    const VkExtent3D extent = imageArray->getExtent();
+    for (uint32_t level = firstLevel; level < lastLevel; ++level)
+    {
+        VkImageCopy region;
+        region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region.srcSubresource.mipLevel = level;
+        region.srcSubresource.baseArrayLayer = frontLayer;
+        region.srcSubresource.layerCount = 1;
+        region.srcOffset = VkOffset3D{0, 0, 0};
+        region.dstSubresource = region.srcSubresource;
+        region.dstSubresource.baseArrayLayer = backLayer;
+        region.dstOffset = VkOffset3D{0, 0, 0};
+        region.extent.width = std::max(1U, extent.width >> level);
+        region.extent.height = std::max(1U, extent.height >> level);
+        region.extent.depth = 1;
+        cmdBuffer->copyImage(imageArray, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            imageArray, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, region);
+    }
+    cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        magma::ImageMemoryBarrier(imageArray,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            frontRange));
+}
+
+bool ImageArrayStreamer::flush(std::shared_ptr<magma::Queue> queue)
+{
+    Slot& slot = slots[recordingSlot];
+    if (slot.submitted || slot.layers.empty())
+        return false;
+    slot.cmdBuffer->end();
+    // Fence of free slot has been signaled by its previous submission, if any
+    slot.fence->reset();
+    queue->submit(slot.cmdBuffer, 0, nullptr, nullptr, slot.fence);
+    slot.submitted = true;
+    // Layers are published by update() when fence is signaled
+    recordingSlot = (recordingSlot + 1) % static_cast<uint32_t>(slots.size());
+    return true;
+}
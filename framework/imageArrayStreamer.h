@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include "magma/magma.h"
+
+/* Streams new contents into individual layers of 2D image array
+   without rebuilding it. Each logical layer is backed by two physical
+   layers: one is sampled by frames in flight while another one receives
+   an update. Shader should access physical layer through indirection
+   table, which is swapped when copy has been completed.
+   Copies are submitted without waiting for them: each submission occupies
+   a slot with its own command buffer and fence, which is polled once per
+   frame. Updated layers are published and slot is reused only after its
+   fence has been signaled. */
+class ImageArrayStreamer
+{
+public:
+    // Image array should have twice as many layers as there are logical layers
+    explicit ImageArrayStreamer(std::shared_ptr<magma::Image2DArray> imageArray,
+        std::shared_ptr<magma::CommandPool> cmdPool,
+        uint32_t framesInFlight = 2,
+        uint32_t slotCount = 2);
+    uint32_t getLayerCount() const noexcept { return layerCount; }
+    uint32_t getPhysicalLayer(uint32_t layer) const noexcept { return physicalLayers[layer]; }
+    const std::vector<uint32_t>& getPhysicalLayers() const noexcept { return physicalLayers; }
+    // Should be called once per frame
+    void advanceFrame() noexcept { ++frameIndex; }
+    // Should be called once per frame, publishes layers whose copies have been completed.
+    // Returns true if indirection table has changed.
+    bool update();
+    // Back copy may still be sampled by frames in flight or wait for its copy,
+    // or there may be no free slot to record copy
+    bool canUpdate(uint32_t layer) const noexcept;
+    // Records copy of mip range from staging buffer to back copy of the layer,
+    // the rest of mips is copied from front copy. Buffer offsets of mip maps are absolute.
+    void updateLayer(uint32_t layer, uint32_t baseMipLevel,
+        std::shared_ptr<magma::SrcTransferBuffer> buffer,
+        const std::vector<magma::Image::Mip>& mipMaps);
+    // Submits recorded copies without waiting, returns false if there was nothing to submit
+    bool flush(std::shared_ptr<magma::Queue> queue);
+
+private:
+    struct Slot
+    {
+        std::shared_ptr<magma::CommandBuffer> cmdBuffer;
+        std::shared_ptr<magma::Fence> fence;
+        std::vector<uint32_t> layers; // Recorded or submitted
+        bool submitted = false;
+    };
+
+    void copyFrontMips(std::shared_ptr<magma::CommandBuffer> cmdBuffer,
+        uint32_t frontLayer, uint32_t backLayer, uint32_t firstLevel, uint32_t lastLevel);
+
+    std::shared_ptr<magma::Image2DArray> imageArray;
+    const uint32_t layerCount;
+    const uint32_t framesInFlight;
+    uint64_t frameIndex = 0;
+    std::vector<uint32_t> physicalLayers;
+    std::vector<uint64_t> retiredFrames;
+    std::vector<Slot> slots;
+    uint32_t recordingSlot = 0;
+};
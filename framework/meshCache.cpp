@@ -0,0 +1,163 @@
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "meshCache.h"
+
+namespace mesh
+{
+constexpr uint32_t cacheMagic = 0x4853454D; // MESH
+constexpr uint32_t cacheVersion = 3;
+
+MappedFile::MappedFile(const std::string& filename):
+    data(nullptr),
+    size(0)
+{
+#ifdef _WIN32
+    file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (INVALID_HANDLE_VALUE == file)
+        throw std::runtime_error("failed to open file \"" + filename + "\"");
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    size = static_cast<size_t>(fileSize.QuadPart);
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping)
+        data = reinterpret_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!data)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("failed to map file \"" + filename + "\"");
+    }
+#else
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("failed to open file \"" + filename + "\"");
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !st.st_size)
+    {
+        close(fd);
+        throw std::runtime_error("failed to stat file \"" + filename + "\"");
+    }
+    size = static_cast<size_t>(st.st_size);
+    void *ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // Mapping keeps reference to the file
+    if (MAP_FAILED == ptr)
+        throw std::runtime_error("failed to map file \"" + filename + "\"");
+    // Whole file will be copied to staging buffer, so read ahead.
+    // Advice values are not flags, each one needs its own call
+    madvise(ptr, size, MADV_SEQUENTIAL);
+    madvise(ptr, size, MADV_WILLNEED);
+    data = reinterpret_cast<const uint8_t *>(ptr);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    UnmapViewOfFile(data);
+    CloseHandle(mapping);
+    CloseHandle(file);
+#else
+    munmap(const_cast<uint8_t *>(data), size);
+#endif
+}
+
+std::unique_ptr<MappedFile> loadCache(const std::string& filename, uint64_t key)
+{
+    std::unique_ptr<MappedFile> file;
+    try
+    {
+        file = std::make_unique<MappedFile>(filename);
+    }
+    catch (const std::runtime_error&)
+    {   // Not cached yet
+        return nullptr;
+    }
+    if (file->getSize() < sizeof(FileHeader))
+        return nullptr;
+    const FileHeader& header = file->getHeader();
+    if (header.magic != cacheMagic ||
+        header.version != cacheVersion ||
+        header.key != key ||
+        header.attributeCount > MaxVertexAttributes ||
+        !header.lodCount || header.lodCount > MaxLods)
+        return nullptr;
+    // Truncated file would cause access violation on read
+    if (header.vertexDataOffset + header.vertexDataSize > file->getSize() ||
+        header.indexDataOffset + header.indexDataSize > file->getSize() ||
+        header.vertexDataSize != static_cast<uint64_t>(header.vertexCount) * header.vertexStride ||
+        header.indexDataSize != header.indexCount * sizeof(uint32_t) ||
+        header.meshletDataOffset + header.meshletDataSize > file->getSize() ||
+        header.meshletDataSize != header.meshletCount * sizeof(Meshlet))
+        return nullptr;
+    // Index ranges are used for drawing as is, so out of bounds range would read garbage
+    for (uint32_t i = 0; i < header.lodCount; ++i)
+    {
+        const LevelOfDetail& lod = header.lods[i];
+        if (static_cast<uint64_t>(lod.firstIndex) + lod.indexCount > header.indexCount)
+            return nullptr;
+    }
+    // Meshlets cover the most detailed level
+    const uint64_t lodBegin = header.lods[0].firstIndex;
+    const uint64_t lodEnd = lodBegin + header.lods[0].indexCount;
+    const Meshlet *meshlets = file->getMeshletData();
+    for (uint32_t i = 0; i < header.meshletCount; ++i)
+    {
+        const Meshlet& meshlet = meshlets[i];
+        if (meshlet.firstIndex < lodBegin ||
+            static_cast<uint64_t>(meshlet.firstIndex) + meshlet.indexCount > lodEnd)
+            return nullptr;
+    }
+    return file;
+}
+
+bool saveCache(const std::string& filename, FileHeader header, const void *vertexData, const uint32_t *indexData,
+    const Meshlet *meshletData /* nullptr */)
+{
+    auto align = [](uint64_t offset) { return (offset + BlobAlignment - 1) & ~(BlobAlignment - 1); };
+    header.magic = cacheMagic;
+    header.version = cacheVersion;
+    header.vertexDataSize = static_cast<uint64_t>(header.vertexCount) * header.vertexStride;
+    header.indexDataSize = header.indexCount * sizeof(uint32_t);
+    header.vertexDataOffset = align(sizeof(FileHeader));
+    header.indexDataOffset = align(header.vertexDataOffset + header.vertexDataSize);
+    if (!meshletData)
+        header.meshletCount = 0;
+    header.meshletDataSize = header.meshletCount * sizeof(Meshlet);
+    header.meshletDataOffset = header.meshletCount ? align(header.indexDataOffset + header.indexDataSize) : 0;
+    return utilities::writeCacheFile(filename,
+        [&](std::ostream& file)
+        {
+            const std::vector<char> padding(BlobAlignment, 0);
+            file.write(reinterpret_cast<const char *>(&header), sizeof(FileHeader));
+            file.write(padding.data(), header.vertexDataOffset - sizeof(FileHeader));
+            file.write(reinterpret_cast<const char *>(vertexData), header.vertexDataSize);
+            file.write(padding.data(), header.indexDataOffset - (header.vertexDataOffset + header.vertexDataSize));
+            file.write(reinterpret_cast<const char *>(indexData), header.indexDataSize);
+            if (header.meshletDataSize)
+            {
+                file.write(padding.data(), header.meshletDataOffset - (header.indexDataOffset + header.indexDataSize));
+                file.write(reinterpret_cast<const char *>(meshletData), header.meshletDataSize);
+            }
+        });
+}
+
+void createDirectory(const std::string& path)
+{   // Fails silently if directory already exists
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+} // namespace mesh
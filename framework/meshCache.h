@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <memory>
+#include "utilities.h"
+#include "meshOptimizer.h"
+#include "meshSimplifier.h"
+#include "meshlets.h"
+
+/* Binary file format for generated meshes. Header describes vertex layout,
+   vertex and index data follow at aligned offsets, so that file can be
+   memory-mapped and copied to staging buffer without any parsing. */
+namespace mesh
+{
+    constexpr uint32_t MaxVertexAttributes = 8;
+    constexpr uint32_t MaxLods = 8;
+    constexpr uint64_t BlobAlignment = 256;
+
+    struct VertexAttribute
+    {
+        uint32_t location;
+        VkFormat format;
+        uint32_t offset;
+    };
+
+    struct FileHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key; // Hash of generator parameters, file is stale if it doesn't match
+        uint32_t vertexCount;
+        uint32_t indexCount; // All levels of detail
+        uint32_t vertexStride;
+        uint32_t attributeCount;
+        VertexAttribute attributes[MaxVertexAttributes];
+        float transform[16]; // Dequantization matrix
+        CacheStatistics unoptimizedStats;
+        CacheStatistics optimizedStats;
+        uint32_t lodCount;
+        LevelOfDetail lods[MaxLods];
+        uint32_t meshletCount; // Zero if meshlets weren't built
+        uint64_t vertexDataOffset;
+        uint64_t vertexDataSize;
+        uint64_t indexDataOffset;
+        uint64_t indexDataSize;
+        uint64_t meshletDataOffset;
+        uint64_t meshletDataSize;
+    };
+
+    // Read-only view of cache file, pages are loaded by OS on demand
+    class MappedFile
+    {
+    public:
+        explicit MappedFile(const std::string& filename);
+        ~MappedFile();
+        const FileHeader& getHeader() const noexcept { return *reinterpret_cast<const FileHeader *>(data); }
+        const void *getVertexData() const noexcept { return data + getHeader().vertexDataOffset; }
+        const uint32_t *getIndexData() const noexcept { return reinterpret_cast<const uint32_t *>(data + getHeader().indexDataOffset); }
+        const Meshlet *getMeshletData() const noexcept { return reinterpret_cast<const Meshlet *>(data + getHeader().meshletDataOffset); }
+        size_t getSize() const noexcept { return size; }
+
+    private:
+        const uint8_t *data;
+        size_t size;
+#ifdef _WIN32
+        void *file;
+        void *mapping;
+#endif
+    };
+
+    // Returns nullptr if file doesn't exist, is corrupted or has different key
+    std::unique_ptr<MappedFile> loadCache(const std::string& filename, uint64_t key);
+    // Header offsets and sizes are filled by function. Returns false if file couldn't be written, failure is reported
+    bool saveCache(const std::string& filename, FileHeader header, const void *vertexData, const uint32_t *indexData,
+        const Meshlet *meshletData = nullptr);
+    void createDirectory(const std::string& path);
+} // namespace mesh
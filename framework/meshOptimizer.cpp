@@ -0,0 +1,286 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "meshOptimizer.h"
+
+namespace mesh
+{
+namespace
+{
+constexpr uint32_t maxCacheSize = 32;
+constexpr float cacheDecayPower = 1.5f;
+constexpr float lastTriangleScore = .75f;
+constexpr float valenceBoostScale = 2.f;
+constexpr float valenceBoostPower = .5f;
+
+float vertexScore(int cachePosition, uint32_t remainingTriangles) noexcept
+{
+    if (!remainingTriangles)
+        return -1.f; // Vertex isn't used anymore
+    float score = 0.f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3) // Vertex was used by the last triangle
+            score = lastTriangleScore;
+        else
+        {
+            const float scale = 1.f/(maxCacheSize - 3);
+            score = powf(1.f - (cachePosition - 3) * scale, cacheDecayPower);
+        }
+    }
+    // Boost vertices with few triangles left, to finish them off
+    score += valenceBoostScale * powf(static_cast<float>(remainingTriangles), -valenceBoostPower);
+    return score;
+}
+
+inline const float *position(const float *positions, size_t stride, uint32_t index) noexcept
+{
+    return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(positions) + index * stride);
+}
+} // namespace
+
+CacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount,
+    uint32_t cacheSize /* 16 */)
+{
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    uint32_t time = cacheSize + 1, misses = 0, uniqueVertices = 0;
+    for (uint32_t index : indices)
+    {   // FIFO: vertex is in cache if it was inserted less than cacheSize misses ago
+        if (time - timestamps[index] > cacheSize)
+        {
+            timestamps[index] = time++;
+            ++misses;
+        }
+        if (!referenced[index])
+        {
+            referenced[index] = true;
+            ++uniqueVertices;
+        }
+    }
+    CacheStatistics stats;
+    const size_t triangleCount = indices.size()/3;
+    stats.acmr = triangleCount ? misses/static_cast<float>(triangleCount) : 0.f;
+    stats.atvr = uniqueVertices ? misses/static_cast<float>(uniqueVertices) : 0.f;
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount)
+{
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size()/3);
+    if (!triangleCount)
+        return;
+    // Build vertex-triangle adjacency
+    std::vector<uint32_t> remaining(vertexCount, 0);
+    for (uint32_t index : indices)
+        ++remaining[index];
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        for (uint32_t k = 0; k < 3; ++k)
+            adjacency[fill[indices[t * 3 + k]]++] = t;
+    }
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+    std::vector<float> triangleScores(triangleCount);
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        triangleScores[t] = vertexScores[indices[t * 3]] +
+            vertexScores[indices[t * 3 + 1]] +
+            vertexScores[indices[t * 3 + 2]];
+    }
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    uint32_t cache[maxCacheSize + 3];
+    uint32_t cacheSize = 0;
+    uint32_t scanCursor = 0;
+    int bestTriangle = -1;
+    for (uint32_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount)
+    {
+        if (bestTriangle < 0)
+        {   // No candidates in cache, take next triangle in input order
+            while (emitted[scanCursor])
+                ++scanCursor;
+            bestTriangle = static_cast<int>(scanCursor);
+        }
+        const uint32_t *tri = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = true;
+        result.insert(result.end(), tri, tri + 3);
+        // Remove triangle from adjacency of its vertices
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            const uint32_t v = tri[k];
+            uint32_t *first = &adjacency[adjacencyOffsets[v]];
+            uint32_t *last = first + remaining[v];
+            std::iter_swap(std::find(first, last, static_cast<uint32_t>(bestTriangle)), last - 1);
+            --remaining[v];
+        }
+        // Move triangle vertices to the front of LRU cache
+        uint32_t newCache[maxCacheSize + 3];
+        uint32_t newCacheSize = 0;
+        for (uint32_t k = 0; k < 3; ++k)
+            newCache[newCacheSize++] = tri[k];
+        for (uint32_t i = 0; i < cacheSize; ++i)
+        {
+            const uint32_t v = cache[i];
+            if (v != tri[0] && v != tri[1] && v != tri[2])
+                newCache[newCacheSize++] = v;
+        }
+        // Update scores of vertices in cache and of those that were evicted
+        for (uint32_t i = 0; i < newCacheSize; ++i)
+        {
+            const uint32_t v = newCache[i];
+            cachePositions[v] = (i < maxCacheSize) ? static_cast<int>(i) : -1;
+        }
+        for (uint32_t i = 0; i < newCacheSize; ++i)
+        {
+            const uint32_t v = newCache[i];
+            const float score = vertexScore(cachePositions[v], remaining[v]);
+            const float delta = score - vertexScores[v];
+            vertexScores[v] = score;
+            const uint32_t *adjacent = &adjacency[adjacencyOffsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; ++j)
+                triangleScores[adjacent[j]] += delta;
+        }
+        // Triangle may share several updated vertices, so pick the best one only when all its scores are final
+        bestTriangle = -1;
+        float bestScore = -1.f;
+        for (uint32_t i = 0; i < newCacheSize; ++i)
+        {
+            const uint32_t v = newCache[i];
+            const uint32_t *adjacent = &adjacency[adjacencyOffsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; ++j)
+            {
+                const uint32_t t = adjacent[j];
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore = triangleScores[t];
+                    bestTriangle = static_cast<int>(t);
+                }
+            }
+        }
+        cacheSize = std::min(newCacheSize, maxCacheSize);
+        memcpy(cache, newCache, cacheSize * sizeof(uint32_t));
+    }
+    indices.swap(result);
+}
+
+void optimizeOverdraw(std::vector<uint32_t>& indices, const float *positions, size_t positionStride,
+    uint32_t vertexCount, uint32_t cacheSize /* 16 */)
+{
+    const uint32_t triangleCount = static_cast<uint32_t>(indices.size()/3);
+    if (!triangleCount)
+        return;
+    // Cluster starts where triangle misses all its vertices in FIFO cache
+    std::vector<uint32_t> clusterStarts;
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        uint32_t misses = 0;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            const uint32_t v = indices[t * 3 + k];
+            if (time - timestamps[v] > cacheSize)
+            {
+                timestamps[v] = time++;
+                ++misses;
+            }
+        }
+        if (3 == misses || clusterStarts.empty())
+            clusterStarts.push_back(t);
+    }
+    clusterStarts.push_back(triangleCount);
+    // Mesh centroid
+    float meshCenter[3] = {0.f, 0.f, 0.f};
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        const float *p = position(positions, positionStride, v);
+        for (int i = 0; i < 3; ++i)
+            meshCenter[i] += p[i];
+    }
+    for (float& c : meshCenter)
+        c /= vertexCount;
+    // Sort key is how much cluster faces outwards from mesh center
+    const uint32_t clusterCount = static_cast<uint32_t>(clusterStarts.size() - 1);
+    std::vector<std::pair<float, uint32_t>> sortKeys(clusterCount);
+    for (uint32_t c = 0; c < clusterCount; ++c)
+    {
+        float center[3] = {0.f, 0.f, 0.f};
+        float normal[3] = {0.f, 0.f, 0.f};
+        float area = 0.f;
+        for (uint32_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t)
+        {
+            const float *p0 = position(positions, positionStride, indices[t * 3]);
+            const float *p1 = position(positions, positionStride, indices[t * 3 + 1]);
+            const float *p2 = position(positions, positionStride, indices[t * 3 + 2]);
+            const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            // Area-weighted normal
+            const float n[3] = {
+                e1[1] * e2[2] - e1[2] * e2[1],
+                e1[2] * e2[0] - e1[0] * e2[2],
+                e1[0] * e2[1] - e1[1] * e2[0]};
+            const float triangleArea = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int i = 0; i < 3; ++i)
+            {
+                normal[i] += n[i];
+                center[i] += (p0[i] + p1[i] + p2[i]) * triangleArea/3.f;
+            }
+            area += triangleArea;
+        }
+        float key = 0.f;
+        const float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (area > 0.f && length > 0.f)
+        {
+            for (int i = 0; i < 3; ++i)
+                key += (center[i]/area - meshCenter[i]) * normal[i]/length;
+        }
+        sortKeys[c] = std::make_pair(key, c);
+    }
+    std::stable_sort(sortKeys.begin(), sortKeys.end(),
+        [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b)
+        {
+            return a.first > b.first;
+        });
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (const auto& key : sortKeys)
+    {
+        const uint32_t c = key.second;
+        result.insert(result.end(),
+            indices.begin() + clusterStarts[c] * 3,
+            indices.begin() + clusterStarts[c + 1] * 3);
+    }
+    indices.swap(result);
+}
+
+uint32_t optimizeVertexFetch(std::vector<uint32_t>& indices, void *vertices, uint32_t vertexCount, size_t vertexSize)
+{
+    constexpr uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(vertexCount, unused);
+    uint32_t nextVertex = 0;
+    for (uint32_t& index : indices)
+    {
+        if (unused == remap[index])
+            remap[index] = nextVertex++;
+        index = remap[index];
+    }
+    std::vector<uint8_t> reordered(nextVertex * vertexSize);
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(vertices);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        if (remap[v] != unused)
+            memcpy(reordered.data() + remap[v] * vertexSize, src + v * vertexSize, vertexSize);
+    }
+    memcpy(vertices, reordered.data(), reordered.size());
+    return nextVertex;
+}
+} // namespace mesh
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Index and vertex reordering for better post-transform vertex cache
+   utilization, less overdraw and more coherent vertex fetch.
+   Should be applied to triangle lists before uploading them to index buffer.
+   Recommended order: vertex cache, overdraw, vertex fetch. */
+namespace mesh
+{
+    struct CacheStatistics
+    {
+        float acmr; // Average cache miss ratio (transformed vertices per triangle)
+        float atvr; // Average transform to vertex ratio (1.0 is optimal)
+    };
+
+    // Simulates FIFO cache of given size
+    CacheStatistics analyzeVertexCache(const std::vector<uint32_t>& indices,
+        uint32_t vertexCount,
+        uint32_t cacheSize = 16);
+    // Tom Forsyth's linear-speed vertex cache optimization
+    void optimizeVertexCache(std::vector<uint32_t>& indices,
+        uint32_t vertexCount);
+    /* Splits cache-optimized triangles into clusters at the points where
+       cache is flushed anyway, then sorts clusters so that outward-facing
+       ones are drawn first. See "Fast Triangle Reordering for Vertex Locality
+       and Reduced Overdraw" by Sander, Nehab and Barczak. */
+    void optimizeOverdraw(std::vector<uint32_t>& indices,
+        const float *positions,
+        size_t positionStride,
+        uint32_t vertexCount,
+        uint32_t cacheSize = 16);
+    // Reorders vertices in order of first use, returns number of referenced vertices
+    uint32_t optimizeVertexFetch(std::vector<uint32_t>& indices,
+        void *vertices,
+        uint32_t vertexCount,
+        size_t vertexSize);
+} // namespace mesh
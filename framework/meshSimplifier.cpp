@@ -0,0 +1,387 @@
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <iterator>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include "meshSimplifier.h"
+
+namespace mesh
+{
+namespace
+{
+constexpr double boundaryWeight = 10.;
+
+// Symmetric 4x4 matrix of plane equation products
+struct Quadric
+{
+    double a[10] = {};
+
+    void addPlane(double nx, double ny, double nz, double d, double weight) noexcept
+    {
+        const double p[4] = {nx, ny, nz, d};
+        int k = 0;
+        for (int i = 0; i < 4; ++i)
+            for (int j = i; j < 4; ++j)
+                a[k++] += p[i] * p[j] * weight;
+    }
+
+    void add(const Quadric& q) noexcept
+    {
+        for (int i = 0; i < 10; ++i)
+            a[i] += q.a[i];
+    }
+
+    double error(const float *v) const noexcept
+    {
+        const double x = v[0], y = v[1], z = v[2];
+        return a[0]*x*x + 2*a[1]*x*y + 2*a[2]*x*z + 2*a[3]*x + a[4]*y*y + 2*a[5]*y*z + 2*a[6]*y +
+            a[7]*z*z + 2*a[8]*z + a[9];
+    }
+};
+
+struct Collapse
+{
+    float cost;
+    uint32_t from, to;
+    uint32_t fromVersion, toVersion;
+
+    bool operator>(const Collapse& other) const noexcept { return cost > other.cost; }
+};
+
+struct PositionHash
+{
+    size_t operator()(const std::array<uint32_t, 3>& p) const noexcept
+    {
+        return (p[0] * 73856093u) ^ (p[1] * 19349663u) ^ (p[2] * 83492791u);
+    }
+};
+
+inline const float *position(const float *positions, size_t stride, uint32_t index) noexcept
+{
+    return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(positions) + index * stride);
+}
+
+inline void cross(const float a[3], const float b[3], float n[3]) noexcept
+{
+    n[0] = a[1] * b[2] - a[2] * b[1];
+    n[1] = a[2] * b[0] - a[0] * b[2];
+    n[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+inline void triangleNormal(const float *p0, const float *p1, const float *p2, float n[3]) noexcept
+{
+    const float e0[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    const float e1[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    cross(e0, e1, n);
+}
+} // namespace
+
+float simplify(std::vector<uint32_t>& indices, const float *positions, size_t positionStride,
+    uint32_t vertexCount, uint32_t targetIndexCount,
+    const float *attributes /* nullptr */, size_t attributeStride /* 0 */, uint32_t attributeCount /* 0 */)
+{
+    auto vertexPosition = [positions, positionStride](uint32_t v) { return position(positions, positionStride, v); };
+    auto sameAttributes = [attributes, attributeStride, attributeCount](uint32_t a, uint32_t b)
+    {
+        return !attributes || !memcmp(position(attributes, attributeStride, a),
+            position(attributes, attributeStride, b), sizeof(float) * attributeCount);
+    };
+    // Weld vertices with equal positions
+    std::vector<uint32_t> remap(vertexCount);
+    std::unordered_map<std::array<uint32_t, 3>, uint32_t, PositionHash> uniquePositions;
+    uniquePositions.reserve(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        std::array<uint32_t, 3> key;
+        memcpy(key.data(), vertexPosition(v), sizeof(float) * 3);
+        remap[v] = uniquePositions.emplace(key, v).first->second;
+    }
+    // Welded vertex keeps a chain of its copies with distinct attributes
+    constexpr uint32_t noCopy = ~0u;
+    std::vector<uint32_t> copies(vertexCount);
+    std::vector<uint32_t> nextCopy(vertexCount, noCopy);
+    for (uint32_t v = 0; v < vertexCount; ++v)
+    {
+        const uint32_t w = remap[v];
+        uint32_t copy = w;
+        while (copy != noCopy && !sameAttributes(copy, v))
+            copy = nextCopy[copy];
+        if (noCopy == copy)
+        {
+            nextCopy[v] = nextCopy[w];
+            nextCopy[w] = v;
+            copy = v;
+        }
+        copies[v] = copy;
+    }
+    std::vector<uint32_t> triangles;
+    std::vector<uint32_t> corners; // Copy of welded vertex referenced by triangle
+    triangles.reserve(indices.size());
+    corners.reserve(indices.size());
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {   // Poles of tessellated patches produce degenerate triangles
+        const uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+        if (a != b && b != c && c != a)
+        {
+            triangles.push_back(a);
+            triangles.push_back(b);
+            triangles.push_back(c);
+            for (size_t k = 0; k < 3; ++k)
+                corners.push_back(copies[indices[i + k]]);
+        }
+    }
+    uint32_t triangleCount = static_cast<uint32_t>(triangles.size()/3);
+    std::vector<std::vector<uint32_t>> vertexTriangles(vertexCount);
+    for (uint32_t t = 0; t < triangleCount; ++t)
+        for (int k = 0; k < 3; ++k)
+            vertexTriangles[triangles[t * 3 + k]].push_back(t);
+    // Each vertex accumulates planes of its triangles
+    std::vector<Quadric> quadrics(vertexCount);
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        const uint32_t *tri = &triangles[t * 3];
+        const float *p0 = vertexPosition(tri[0]);
+        float n[3];
+        triangleNormal(p0, vertexPosition(tri[1]), vertexPosition(tri[2]), n);
+        const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length < 1e-20f)
+            continue;
+        for (int k = 0; k < 3; ++k)
+            n[k] /= length;
+        const double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+        for (int k = 0; k < 3; ++k)
+            quadrics[tri[k]].addPlane(n[0], n[1], n[2], d, 1.);
+    }
+    // Open boundaries are preserved with planes perpendicular to boundary faces
+    std::unordered_map<uint64_t, uint32_t> edgeTriangles;
+    auto edgeKey = [](uint32_t a, uint32_t b) { return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b); };
+    for (uint32_t t = 0; t < triangleCount; ++t)
+        for (int k = 0; k < 3; ++k)
+            ++edgeTriangles[edgeKey(triangles[t * 3 + k], triangles[t * 3 + (k + 1) % 3])];
+    std::vector<bool> boundary(vertexCount, false);
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        const uint32_t *tri = &triangles[t * 3];
+        float n[3];
+        triangleNormal(vertexPosition(tri[0]), vertexPosition(tri[1]), vertexPosition(tri[2]), n);
+        for (int k = 0; k < 3; ++k)
+        {
+            const uint32_t a = tri[k], b = tri[(k + 1) % 3];
+            if (edgeTriangles[edgeKey(a, b)] != 1)
+                continue;
+            boundary[a] = boundary[b] = true;
+            const float *pa = vertexPosition(a), *pb = vertexPosition(b);
+            const float edge[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+            float m[3];
+            cross(edge, n, m);
+            const float length = sqrtf(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+            if (length < 1e-20f)
+                continue;
+            for (int i = 0; i < 3; ++i)
+                m[i] /= length;
+            const double d = -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]);
+            quadrics[a].addPlane(m[0], m[1], m[2], d, boundaryWeight);
+            quadrics[b].addPlane(m[0], m[1], m[2], d, boundaryWeight);
+        }
+    }
+    std::vector<bool> removed(vertexCount, false);
+    std::vector<bool> deadTriangles(triangleCount, false);
+    std::vector<uint32_t> versions(vertexCount, 0);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+    auto pushEdge = [&](uint32_t a, uint32_t b)
+    {   // Vertex stays in place, so collapse to the endpoint with smaller error
+        Quadric q = quadrics[a];
+        q.add(quadrics[b]);
+        const double errorA = q.error(vertexPosition(a));
+        const double errorB = q.error(vertexPosition(b));
+        if (errorA <= errorB)
+            heap.push({static_cast<float>(std::max(errorA, 0.)), b, a, versions[b], versions[a]});
+        else
+            heap.push({static_cast<float>(std::max(errorB, 0.)), a, b, versions[a], versions[b]});
+    };
+    for (uint32_t t = 0; t < triangleCount; ++t)
+    {
+        for (int k = 0; k < 3; ++k)
+        {
+            const uint32_t a = triangles[t * 3 + k], b = triangles[t * 3 + (k + 1) % 3];
+            if (a < b || edgeTriangles[edgeKey(a, b)] == 1)
+                pushEdge(a, b);
+        }
+    }
+    std::vector<uint32_t> fromNeighbours, toNeighbours;
+    std::vector<std::pair<uint32_t, uint32_t>> copyPairs;
+    auto findCopy = [&copyPairs](uint32_t fromCopy)
+    {
+        return std::find_if(copyPairs.begin(), copyPairs.end(),
+            [fromCopy](const std::pair<uint32_t, uint32_t>& pair) { return pair.first == fromCopy; });
+    };
+    auto cornerOf = [&triangles](uint32_t t, uint32_t v)
+    {
+        const uint32_t *tri = &triangles[t * 3];
+        return t * 3 + (tri[0] == v ? 0 : (tri[1] == v ? 1 : 2));
+    };
+    auto gatherNeighbours = [&](uint32_t v, std::vector<uint32_t>& neighbours)
+    {
+        neighbours.clear();
+        for (uint32_t t : vertexTriangles[v])
+        {
+            if (deadTriangles[t])
+                continue;
+            for (int k = 0; k < 3; ++k)
+                if (triangles[t * 3 + k] != v)
+                    neighbours.push_back(triangles[t * 3 + k]);
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    };
+    float maxError = 0.f;
+    while (triangleCount * 3 > targetIndexCount && !heap.empty())
+    {
+        const Collapse collapse = heap.top();
+        heap.pop();
+        const uint32_t from = collapse.from, to = collapse.to;
+        if (removed[from] || removed[to] ||
+            versions[from] != collapse.fromVersion ||
+            versions[to] != collapse.toVersion)
+            continue;
+        uint32_t sharedTriangles = 0;
+        for (uint32_t t : vertexTriangles[from])
+        {
+            if (deadTriangles[t])
+                continue;
+            const uint32_t *tri = &triangles[t * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to)
+                ++sharedTriangles;
+        }
+        if (!sharedTriangles)
+            continue; // Edge doesn't exist anymore
+        // Boundary vertex may only slide along the boundary
+        if (boundary[from] && (!boundary[to] || sharedTriangles != 1))
+            continue;
+        // Link condition: more than two common neighbours would pinch the surface
+        gatherNeighbours(from, fromNeighbours);
+        gatherNeighbours(to, toNeighbours);
+        std::vector<uint32_t> common;
+        std::set_intersection(fromNeighbours.begin(), fromNeighbours.end(),
+            toNeighbours.begin(), toNeighbours.end(), std::back_inserter(common));
+        if (common.size() > sharedTriangles)
+            continue;
+        // Reject collapse that flips any of remaining triangles
+        bool flipped = false;
+        for (uint32_t t : vertexTriangles[from])
+        {
+            if (deadTriangles[t])
+                continue;
+            const uint32_t *tri = &triangles[t * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to)
+                continue;
+            const float *p[3], *q[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                p[k] = vertexPosition(tri[k]);
+                q[k] = vertexPosition(tri[k] == from ? to : tri[k]);
+            }
+            float before[3], after[3];
+            triangleNormal(p[0], p[1], p[2], before);
+            triangleNormal(q[0], q[1], q[2], after);
+            const float dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+            if (dot <= 0.f)
+            {
+                flipped = true;
+                break;
+            }
+        }
+        if (flipped)
+            continue;
+        /* Triangles of the collapsed edge pair each copy of 'from' with copy of 'to'
+           on the same side of attribute seam. Collapse is rejected if remaining
+           triangle references copy that has no pair, i.e. if seam vertex would
+           move off the seam or seam corner would be lost. */
+        copyPairs.clear();
+        bool seamBroken = false;
+        for (uint32_t t : vertexTriangles[from])
+        {
+            if (deadTriangles[t])
+                continue;
+            const uint32_t *tri = &triangles[t * 3];
+            if (tri[0] != to && tri[1] != to && tri[2] != to)
+                continue;
+            const uint32_t fromCopy = corners[cornerOf(t, from)];
+            const uint32_t toCopy = corners[cornerOf(t, to)];
+            const auto pair = findCopy(fromCopy);
+            if (pair == copyPairs.end())
+                copyPairs.emplace_back(fromCopy, toCopy);
+            else if (pair->second != toCopy)
+                seamBroken = true;
+        }
+        for (uint32_t t : vertexTriangles[from])
+        {
+            if (seamBroken)
+                break;
+            if (!deadTriangles[t] && findCopy(corners[cornerOf(t, from)]) == copyPairs.end())
+                seamBroken = true;
+        }
+        if (seamBroken)
+            continue;
+        // Collapse
+        for (uint32_t t : vertexTriangles[from])
+        {
+            if (deadTriangles[t])
+                continue;
+            uint32_t *tri = &triangles[t * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to)
+            {
+                deadTriangles[t] = true;
+                --triangleCount;
+            }
+            else
+            {
+                const uint32_t corner = cornerOf(t, from);
+                tri[corner - t * 3] = to;
+                corners[corner] = findCopy(corners[corner])->second;
+                vertexTriangles[to].push_back(t);
+            }
+        }
+        std::vector<uint32_t>& toTriangles = vertexTriangles[to];
+        toTriangles.erase(std::remove_if(toTriangles.begin(), toTriangles.end(),
+            [&deadTriangles](uint32_t t) { return deadTriangles[t]; }), toTriangles.end());
+        vertexTriangles[from].clear();
+        quadrics[to].add(quadrics[from]);
+        removed[from] = true;
+        ++versions[to];
+        maxError = std::max(maxError, collapse.cost);
+        gatherNeighbours(to, toNeighbours);
+        for (uint32_t v : toNeighbours)
+            pushEdge(to, v);
+    }
+    // Emit remaining triangles, each corner references copy with its own attributes
+    indices.clear();
+    indices.reserve(triangleCount * 3);
+    for (uint32_t t = 0, count = static_cast<uint32_t>(deadTriangles.size()); t < count; ++t)
+    {
+        if (!deadTriangles[t])
+            indices.insert(indices.end(), &corners[t * 3], &corners[t * 3] + 3);
+    }
+    // Quadric error is sum of squared distances to planes
+    return sqrtf(maxError);
+}
+
+uint32_t selectLod(const std::vector<LevelOfDetail>& lods, uint32_t currentLod, float pixelsPerUnit,
+    float threshold /* 1 */, float hysteresis /* .25 */) noexcept
+{
+    if (lods.empty())
+        return 0;
+    uint32_t lod = std::min(currentLod, static_cast<uint32_t>(lods.size() - 1));
+    // Refine if current level became too coarse
+    while (lod > 0 && lods[lod].error * pixelsPerUnit > threshold * (1.f + hysteresis))
+        --lod;
+    // Coarsen only when next level is well below threshold
+    while (lod + 1 < lods.size() && lods[lod + 1].error * pixelsPerUnit < threshold * (1.f - hysteresis))
+        ++lod;
+    return lod;
+}
+} // namespace mesh
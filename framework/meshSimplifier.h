@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Mesh simplification for generation of discrete levels of detail.
+   Edges are collapsed into one of their endpoints, so simplified index
+   buffers reference vertices of the original mesh and all levels can
+   share single vertex buffer. */
+namespace mesh
+{
+    struct LevelOfDetail
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float error; // Geometric deviation in object space units
+    };
+
+    /* Greedy edge collapse ordered by quadric error metric, see "Surface
+       Simplification Using Quadric Error Metrics" by Garland and Heckbert.
+       Vertices with equal positions are welded, so that seams between
+       patches don't crack. Vertices that share position but differ in
+       attributes (e.g. texture coordinates across UV seam) are kept apart
+       in the output: seam vertex may only collapse along the seam, so that
+       texture isn't stretched across it. Collapses that flip triangles,
+       pinch the surface or detach open boundaries are rejected.
+       Returns error of the level. */
+    float simplify(std::vector<uint32_t>& indices,
+        const float *positions,
+        size_t positionStride,
+        uint32_t vertexCount,
+        uint32_t targetIndexCount,
+        const float *attributes = nullptr,
+        size_t attributeStride = 0,
+        uint32_t attributeCount = 0);
+    /* Chooses coarsest level whose error projects to less than threshold
+       (in pixels). Switching is delayed by hysteresis band around threshold,
+       so that object on the edge doesn't pop from frame to frame. */
+    uint32_t selectLod(const std::vector<LevelOfDetail>& lods,
+        uint32_t currentLod,
+        float pixelsPerUnit,
+        float threshold = 1.f,
+        float hysteresis = .25f) noexcept;
+} // namespace mesh
@@ -0,0 +1,183 @@
+#include <cmath>
+#include <algorithm>
+#include "meshlets.h"
+
+namespace mesh
+{
+namespace
+{
+constexpr uint32_t invalidIndex = ~0U;
+
+inline const float *position(const float *positions, size_t stride, uint32_t index) noexcept
+{
+    return reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(positions) + index * stride);
+}
+
+void computeBounds(Meshlet& meshlet, const uint32_t *indices, const std::vector<uint32_t>& vertices,
+    const float *positions, size_t stride) noexcept
+{
+    float minBound[3] = {INFINITY, INFINITY, INFINITY};
+    float maxBound[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t v : vertices)
+    {
+        const float *p = position(positions, stride, v);
+        for (int k = 0; k < 3; ++k)
+        {
+            minBound[k] = std::min(minBound[k], p[k]);
+            maxBound[k] = std::max(maxBound[k], p[k]);
+        }
+    }
+    float radiusSq = 0.f;
+    for (int k = 0; k < 3; ++k)
+        meshlet.center[k] = (minBound[k] + maxBound[k]) * .5f;
+    for (uint32_t v : vertices)
+    {
+        const float *p = position(positions, stride, v);
+        const float d[3] = {p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2]};
+        radiusSq = std::max(radiusSq, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+    meshlet.radius = sqrtf(radiusSq);
+    // Cone axis is average of triangle normals
+    std::vector<float> normals;
+    normals.reserve(meshlet.indexCount);
+    float axis[3] = {0.f, 0.f, 0.f};
+    for (uint32_t i = 0; i < meshlet.indexCount; i += 3)
+    {
+        const float *p0 = position(positions, stride, indices[i]);
+        const float *p1 = position(positions, stride, indices[i + 1]);
+        const float *p2 = position(positions, stride, indices[i + 2]);
+        const float e0[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const float e1[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        float n[3] = {
+            e0[1] * e1[2] - e0[2] * e1[1],
+            e0[2] * e1[0] - e0[0] * e1[2],
+            e0[0] * e1[1] - e0[1] * e1[0]
+        };
+        const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length < 1e-20f)
+            continue; // Degenerate triangles at poles are never rasterized
+        for (int k = 0; k < 3; ++k)
+        {
+            n[k] /= length;
+            axis[k] += n[k];
+        }
+        normals.insert(normals.end(), n, n + 3);
+    }
+    const float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    float minDot = 1.f;
+    if (axisLength < 1e-6f)
+        minDot = -1.f;
+    else
+    {
+        for (int k = 0; k < 3; ++k)
+            axis[k] /= axisLength;
+        for (size_t i = 0; i < normals.size(); i += 3)
+            minDot = std::min(minDot, axis[0] * normals[i] + axis[1] * normals[i + 1] + axis[2] * normals[i + 2]);
+    }
+    for (int k = 0; k < 3; ++k)
+        meshlet.coneAxis[k] = axisLength < 1e-6f ? 0.f : axis[k];
+    // Wide cone culls nothing, but sphere test would still be evaluated
+    meshlet.coneCutoff = (minDot <= .1f) ? 1.f : sqrtf(1.f - minDot * minDot);
+}
+} // namespace
+
+std::vector<Meshlet> buildMeshlets(uint32_t *indices, uint32_t indexCount, const float *positions,
+    size_t positionStride, uint32_t vertexCount)
+{
+    const uint32_t triangleCount = indexCount/3;
+    // Build vertex-triangle adjacency
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t i = 0; i < triangleCount * 3; ++i)
+        ++adjacencyOffsets[indices[i] + 1];
+    for (uint32_t v = 0; v < vertexCount; ++v)
+        adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (uint32_t t = 0; t < triangleCount; ++t)
+            for (int k = 0; k < 3; ++k)
+                adjacency[fill[indices[t * 3 + k]]++] = t;
+    }
+    auto centroid = [&](uint32_t t, float c[3])
+    {
+        const float *p0 = position(positions, positionStride, indices[t * 3]);
+        const float *p1 = position(positions, positionStride, indices[t * 3 + 1]);
+        const float *p2 = position(positions, positionStride, indices[t * 3 + 2]);
+        for (int k = 0; k < 3; ++k)
+            c[k] = (p0[k] + p1[k] + p2[k])/3.f;
+    };
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> vertexMeshlet(vertexCount, invalidIndex);
+    std::vector<uint32_t> vertices;
+    vertices.reserve(MaxMeshletVertices);
+    std::vector<uint32_t> sortedIndices;
+    sortedIndices.reserve(triangleCount * 3);
+    std::vector<Meshlet> meshlets;
+    uint32_t seed = 0;
+    while (true)
+    {
+        while (seed < triangleCount && emitted[seed])
+            ++seed;
+        if (seed == triangleCount)
+            break;
+        const uint32_t id = static_cast<uint32_t>(meshlets.size());
+        Meshlet meshlet = {};
+        meshlet.firstIndex = static_cast<uint32_t>(sortedIndices.size());
+        vertices.clear();
+        float seedCentroid[3];
+        centroid(seed, seedCentroid);
+        uint32_t triangle = seed;
+        uint32_t meshletTriangles = 0;
+        while (triangle != invalidIndex)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                const uint32_t v = indices[triangle * 3 + k];
+                if (vertexMeshlet[v] != id)
+                {
+                    vertexMeshlet[v] = id;
+                    vertices.push_back(v);
+                }
+                sortedIndices.push_back(v);
+            }
+            emitted[triangle] = true;
+            if (++meshletTriangles == MaxMeshletTriangles)
+                break;
+            // Choose triangle adjacent to the meshlet that adds fewest vertices
+            triangle = invalidIndex;
+            uint32_t bestNewVertices = 4;
+            float bestDistance = INFINITY;
+            for (uint32_t v : vertices)
+            {
+                for (uint32_t j = adjacencyOffsets[v]; j < adjacencyOffsets[v + 1]; ++j)
+                {
+                    const uint32_t t = adjacency[j];
+                    if (emitted[t])
+                        continue;
+                    uint32_t newVertices = 0;
+                    for (int k = 0; k < 3; ++k)
+                        newVertices += (vertexMeshlet[indices[t * 3 + k]] != id);
+                    if (vertices.size() + newVertices > MaxMeshletVertices || newVertices > bestNewVertices)
+                        continue;
+                    float c[3];
+                    centroid(t, c);
+                    const float d[3] = {c[0] - seedCentroid[0], c[1] - seedCentroid[1], c[2] - seedCentroid[2]};
+                    const float distance = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+                    if (newVertices < bestNewVertices || distance < bestDistance)
+                    {
+                        triangle = t;
+                        bestNewVertices = newVertices;
+                        bestDistance = distance;
+                    }
+                }
+            }
+        }
+        meshlet.indexCount = meshletTriangles * 3;
+        meshlet.vertexCount = static_cast<uint32_t>(vertices.size());
+        computeBounds(meshlet, sortedIndices.data() + meshlet.firstIndex, vertices, positions, positionStride);
+        meshlets.push_back(meshlet);
+    }
+    std::copy(sortedIndices.begin(), sortedIndices.end(), indices);
+    return meshlets;
+}
+} // namespace mesh
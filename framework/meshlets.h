@@ -0,0 +1,37 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+/* Clusters of adjacent triangles with bounds for coarse visibility tests.
+   Without mesh shaders, meshlet is a contiguous range of index buffer,
+   so that each visible cluster is drawn by its own indirect command. */
+namespace mesh
+{
+    constexpr uint32_t MaxMeshletVertices = 64;
+    constexpr uint32_t MaxMeshletTriangles = 124;
+
+    // Matches std430 layout of culling shader
+    struct Meshlet
+    {
+        float center[3];
+        float radius;
+        float coneAxis[3];
+        /* Cluster is backfacing if
+           dot(center - eye, coneAxis) >= coneCutoff * length(center - eye) + radius.
+           Cutoff is 1 if triangle normals diverge too much for the test. */
+        float coneCutoff;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t vertexCount;
+        uint32_t padding;
+    };
+
+    /* Grows each meshlet from seed triangle by adjacent triangles that add
+       fewest new vertices, nearest to the seed first. Triangles are reordered
+       in place, so that each meshlet occupies contiguous range of indices. */
+    std::vector<Meshlet> buildMeshlets(uint32_t *indices,
+        uint32_t indexCount,
+        const float *positions,
+        size_t positionStride,
+        uint32_t vertexCount);
+} // namespace mesh
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+/* Helpers to pack vertex attributes into compact formats that
+   are decoded by fixed-function vertex fetch. */
+namespace quantization
+{
+    // VK_FORMAT_R16_SNORM
+    inline int16_t snorm16(float x) noexcept
+    {
+        x = std::min(std::max(x, -1.f), 1.f);
+        return static_cast<int16_t>(lroundf(x * 32767.f));
+    }
+
+    // VK_FORMAT_A2B10G10R10_UNORM_PACK32, vector components are mapped from [-1, 1] to [0, 1],
+    // vertex shader should decode them as n * 2 - 1
+    inline uint32_t packNormal1010102(float x, float y, float z) noexcept
+    {
+        auto unorm10 = [](float v) -> uint32_t
+        {
+            v = std::min(std::max(v * .5f + .5f, 0.f), 1.f);
+            return static_cast<uint32_t>(lroundf(v * 1023.f));
+        };
+        return unorm10(x) | (unorm10(y) << 10) | (unorm10(z) << 20);
+    }
+
+    // VK_FORMAT_R16_SFLOAT, round to nearest even
+    inline uint16_t half(float x) noexcept
+    {
+        uint32_t bits;
+        memcpy(&bits, &x, sizeof(float));
+        const uint32_t sign = (bits >> 16) & 0x8000;
+        const int32_t exponent = static_cast<int32_t>((bits >> 23) & 0xFF) - 127 + 15;
+        uint32_t mantissa = bits & 0x7FFFFF;
+        if (exponent >= 31)
+        {   // Overflow to infinity, keep NaN
+            const bool nan = ((bits >> 23) & 0xFF) == 0xFF && mantissa;
+            return static_cast<uint16_t>(sign | 0x7C00 | (nan ? 0x200 : 0));
+        }
+        if (exponent <= 0)
+        {   // Denormal or zero
+            if (exponent < -10)
+                return static_cast<uint16_t>(sign);
+            mantissa |= 0x800000;
+            const uint32_t shift = 14 - exponent;
+            uint32_t value = mantissa >> shift;
+            const uint32_t remainder = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (value & 1)))
+                ++value;
+            return static_cast<uint16_t>(sign | value);
+        }
+        uint32_t value = (exponent << 10) | (mantissa >> 13);
+        const uint32_t remainder = mantissa & 0x1FFF;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (value & 1)))
+            ++value; // May carry into exponent, which is correct
+        return static_cast<uint16_t>(sign | value);
+    }
+} // namespace quantization
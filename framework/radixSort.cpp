@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <functional>
+#include "radixSort.h"
+#include "threadPool.h"
+
+namespace
+{
+constexpr uint32_t MinBlockSize = 4096; // Smaller blocks don't pay off task overhead
+
+inline uint32_t digit(uint64_t key, uint32_t shift) noexcept
+{
+    return static_cast<uint32_t>(key >> shift) & (RadixSort::BucketCount - 1);
+}
+
+void parallelFor(ThreadPool *threadPool, uint32_t count, const std::function<void(uint32_t first, uint32_t last)>& func)
+{
+    if (threadPool && count > 1)
+        threadPool->parallelFor(count, func);
+    else
+        func(0, count);
+}
+} // namespace
+
+void RadixSort::sort(std::vector<Item>& items, ThreadPool *threadPool /* nullptr */)
+{
+    passCount = 0;
+    const uint32_t count = static_cast<uint32_t>(items.size());
+    if (count < 2)
+        return;
+    uint32_t blockCount = 1;
+    if (threadPool)
+        blockCount = std::max(1U, std::min(threadPool->getThreadCount(), count/MinBlockSize));
+    const uint32_t blockSize = (count + blockCount - 1)/blockCount;
+    blockCount = (count + blockSize - 1)/blockSize;
+    scratch.resize(count);
+    // Digits of all passes are counted at once to find out which passes can be skipped
+    counts.assign(blockCount * MaxPassCount * BucketCount, 0);
+    parallelFor(threadPool, blockCount,
+        [this, &items, count, blockSize](uint32_t firstBlock, uint32_t lastBlock)
+        {
+            for (uint32_t block = firstBlock; block < lastBlock; ++block)
+            {
+                uint32_t *blockCounts = &counts[block * MaxPassCount * BucketCount];
+                const uint32_t last = std::min((block + 1) * blockSize, count);
+                for (uint32_t i = block * blockSize; i < last; ++i)
+                {
+                    const uint64_t key = items[i].key;
+                    for (uint32_t pass = 0; pass < MaxPassCount; ++pass)
+                        ++blockCounts[pass * BucketCount + digit(key, pass * RadixBits)];
+                }
+            }
+        });
+    bool skipPass[MaxPassCount];
+    for (uint32_t pass = 0; pass < MaxPassCount; ++pass)
+    {
+        const uint32_t bucket = digit(items[0].key, pass * RadixBits);
+        uint32_t bucketCount = 0;
+        for (uint32_t block = 0; block < blockCount; ++block)
+            bucketCount += counts[(block * MaxPassCount + pass) * BucketCount + bucket];
+        skipPass[pass] = (bucketCount == count);
+    }
+    std::vector<Item> *src = &items, *dst = &scratch;
+    bool firstPass = true;
+    for (uint32_t pass = 0; pass < MaxPassCount; ++pass)
+    {
+        if (skipPass[pass])
+            continue;
+        const uint32_t shift = pass * RadixBits;
+        // Blocks have been reordered by previous pass, so their digits are counted again
+        if (!firstPass)
+        {
+            parallelFor(threadPool, blockCount,
+                [this, src, count, blockSize, pass, shift](uint32_t firstBlock, uint32_t lastBlock)
+                {
+                    for (uint32_t block = firstBlock; block < lastBlock; ++block)
+                    {
+                        uint32_t *blockCounts = &counts[(block * MaxPassCount + pass) * BucketCount];
+                        std::fill(blockCounts, blockCounts + BucketCount, 0);
+                        const uint32_t last = std::min((block + 1) * blockSize, count);
+                        for (uint32_t i = block * blockSize; i < last; ++i)
+                            ++blockCounts[digit((*src)[i].key, shift)];
+                    }
+                });
+        }
+        firstPass = false;
+        // Counts are turned into offsets: bucket by bucket, block by block within bucket
+        uint32_t offset = 0;
+        for (uint32_t bucket = 0; bucket < BucketCount; ++bucket)
+        {
+            for (uint32_t block = 0; block < blockCount; ++block)
+            {
+                uint32_t& blockOffset = counts[(block * MaxPassCount + pass) * BucketCount + bucket];
+                const uint32_t bucketCount = blockOffset;
+                blockOffset = offset;
+                offset += bucketCount;
+            }
+        }
+        parallelFor(threadPool, blockCount,
+            [this, src, dst, count, blockSize, pass, shift](uint32_t firstBlock, uint32_t lastBlock)
+            {
+                for (uint32_t block = firstBlock; block < lastBlock; ++block)
+                {
+                    uint32_t *offsets = &counts[(block * MaxPassCount + pass) * BucketCount];
+                    const uint32_t last = std::min((block + 1) * blockSize, count);
+                    for (uint32_t i = block * blockSize; i < last; ++i)
+                    {
+                        const Item& item = (*src)[i];
+                        (*dst)[offsets[digit(item.key, shift)]++] = item;
+                    }
+                }
+            });
+        std::swap(src, dst);
+        ++passCount;
+    }
+    if (src != &items) // Odd number of passes
+        items.swap(scratch);
+}
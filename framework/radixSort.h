@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+/* Stable LSD radix sort of 64-bit keys with 32-bit payload, 8 bits per pass.
+   Items are split into contiguous blocks, one per worker. Each pass counts
+   digits of every block in parallel, exclusive prefix sum over digits and
+   blocks gives each block its own output offsets, then blocks are scattered
+   in parallel. Passes over digit that is the same in all keys are skipped,
+   so that keys with unused high bits cost fewer passes.
+   Scratch memory is kept between calls. */
+class RadixSort
+{
+public:
+    constexpr static uint32_t RadixBits = 8;
+    constexpr static uint32_t BucketCount = 1 << RadixBits;
+    constexpr static uint32_t MaxPassCount = 64/RadixBits;
+
+    struct Item
+    {
+        uint64_t key;
+        uint32_t value;
+    };
+
+    // Sorts items in ascending order of keys, equal keys keep their order
+    void sort(std::vector<Item>& items, ThreadPool *threadPool = nullptr);
+    // Number of scatter passes done by the last call
+    uint32_t getPassCount() const noexcept { return passCount; }
+
+private:
+    std::vector<Item> scratch;
+    std::vector<uint32_t> counts; // Per block
+    uint32_t passCount = 0;
+};
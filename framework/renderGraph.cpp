@@ -0,0 +1,492 @@
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include "renderGraph.h"
+
+namespace
+{
+struct UsageInfo
+{
+    VkImageLayout layout;
+    VkPipelineStageFlags stageMask;
+    VkAccessFlags accessMask;
+    bool write; // Writes overwrite the whole image
+};
+
+VkImageSubresourceRange subresourceRange(bool depth, bool stencil) noexcept
+{
+    VkImageSubresourceRange range;
+    range.aspectMask = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    if (stencil) // Layout of both aspects is changed at once
+        range.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    range.baseMipLevel = 0;
+    range.levelCount = 1;
+    range.baseArrayLayer = 0;
+    range.layerCount = 1;
+    return range;
+}
+
+bool hasMemoryType(std::shared_ptr<const magma::PhysicalDevice> physicalDevice, uint32_t memoryTypeBits,
+    VkMemoryPropertyFlags flags)
+{
+    const VkPhysicalDeviceMemoryProperties properties = physicalDevice->getMemoryProperties();
+    for (uint32_t i = 0; i < properties.memoryTypeCount; ++i)
+    {
+        if ((memoryTypeBits & (1 << i)) && ((properties.memoryTypes[i].propertyFlags & flags) == flags))
+            return true;
+    }
+    return false;
+}
+
+VkImageUsageFlags transientUsage(bool depth) noexcept
+{
+    return VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
+        (depth ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+}
+
+/* Lazily allocated memory type is preferred if image allows it, device local one
+   is used otherwise. Memory requirements can be queried only from existing image,
+   so throwaway image without memory is created first. */
+VkMemoryPropertyFlags chooseTransientMemory(std::shared_ptr<magma::Device> device, VkFormat format,
+    const VkExtent2D& extent, uint32_t samples, bool depth)
+{
+    VkImageCreateInfo imageInfo;
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.pNext = nullptr;
+    imageInfo.flags = 0;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = VkExtent3D{extent.width, extent.height, 1};
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = static_cast<VkSampleCountFlagBits>(samples);
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = transientUsage(depth);
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.queueFamilyIndexCount = 0;
+    imageInfo.pQueueFamilyIndices = nullptr;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkImage image;
+    if (vkCreateImage(device->getHandle(), &imageInfo, nullptr, &image) != VK_SUCCESS)
+        throw std::runtime_error("failed to create image");
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(device->getHandle(), image, &memoryRequirements);
+    vkDestroyImage(device->getHandle(), image, nullptr);
+    constexpr VkMemoryPropertyFlags lazyFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    if (hasMemoryType(device->getPhysicalDevice(), memoryRequirements.memoryTypeBits, lazyFlags))
+        return lazyFlags;
+    return VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+}
+
+// Contents live only within render pass, so that tiler may keep them in on-chip memory
+class TransientAttachment : public magma::Image
+{
+public:
+    explicit TransientAttachment(std::shared_ptr<magma::Device> device, VkFormat format,
+        const VkExtent2D& extent, uint32_t samples, bool depth, VkMemoryPropertyFlags memoryFlags):
+        magma::Image(std::move(device), VK_IMAGE_TYPE_2D, format, VkExtent3D{extent.width, extent.height, 1},
+            1, // mipLevels
+            1, // arrayLayers
+            samples,
+            0, // flags
+            transientUsage(depth),
+            memoryFlags, // Memory of this type is allocated and bound by base constructor
+            magma::Sharing(), nullptr)
+    {}
+};
+} // namespace
+
+RenderGraph::Pass::Pass(RenderGraph *graph, const char *name, RecordFunc record):
+    graph(graph),
+    name(name),
+    record(std::move(record))
+{}
+
+RenderGraph::Pass& RenderGraph::Pass::writeColor(Resource image, bool clear /* true */)
+{
+    return use(image, Usage::Color, clear);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::writeDepth(Resource image, bool clear /* true */)
+{
+    return use(image, Usage::Depth, clear);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::resolve(Resource image)
+{
+    return use(image, Usage::Resolve, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::sample(Resource image)
+{
+    return use(image, Usage::Sampled, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::copyFrom(Resource image)
+{
+    return use(image, Usage::TransferSrc, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::copyTo(Resource image)
+{
+    return use(image, Usage::TransferDst, false);
+}
+
+RenderGraph::Pass& RenderGraph::Pass::use(Resource image, Usage usage, bool clear)
+{
+    if (graph->compiled)
+        throw std::runtime_error("render graph has been compiled");
+    if (image >= graph->images.size())
+        throw std::out_of_range("invalid render graph image");
+    const bool attachment = (Usage::Color == usage) || (Usage::Depth == usage) || (Usage::Resolve == usage);
+    if (attachment && ((Usage::Depth == usage) != graph->images[image].depth))
+        throw std::invalid_argument("format of image \"" + graph->images[image].name + "\" doesn't match its attachment");
+    uses.push_back({image, usage, clear});
+    return *this;
+}
+
+RenderGraph::RenderGraph(std::shared_ptr<magma::Device> device):
+    device(std::move(device))
+{
+    stats.lazilyAllocated = hasMemoryType(this->device->getPhysicalDevice(), ~0u, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+}
+
+RenderGraph::Resource RenderGraph::createImage(const char *name, VkFormat format, const VkExtent2D& extent, uint32_t samples /* 1 */)
+{
+    if (compiled)
+        throw std::runtime_error("render graph has been compiled");
+    const magma::Format fmt(format);
+    Image image;
+    image.name = name;
+    image.format = format;
+    image.extent = extent;
+    image.samples = samples;
+    image.depth = fmt.depth() || fmt.depthStencil();
+    image.stencil = fmt.depthStencil();
+    images.push_back(image);
+    return static_cast<Resource>(images.size() - 1);
+}
+
+void RenderGraph::exportImage(Resource image, VkImageLayout layout, VkPipelineStageFlags stageMask, VkAccessFlags accessMask)
+{
+    Image& exported = images.at(image);
+    exported.exported = true;
+    exported.exportLayout = layout;
+    exported.exportStageMask = stageMask;
+    exported.exportAccessMask = accessMask;
+    if (VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL == layout)
+        exported.sampled = true;
+}
+
+RenderGraph::Pass& RenderGraph::addPass(const char *name, RecordFunc record)
+{
+    if (compiled)
+        throw std::runtime_error("render graph has been compiled");
+    passes.emplace_back(new Pass(this, name, std::move(record)));
+    return *passes.back();
+}
+
+void RenderGraph::compile()
+{
+    computeLifetimes();
+    allocateImages();
+    for (uint32_t i = 0; i < passes.size(); ++i)
+        createRenderPass(*passes[i], i);
+    // The first walk finds out states in the end of frame, the second one starts from them
+    std::vector<State> states(physicalImages.size());
+    trackStates(states, false);
+    trackStates(states, true);
+    stats.passCount = static_cast<uint32_t>(passes.size());
+    stats.physicalImageCount = static_cast<uint32_t>(physicalImages.size());
+    compiled = true;
+}
+
+void RenderGraph::record(std::shared_ptr<magma::CommandBuffer> cmdBuffer) const
+{
+    if (!compiled)
+        throw std::runtime_error("render graph should be compiled before recording");
+    for (const auto& pass : passes)
+    {
+        recordBarriers(cmdBuffer, pass->imageBarriers, pass->dependency);
+        pass->record(cmdBuffer, *pass);
+    }
+    recordBarriers(std::move(cmdBuffer), exportBarriers, exportDependency);
+}
+
+std::shared_ptr<magma::Image> RenderGraph::getImage(Resource image) const
+{
+    return physicalImages[getPhysicalImage(image)].image;
+}
+
+std::shared_ptr<magma::ImageView> RenderGraph::getImageView(Resource image) const
+{
+    return physicalImages[getPhysicalImage(image)].view;
+}
+
+uint32_t RenderGraph::getPhysicalImage(Resource image) const
+{
+    const Image& logical = images.at(image);
+    if (logical.physicalImage >= physicalImages.size())
+        throw std::runtime_error("image \"" + logical.name + "\" isn't used by any pass");
+    return logical.physicalImage;
+}
+
+void RenderGraph::computeLifetimes()
+{
+    for (uint32_t i = 0; i < passes.size(); ++i)
+    {
+        uint32_t colorCount = 0, resolveCount = 0;
+        for (const Pass::Use& use : passes[i]->uses)
+        {
+            Image& image = images[use.image];
+            if (image.firstPass > i)
+            {   // Contents don't survive between frames
+                if ((Pass::Usage::Sampled == use.usage) || (Pass::Usage::TransferSrc == use.usage))
+                    throw std::runtime_error("image \"" + image.name + "\" is read by pass \"" + passes[i]->name + "\" before it is written");
+                image.firstPass = i;
+            }
+            image.lastPass = i;
+            switch (use.usage)
+            {
+            case Pass::Usage::Color: ++colorCount; break;
+            case Pass::Usage::Resolve: ++resolveCount; break;
+            case Pass::Usage::Sampled: image.sampled = true; break;
+            case Pass::Usage::TransferSrc:
+            case Pass::Usage::TransferDst: image.transfer = true; break;
+            default: break;
+            }
+        }
+        if (resolveCount > colorCount)
+            throw std::runtime_error("pass \"" + passes[i]->name + "\" has more resolve attachments than color ones");
+    }
+    for (Image& image : images)
+    {
+        if (image.depth && image.transfer)
+            throw std::runtime_error("copy of depth image \"" + image.name + "\" isn't supported");
+        if (image.exported && (image.firstPass != ~0u))
+            image.lastPass = static_cast<uint32_t>(passes.size()); // Used after the last pass
+        // Attachment of single pass is never stored, so it doesn't need to be backed by memory
+        image.transient = stats.lazilyAllocated &&
+            !image.exported && !image.sampled && !image.transfer &&
+            (image.firstPass == image.lastPass);
+    }
+}
+
+void RenderGraph::allocateImages()
+{   // Interval scheduling: images in order of their first use reuse retired physical images
+    std::vector<Resource> order(images.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+        [this](Resource a, Resource b) { return images[a].firstPass < images[b].firstPass; });
+    physicalImages.clear();
+    stats.imageCount = 0;
+    stats.transientImageCount = 0;
+    stats.lazilyAllocatedImageCount = 0;
+    stats.lazilyAllocatedMemorySize = 0;
+    for (Resource i : order)
+    {
+        Image& image = images[i];
+        if (image.firstPass == ~0u)
+            continue;
+        ++stats.imageCount;
+        auto it = std::find_if(physicalImages.begin(), physicalImages.end(),
+            [this, &image](const PhysicalImage& physical)
+            {
+                const Image& desc = images[physical.desc];
+                return !image.exported && !desc.exported &&
+                    (physical.lastPass < image.firstPass) &&
+                    (desc.format == image.format) &&
+                    (desc.extent.width == image.extent.width) &&
+                    (desc.extent.height == image.extent.height) &&
+                    (desc.samples == image.samples) &&
+                    (desc.sampled == image.sampled) &&
+                    (desc.transfer == image.transfer) &&
+                    (desc.transient == image.transient);
+            });
+        if (it != physicalImages.end())
+        {
+            it->lastPass = image.lastPass;
+            image.physicalImage = static_cast<uint32_t>(it - physicalImages.begin());
+            continue;
+        }
+        PhysicalImage physical;
+        physical.desc = i;
+        if (image.transient)
+        {
+            const VkMemoryPropertyFlags memoryFlags = chooseTransientMemory(device, image.format, image.extent,
+                image.samples, image.depth);
+            physical.image = std::make_shared<TransientAttachment>(device, image.format, image.extent,
+                image.samples, image.depth, memoryFlags);
+            ++stats.transientImageCount;
+            if (memoryFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+            {   // Otherwise image memory isn't allowed to be lazily allocated, and it is committed as usual
+                ++stats.lazilyAllocatedImageCount;
+                stats.lazilyAllocatedMemorySize += physical.image->getMemory()->getSize();
+            }
+        }
+        else if (image.depth)
+        {
+            physical.image = std::make_shared<magma::DepthStencilAttachment>(device, image.format, image.extent,
+                1, image.samples, image.sampled);
+        }
+        else
+        {
+            physical.image = std::make_shared<magma::ColorAttachment>(device, image.format, image.extent,
+                1, image.samples, image.sampled, nullptr, image.transfer);
+        }
+        physical.view = std::make_shared<magma::ImageView>(physical.image);
+        physical.lastPass = image.lastPass;
+        image.physicalImage = static_cast<uint32_t>(physicalImages.size());
+        physicalImages.push_back(physical);
+    }
+}
+
+void RenderGraph::createRenderPass(Pass& pass, uint32_t passIndex)
+{
+    std::vector<magma::AttachmentDescription> attachments;
+    std::vector<std::shared_ptr<magma::ImageView>> views;
+    for (Pass::Usage usage : {Pass::Usage::Color, Pass::Usage::Depth, Pass::Usage::Resolve})
+    {
+        for (const Pass::Use& use : pass.uses)
+        {
+            if (use.usage != usage)
+                continue;
+            const Image& image = images[use.image];
+            // Layouts are changed by barriers of graph, so render pass doesn't change them
+            const VkImageLayout layout = image.depth ?
+                VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL :
+                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+            // Contents are stored only if somebody reads them later
+            const bool store = isStored(use.image, passIndex);
+            attachments.emplace_back(image.format, image.samples,
+                use.clear ? (store ? magma::op::clearStore : magma::op::clear)
+                          : (store ? magma::op::store : magma::op::dontCare),
+                magma::op::dontCare,
+                layout, layout);
+            views.push_back(physicalImages[image.physicalImage].view);
+        }
+    }
+    if (attachments.empty())
+        return;
+    pass.renderPass = std::shared_ptr<magma::RenderPass>(new magma::RenderPass(device, attachments));
+    pass.framebuffer = std::shared_ptr<magma::Framebuffer>(new magma::Framebuffer(pass.renderPass, views));
+}
+
+void RenderGraph::trackStates(std::vector<State>& states, bool emit)
+{
+    auto transition = [this, emit](State& state, uint32_t physicalImage, const UsageInfo& info,
+        std::vector<Pass::ImageBarrier>& imageBarriers, Pass::Dependency& dependency)
+    {
+        if (state.layout != info.layout)
+        {   // Written image doesn't need previous contents
+            if (emit)
+            {
+                imageBarriers.push_back({physicalImage,
+                    info.write ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout, info.layout,
+                    state.stageMask, info.stageMask});
+            }
+        }
+        else if (state.written || info.write)
+        {   // Write after read needs only execution dependency
+            dependency.srcStageMask |= state.stageMask;
+            dependency.dstStageMask |= info.stageMask;
+            if (state.written)
+            {
+                dependency.srcAccessMask |= state.accessMask;
+                dependency.dstAccessMask |= info.accessMask;
+            }
+        }
+        else
+        {   // Read after read, readers are accumulated for the next writer
+            state.stageMask |= info.stageMask;
+            state.accessMask |= info.accessMask;
+            return;
+        }
+        state.layout = info.layout;
+        state.stageMask = info.stageMask;
+        state.accessMask = info.accessMask;
+        state.written = info.write;
+    };
+
+    for (auto& pass : passes)
+    {
+        std::vector<Pass::ImageBarrier> imageBarriers;
+        Pass::Dependency dependency;
+        for (const Pass::Use& use : pass->uses)
+        {
+            const Image& image = images[use.image];
+            UsageInfo info;
+            switch (use.usage)
+            {
+            case Pass::Usage::Color:
+            case Pass::Usage::Resolve:
+                info = {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                    VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, true};
+                break;
+            case Pass::Usage::Depth:
+                info = {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+                    VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, true};
+                break;
+            case Pass::Usage::Sampled:
+                info = {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_SHADER_READ_BIT, false};
+                break;
+            case Pass::Usage::TransferSrc:
+                info = {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_READ_BIT, false};
+                break;
+            case Pass::Usage::TransferDst:
+                info = {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_ACCESS_TRANSFER_WRITE_BIT, true};
+                break;
+            }
+            transition(states[image.physicalImage], image.physicalImage, info, imageBarriers, dependency);
+        }
+        if (emit)
+        {
+            pass->imageBarriers = std::move(imageBarriers);
+            pass->dependency = dependency;
+        }
+    }
+    std::vector<Pass::ImageBarrier> imageBarriers;
+    Pass::Dependency dependency;
+    for (const Image& image : images)
+    {
+        if (image.exported && (image.physicalImage != ~0u))
+        {
+            const UsageInfo info = {image.exportLayout, image.exportStageMask, image.exportAccessMask, false};
+            transition(states[image.physicalImage], image.physicalImage, info, imageBarriers, dependency);
+        }
+    }
+    if (emit)
+    {
+        exportBarriers = std::move(imageBarriers);
+        exportDependency = dependency;
+        stats.barrierCount = static_cast<uint32_t>(exportBarriers.size()) + (exportDependency.dstStageMask ? 1 : 0);
+        for (const auto& pass : passes)
+            stats.barrierCount += static_cast<uint32_t>(pass->imageBarriers.size()) + (pass->dependency.dstStageMask ? 1 : 0);
+    }
+}
+
+bool RenderGraph::isStored(Resource image, uint32_t passIndex) const noexcept
+{
+    return images[image].lastPass > passIndex;
+}
+
+void RenderGraph::recordBarriers(std::shared_ptr<magma::CommandBuffer> cmdBuffer,
+    const std::vector<Pass::ImageBarrier>& imageBarriers, const Pass::Dependency& dependency) const
+{
+    for (const Pass::ImageBarrier& barrier : imageBarriers)
+    {
+        const PhysicalImage& physical = physicalImages[barrier.physicalImage];
+        cmdBuffer->pipelineBarrier(barrier.srcStageMask, barrier.dstStageMask,
+            magma::ImageMemoryBarrier(physical.image, barrier.oldLayout, barrier.newLayout,
+                subresourceRange(images[physical.desc].depth, images[physical.desc].stencil)));
+    }
+    if (dependency.dstStageMask)
+    {
+        cmdBuffer->pipelineBarrier(dependency.srcStageMask, dependency.dstStageMask,
+            magma::MemoryBarrier(dependency.srcAccessMask, dependency.dstAccessMask));
+    }
+}
@@ -0,0 +1,179 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "magma/magma.h"
+
+/* Render graph for samples that render to textures before drawing to swapchain.
+   Passes declare images they write as attachments, resolve into, sample
+   in shaders or copy from/to; graph owns images, render passes and framebuffers.
+   Compilation:
+   1) Images that are not exported share physical image with other image
+      of the same description if their lifetimes (first to last using pass)
+      don't overlap.
+   2) Layout and last access of each physical image are tracked through passes.
+      Image barrier is inserted only where layout changes, the rest of hazards
+      before pass are merged into single memory barrier, read after read
+      needs nothing. Render passes themselves don't change layouts.
+   3) Attachments that are written and consumed by single pass are never
+      stored. If device has lazily allocated memory type, they are created
+      as transient attachments, so that tiler may keep them on chip and
+      never commit their memory; otherwise they are regular attachments.
+      Transient attachment is placed in lazily allocated memory only if its
+      memory requirements allow that type, otherwise in device local one.
+   4) Graph is recorded into command buffer of frame, so that offscreen
+      passes don't need their own submission and semaphore.
+   Graph is assumed to be recorded once per frame, so hazards with uses
+   of the previous frame are taken into account as well. Contents of
+   images don't survive between frames: the first use of image in frame
+   should write it. */
+class RenderGraph
+{
+public:
+    typedef uint32_t Resource;
+    class Pass;
+    // Should begin and end render pass of graphics pass
+    typedef std::function<void(std::shared_ptr<magma::CommandBuffer>, const Pass&)> RecordFunc;
+
+    struct Statistics
+    {
+        uint32_t passCount = 0;
+        uint32_t imageCount = 0;
+        uint32_t physicalImageCount = 0;
+        uint32_t barrierCount = 0; // Per recording
+        uint32_t transientImageCount = 0;
+        uint32_t lazilyAllocatedImageCount = 0; // Transient images placed in lazily allocated memory
+        VkDeviceSize lazilyAllocatedMemorySize = 0; // Not committed until tiler spills attachments
+        bool lazilyAllocated = false; // Device has lazily allocated memory type
+    };
+
+    class Pass
+    {
+    public:
+        // Attachments are bound in order: colors, depth, resolves
+        Pass& writeColor(Resource image, bool clear = true);
+        Pass& writeDepth(Resource image, bool clear = true);
+        // Color attachment of the same index is resolved into image in the end of render pass
+        Pass& resolve(Resource image);
+        Pass& sample(Resource image);
+        Pass& copyFrom(Resource image);
+        Pass& copyTo(Resource image);
+        const std::string& getName() const noexcept { return name; }
+        // Null if pass doesn't have attachments
+        const std::shared_ptr<magma::RenderPass>& getRenderPass() const noexcept { return renderPass; }
+        const std::shared_ptr<magma::Framebuffer>& getFramebuffer() const noexcept { return framebuffer; }
+
+    private:
+        friend class RenderGraph;
+        enum class Usage
+        {
+            Color, Depth, Resolve, Sampled, TransferSrc, TransferDst
+        };
+
+        struct Use
+        {
+            Resource image;
+            Usage usage;
+            bool clear;
+        };
+
+        struct ImageBarrier
+        {
+            uint32_t physicalImage;
+            VkImageLayout oldLayout;
+            VkImageLayout newLayout;
+            VkPipelineStageFlags srcStageMask;
+            VkPipelineStageFlags dstStageMask;
+        };
+
+        struct Dependency
+        {
+            VkPipelineStageFlags srcStageMask = 0;
+            VkPipelineStageFlags dstStageMask = 0;
+            VkAccessFlags srcAccessMask = 0;
+            VkAccessFlags dstAccessMask = 0;
+        };
+
+        Pass(RenderGraph *graph, const char *name, RecordFunc record);
+        Pass& use(Resource image, Usage usage, bool clear);
+
+        RenderGraph *graph;
+        const std::string name;
+        const RecordFunc record;
+        std::vector<Use> uses;
+        std::vector<ImageBarrier> imageBarriers;
+        Dependency dependency; // Hazards that don't need layout transition
+        std::shared_ptr<magma::RenderPass> renderPass;
+        std::shared_ptr<magma::Framebuffer> framebuffer;
+    };
+
+    explicit RenderGraph(std::shared_ptr<magma::Device> device);
+    Resource createImage(const char *name, VkFormat format, const VkExtent2D& extent, uint32_t samples = 1);
+    // Image is used after graph in given layout, e.g. sampled by onscreen pass
+    void exportImage(Resource image, VkImageLayout layout, VkPipelineStageFlags stageMask, VkAccessFlags accessMask);
+    Pass& addPass(const char *name, RecordFunc record);
+    // Creates images, render passes and framebuffers and computes barriers
+    void compile();
+    void record(std::shared_ptr<magma::CommandBuffer> cmdBuffer) const;
+    // Valid after compilation
+    std::shared_ptr<magma::Image> getImage(Resource image) const;
+    std::shared_ptr<magma::ImageView> getImageView(Resource image) const;
+    const Statistics& getStatistics() const noexcept { return stats; }
+
+private:
+    struct Image
+    {
+        std::string name;
+        VkFormat format;
+        VkExtent2D extent;
+        uint32_t samples;
+        bool depth;
+        bool stencil;
+        bool sampled = false;
+        bool transfer = false;
+        bool exported = false;
+        bool transient = false;
+        VkImageLayout exportLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags exportStageMask = 0;
+        VkAccessFlags exportAccessMask = 0;
+        uint32_t firstPass = ~0u;
+        uint32_t lastPass = 0;
+        uint32_t physicalImage = ~0u;
+    };
+
+    struct PhysicalImage
+    {
+        Resource desc; // The first image placed here
+        std::shared_ptr<magma::Image> image;
+        std::shared_ptr<magma::ImageView> view;
+        uint32_t lastPass;
+    };
+
+    struct State
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkPipelineStageFlags stageMask = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        VkAccessFlags accessMask = 0;
+        bool written = false;
+    };
+
+    void computeLifetimes();
+    void allocateImages();
+    void createRenderPass(Pass& pass, uint32_t passIndex);
+    void trackStates(std::vector<State>& states, bool emit);
+    bool isStored(Resource image, uint32_t passIndex) const noexcept;
+    uint32_t getPhysicalImage(Resource image) const;
+    void recordBarriers(std::shared_ptr<magma::CommandBuffer> cmdBuffer,
+        const std::vector<Pass::ImageBarrier>& imageBarriers, const Pass::Dependency& dependency) const;
+
+    std::shared_ptr<magma::Device> device;
+    std::vector<Image> images;
+    std::vector<PhysicalImage> physicalImages;
+    std::vector<std::unique_ptr<Pass>> passes;
+    std::vector<Pass::ImageBarrier> exportBarriers;
+    Pass::Dependency exportDependency;
+    Statistics stats;
+    bool compiled = false;
+};
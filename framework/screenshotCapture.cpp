@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include "screenshotCapture.h"
+#include "threadPool.h"
+
+namespace
+{
+uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0) noexcept
+{
+    static uint32_t table[256];
+    static const bool initialized = []()
+    {
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k)
+                c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return true;
+    }();
+    (void)initialized;
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void putBigEndian(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+void writeChunk(std::ofstream& file, const char type[4], const std::vector<uint8_t>& data)
+{
+    std::vector<uint8_t> chunk;
+    chunk.reserve(data.size() + 12);
+    putBigEndian(chunk, static_cast<uint32_t>(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    // CRC covers type and data
+    putBigEndian(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+    file.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+}
+
+/* Image data is stored in uncompressed deflate blocks, as encoding
+   should keep up with capture rate rather than produce small files. */
+void writePng(std::ofstream& file, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height)
+{
+    constexpr uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    file.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+    std::vector<uint8_t> header;
+    putBigEndian(header, width);
+    putBigEndian(header, height);
+    header.push_back(8); // Bit depth
+    header.push_back(6); // Truecolor with alpha
+    header.push_back(0); // Deflate
+    header.push_back(0); // Adaptive filtering
+    header.push_back(0); // No interlace
+    writeChunk(file, "IHDR", header);
+    // Each scanline is prefixed by filter type
+    const size_t rowSize = width * 4;
+    std::vector<uint8_t> scanlines;
+    scanlines.reserve((rowSize + 1) * height);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        scanlines.push_back(0); // No filter
+        scanlines.insert(scanlines.end(), rgba.begin() + y * rowSize, rgba.begin() + (y + 1) * rowSize);
+    }
+    constexpr size_t maxBlockSize = 65535;
+    std::vector<uint8_t> zlib;
+    zlib.reserve(scanlines.size() + scanlines.size()/maxBlockSize * 5 + 11);
+    zlib.push_back(0x78); // Deflate with 32K window
+    zlib.push_back(0x01); // No preset dictionary, fastest compression
+    uint32_t a = 1, b = 0; // Adler-32
+    for (size_t offset = 0; offset < scanlines.size(); offset += maxBlockSize)
+    {
+        const size_t size = std::min(maxBlockSize, scanlines.size() - offset);
+        const bool final = (offset + size == scanlines.size());
+        zlib.push_back(final ? 1 : 0); // Stored block
+        zlib.push_back(static_cast<uint8_t>(size));
+        zlib.push_back(static_cast<uint8_t>(size >> 8));
+        zlib.push_back(static_cast<uint8_t>(~size));
+        zlib.push_back(static_cast<uint8_t>(~size >> 8));
+        zlib.insert(zlib.end(), scanlines.begin() + offset, scanlines.begin() + offset + size);
+        for (size_t i = offset; i < offset + size; ++i)
+        {
+            a = (a + scanlines[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    putBigEndian(zlib, (b << 16) | a);
+    writeChunk(file, "IDAT", zlib);
+    writeChunk(file, "IEND", {});
+}
+
+void writePpm(std::ofstream& file, const std::vector<uint8_t>& rgba, uint32_t width, uint32_t height)
+{
+    file << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<uint8_t> rgb(width * height * 3);
+    for (size_t i = 0, j = 0; i < rgb.size(); i += 3, j += 4)
+    {
+        rgb[i] = rgba[j];
+        rgb[i + 1] = rgba[j + 1];
+        rgb[i + 2] = rgba[j + 2];
+    }
+    file.write(reinterpret_cast<const char *>(rgb.data()), rgb.size());
+}
+
+bool hasExtension(const std::string& filename, const char *extension)
+{
+    const std::string ext(extension);
+    if (filename.length() < ext.length())
+        return false;
+    return std::equal(ext.begin(), ext.end(), filename.end() - ext.length(),
+        [](char a, char b) { return a == std::tolower(b); });
+}
+} // namespace
+
+ScreenshotCapture::ScreenshotCapture(std::shared_ptr<magma::Device> device, std::shared_ptr<magma::CommandPool> cmdPool,
+    VkFormat format, const VkExtent2D& extent, uint32_t frameCount /* 3 */, uint32_t maxBufferCount /* 8 */):
+    device(std::move(device)),
+    cmdPool(std::move(cmdPool)),
+    extent(extent),
+    bgra((VK_FORMAT_B8G8R8A8_UNORM == format) || (VK_FORMAT_B8G8R8A8_SRGB == format)),
+    frameCount(std::max(frameCount, 1U)),
+    maxBufferCount(std::max(maxBufferCount, 1U)),
+    writer(std::make_unique<ThreadPool>(1)) // Files are written in order of capture
+{
+    switch (format)
+    {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        break;
+    default:
+        throw std::invalid_argument("unsupported format of screenshot");
+    }
+}
+
+ScreenshotCapture::~ScreenshotCapture()
+{   // Complete captures in flight
+    for (auto& readback : buffers)
+    {
+        if (State::Copying == readback->state)
+        {
+            readback->fence->wait();
+            readback->state = State::Writing;
+            ReadbackBuffer *pending = readback.get();
+            readback->written = writer->submit([this, pending]() { write(*pending); });
+        }
+    }
+    for (auto& readback : buffers)
+    {
+        if (State::Writing == readback->state)
+            retire(*readback);
+    }
+}
+
+std::shared_ptr<magma::Semaphore> ScreenshotCapture::capture(std::shared_ptr<magma::Queue> queue,
+    std::shared_ptr<magma::Image> image, std::shared_ptr<magma::Semaphore> renderFinished, const std::string& filename)
+{
+    ReadbackBuffer *readback = acquireBuffer();
+    if (!readback)
+    {
+        ++rejectedCount;
+        return nullptr;
+    }
+    VkImageSubresourceRange subresourceRange;
+    subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    subresourceRange.baseMipLevel = 0;
+    subresourceRange.levelCount = 1;
+    subresourceRange.baseArrayLayer = 0;
+    subresourceRange.layerCount = 1;
+    VkBufferImageCopy region;
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0; // Tightly packed
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = VkOffset3D{0, 0, 0};
+    region.imageExtent = VkExtent3D{extent.width, extent.height, 1};
+    std::shared_ptr<magma::CommandBuffer> cmdBuffer = readback->cmdBuffer;
+    cmdBuffer->begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    {   // Semaphore wait makes rendering visible to transfer stage
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            magma::ImageMemoryBarrier(image,
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                subresourceRange));
+        cmdBuffer->copyImageToBuffer(image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback->buffer, {region});
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            magma::ImageMemoryBarrier(image,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                subresourceRange));
+        cmdBuffer->pipelineBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            magma::BufferMemoryBarrier(readback->buffer, magma::barrier::transferWriteHostRead));
+    }
+    cmdBuffer->end();
+    readback->fence->reset();
+    queue->submit(cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        std::move(renderFinished), // Wait for rendering
+        readback->semaphore, // Signal when image can be presented
+        readback->fence);
+    readback->state = State::Copying;
+    readback->frameIndex = frameIndex;
+    readback->filename = filename;
+    return readback->semaphore;
+}
+
+void ScreenshotCapture::update()
+{
+    ++frameIndex;
+    for (auto& readback : buffers)
+    {
+        if ((State::Copying == readback->state) && (frameIndex >= readback->frameIndex + frameCount))
+        {   // Copy has been completed long ago, so fence doesn't block
+            readback->fence->wait();
+            readback->state = State::Writing;
+            ReadbackBuffer *pending = readback.get();
+            readback->written = writer->submit([this, pending]() { write(*pending); });
+        }
+        else if ((State::Writing == readback->state) &&
+            (readback->written.wait_for(std::chrono::seconds(0)) == std::future_status::ready))
+        {
+            retire(*readback);
+        }
+    }
+}
+
+uint32_t ScreenshotCapture::getPendingCount() const noexcept
+{
+    return static_cast<uint32_t>(std::count_if(buffers.begin(), buffers.end(),
+        [](const std::unique_ptr<ReadbackBuffer>& readback) { return readback->state != State::Free; }));
+}
+
+ScreenshotCapture::ReadbackBuffer *ScreenshotCapture::acquireBuffer()
+{
+    for (auto& readback : buffers)
+    {
+        if (State::Free == readback->state)
+            return readback.get();
+    }
+    if (buffers.size() >= maxBufferCount)
+        return nullptr;
+    std::unique_ptr<ReadbackBuffer> readback = std::make_unique<ReadbackBuffer>();
+    readback->buffer = std::make_shared<magma::DstTransferBuffer>(device, extent.width * extent.height * 4);
+    readback->cmdBuffer = std::make_shared<magma::PrimaryCommandBuffer>(cmdPool);
+    readback->semaphore = std::make_shared<magma::Semaphore>(device);
+    readback->fence = std::make_shared<magma::Fence>(device);
+    buffers.push_back(std::move(readback));
+    return buffers.back().get();
+}
+
+void ScreenshotCapture::write(ReadbackBuffer& readback)
+{   // Executed by worker thread, buffer isn't touched by render loop until it is retired
+    std::vector<uint8_t> rgba(extent.width * extent.height * 4);
+    magma::helpers::mapScoped<uint8_t>(readback.buffer,
+        [this, &rgba](uint8_t *pixels)
+        {
+            for (size_t i = 0; i < rgba.size(); i += 4)
+            {
+                rgba[i] = bgra ? pixels[i + 2] : pixels[i];
+                rgba[i + 1] = pixels[i + 1];
+                rgba[i + 2] = bgra ? pixels[i] : pixels[i + 2];
+                rgba[i + 3] = 255; // Presented image is opaque
+            }
+        });
+    std::ofstream file(readback.filename, std::ios::out | std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("failed to open file \"" + readback.filename + "\"");
+    if (hasExtension(readback.filename, ".ppm"))
+        writePpm(file, rgba, extent.width, extent.height);
+    else
+        writePng(file, rgba, extent.width, extent.height);
+    if (!file.good())
+        throw std::runtime_error("failed to write file \"" + readback.filename + "\"");
+}
+
+void ScreenshotCapture::retire(ReadbackBuffer& readback)
+{
+    try
+    {
+        readback.written.get();
+        ++capturedCount;
+        std::cout << "Screenshot saved to " << readback.filename << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << e.what() << std::endl;
+    }
+    readback.state = State::Free;
+}
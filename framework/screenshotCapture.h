@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "magma/magma.h"
+
+class ThreadPool;
+
+/* Captures presented swapchain images without stalling render loop.
+   Copy of image into host-visible readback buffer is submitted between
+   rendering and presentation, and buffer is mapped frameCount frames
+   later, when copy has long been completed. Conversion to RGBA and
+   encoding to PNG or PPM (chosen by file extension) are performed by
+   worker thread. Each capture occupies its readback buffer until file
+   is written; new buffers are created if all of them are busy, so that
+   every requested frame is captured up to maxBufferCount captures in flight. */
+class ScreenshotCapture
+{
+public:
+    // Only 8-bit RGBA and BGRA formats are supported
+    explicit ScreenshotCapture(std::shared_ptr<magma::Device> device,
+        std::shared_ptr<magma::CommandPool> cmdPool,
+        VkFormat format,
+        const VkExtent2D& extent,
+        uint32_t frameCount = 3,
+        uint32_t maxBufferCount = 8);
+    ~ScreenshotCapture();
+    /* Submits copy of swapchain image in present layout, which waits for
+       rendering semaphore. Returns semaphore that presentation should wait
+       for instead, or null if there are too many captures in flight. */
+    std::shared_ptr<magma::Semaphore> capture(std::shared_ptr<magma::Queue> queue,
+        std::shared_ptr<magma::Image> image,
+        std::shared_ptr<magma::Semaphore> renderFinished,
+        const std::string& filename);
+    // Should be called once per frame, hands completed copies to worker thread
+    void update();
+    uint32_t getBufferCount() const noexcept { return static_cast<uint32_t>(buffers.size()); }
+    uint32_t getPendingCount() const noexcept;
+    uint64_t getCapturedCount() const noexcept { return capturedCount; }
+    uint64_t getRejectedCount() const noexcept { return rejectedCount; }
+
+private:
+    enum class State
+    {
+        Free, Copying, Writing
+    };
+
+    struct ReadbackBuffer
+    {
+        std::shared_ptr<magma::DstTransferBuffer> buffer;
+        std::shared_ptr<magma::CommandBuffer> cmdBuffer;
+        std::shared_ptr<magma::Semaphore> semaphore;
+        std::shared_ptr<magma::Fence> fence;
+        State state = State::Free;
+        uint64_t frameIndex = 0; // When copy was submitted
+        std::string filename;
+        std::future<void> written;
+    };
+
+    ReadbackBuffer *acquireBuffer();
+    void write(ReadbackBuffer& readback);
+    void retire(ReadbackBuffer& readback);
+
+    std::shared_ptr<magma::Device> device;
+    std::shared_ptr<magma::CommandPool> cmdPool;
+    const VkExtent2D extent;
+    const bool bgra;
+    const uint32_t frameCount;
+    const uint32_t maxBufferCount;
+    std::vector<std::unique_ptr<ReadbackBuffer>> buffers;
+    std::unique_ptr<ThreadPool> writer;
+    uint64_t frameIndex = 0;
+    uint64_t capturedCount = 0;
+    uint64_t rejectedCount = 0;
+};
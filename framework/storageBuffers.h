@@ -0,0 +1,30 @@
+#pragma once
+#include "magma/magma.h"
+
+/* Device local buffers that are written by compute shaders and then consumed
+   by fixed-function stages. Buffer classes of magma have fixed usage flags,
+   so storage usage is combined here with vertex or indirect usage. */
+class StorageVertexBuffer : public magma::Buffer
+{
+public:
+    explicit StorageVertexBuffer(std::shared_ptr<magma::Device> device, VkDeviceSize size):
+        magma::Buffer(std::move(device), size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            magma::Buffer::Descriptor(), magma::Sharing(), nullptr)
+    {}
+};
+
+/* Transfer destination, so that draw command can be reset with vkCmdUpdateBuffer,
+   and source, so that counters written by shader can be read back. */
+class StorageIndirectBuffer : public magma::Buffer
+{
+public:
+    explicit StorageIndirectBuffer(std::shared_ptr<magma::Device> device, VkDeviceSize size):
+        magma::Buffer(std::move(device), size,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+            magma::Buffer::Descriptor(), magma::Sharing(), nullptr)
+    {}
+};
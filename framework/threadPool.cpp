@@ -0,0 +1,56 @@
+#include <algorithm>
+#include "threadPool.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount /* std::thread::hardware_concurrency() */):
+    stop(false)
+{
+    threadCount = std::max(1U, threadCount);
+    workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i)
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(queueAccess);
+        stop = true;
+    }
+    hasTasks.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t first, uint32_t last)>& func)
+{
+    if (!count)
+        return;
+    const uint32_t taskCount = std::min(count, getThreadCount());
+    const uint32_t rangeSize = (count + taskCount - 1)/taskCount;
+    std::vector<std::future<void>> results;
+    results.reserve(taskCount);
+    for (uint32_t first = 0; first < count; first += rangeSize)
+    {
+        const uint32_t last = std::min(first + rangeSize, count);
+        results.push_back(submit([&func, first, last]() { func(first, last); }));
+    }
+    for (auto& result : results)
+        result.get(); // Rethrows exception if task failed
+}
+
+void ThreadPool::workerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queueAccess);
+            hasTasks.wait(lock, [this]() { return stop || !tasks.empty(); });
+            if (stop && tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
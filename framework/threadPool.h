@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+/* Fixed-size pool of worker threads for CPU-side preprocessing
+   (texture filtering, mesh generation, sorting etc.).
+   Tasks are executed in FIFO order, exceptions are propagated
+   to the caller through std::future. */
+class ThreadPool
+{
+public:
+    explicit ThreadPool(uint32_t threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+    uint32_t getThreadCount() const noexcept { return static_cast<uint32_t>(workers.size()); }
+    template<typename Func>
+    std::future<void> submit(Func&& func);
+    // Splits [0, count) into contiguous ranges and waits for completion of all of them
+    void parallelFor(uint32_t count, const std::function<void(uint32_t first, uint32_t last)>& func);
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queueAccess;
+    std::condition_variable hasTasks;
+    bool stop;
+};
+
+template<typename Func>
+inline std::future<void> ThreadPool::submit(Func&& func)
+{
+    auto task = std::make_shared<std::packaged_task<void()>>(std::forward<Func>(func));
+    std::future<void> result = task->get_future();
+    {
+        std::lock_guard<std::mutex> guard(queueAccess);
+        tasks.emplace([task]() { (*task)(); });
+    }
+    hasTasks.notify_one();
+    return result;
+}
@@ -1,3 +1,4 @@
+#include <cstdio>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -23,6 +24,35 @@ aligned_vector<char> loadBinaryFile(const std::string& filename)
     return binary;
 }
 
+uint64_t hashFnv1a(const void *data, size_t size, uint64_t seed /* 14695981039346656037 */) noexcept
+{
+    constexpr uint64_t prime = 1099511628211ull;
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= prime;
+    }
+    return hash;
+}
+
+bool writeCacheFile(const std::string& filename, const std::function<void(std::ostream&)>& write)
+{
+    std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (file.is_open())
+    {
+        write(file);
+        file.close();
+        if (!file.fail())
+            return true;
+        // Don't leave truncated file behind
+        std::remove(filename.c_str());
+    }
+    std::cerr << "failed to write cache \"" << filename << "\"" << std::endl;
+    return false;
+}
+
 VkFormat getBlockCompressedFormat(const gliml::context& ctx)
 {
     const int internalFormat = ctx.image_internal_format();
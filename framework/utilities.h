@@ -1,6 +1,9 @@
 #pragma once
 #include <memory>
 #include <vector>
+#include <string>
+#include <functional>
+#include <iosfwd>
 #include <cassert>
 
 #ifdef _WIN32
@@ -22,6 +25,11 @@ namespace magma
 namespace utilities
 {
     aligned_vector<char> loadBinaryFile(const std::string& filename);
+    uint64_t hashFnv1a(const void *data, size_t size, uint64_t seed = 14695981039346656037ull) noexcept;
+    /* Writes file of data cached between runs. Failure is reported, but
+       not thrown, as data is generated again next run; file is removed
+       if it couldn't be written completely. Returns false on failure. */
+    bool writeCacheFile(const std::string& filename, const std::function<void(std::ostream&)>& write);
 
     VkFormat getBlockCompressedFormat(const gliml::context& ctx);
     VkFormat getSupportedDepthFormat(std::shared_ptr<magma::PhysicalDevice> physicalDevice,
@@ -1,6 +1,7 @@
 #include "vulkanApp.h"
 #include "linearAllocator.h"
 #include "utilities.h"
+#include "screenshotCapture.h"
 
 VulkanApp::VulkanApp(const AppEntry& entry, const std::tstring& caption, uint32_t width, uint32_t height,
     bool depthBuffer /* false */):
@@ -9,6 +10,8 @@ VulkanApp::VulkanApp(const AppEntry& entry, const std::tstring& caption, uint32_
     vSync(false),
     depthBuffer(depthBuffer),
     negateViewport(false),
+    multiDrawIndirect(false),
+    screenshotRequested(false),
     waitMethod(WaitMethod::Fence),
     frameIndex(0)
 {
@@ -42,7 +45,15 @@ void VulkanApp::onPaint()
         waitFences[bufferIndex]->reset();
     }
     render(bufferIndex);
-    graphicsQueue->present(swapchain, bufferIndex, renderFinished);
+    std::shared_ptr<magma::Semaphore> presentWait = renderFinished;
+    if (screenshotRequested)
+    {
+        presentWait = captureScreenshot(bufferIndex);
+        screenshotRequested = false;
+    }
+    graphicsQueue->present(swapchain, bufferIndex, presentWait);
+    if (screenshotCapture)
+        screenshotCapture->update();
     if (WaitMethod::Queue == waitMethod)
         graphicsQueue->waitIdle();
     else if (WaitMethod::Device == waitMethod)
@@ -57,6 +68,13 @@ void VulkanApp::onPaint()
     ++frameIndex;
 }
 
+void VulkanApp::onKeyDown(char key, int repeat, uint32_t flags)
+{
+    if (('P' == key) || ('p' == key))
+        screenshotRequested = true;
+    NativeApp::onKeyDown(key, repeat, flags);
+}
+
 void VulkanApp::initialize()
 {
     createInstance();
@@ -145,6 +163,9 @@ void VulkanApp::createLogicalDevice()
     features.samplerAnisotropy = VK_TRUE;
     features.textureCompressionBC = VK_TRUE;
     features.occlusionQueryPrecise = VK_TRUE;
+    // Without this feature, indirect draw count must be 0 or 1
+    multiDrawIndirect = physicalDevice->getFeatures().multiDrawIndirect;
+    features.multiDrawIndirect = multiDrawIndirect ? VK_TRUE : VK_FALSE;
 
     std::vector<const char*> enabledExtensions;
     enabledExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
@@ -312,7 +333,7 @@ void VulkanApp::createSyncPrimitives()
 
 void VulkanApp::createDescriptorPool()
 {
-    constexpr uint32_t maxDescriptorSets = 2;
+    constexpr uint32_t maxDescriptorSets = 4;
     // Create descriptor pool enough for basic samples
     descriptorPool = std::make_shared<magma::DescriptorPool>(device, maxDescriptorSets,
         std::vector<magma::descriptor::DescriptorPool>{
@@ -347,6 +368,30 @@ void VulkanApp::submitCopyImageCommands()
     waitFences[0]->wait();
 }
 
+std::shared_ptr<magma::Semaphore> VulkanApp::captureScreenshot(uint32_t bufferIndex)
+{
+    try
+    {
+        if (!screenshotCapture)
+        {
+            const std::vector<VkSurfaceFormatKHR> surfaceFormats = physicalDevice->getSurfaceFormats(surface);
+            screenshotCapture = std::make_unique<ScreenshotCapture>(device, commandPools[0],
+                surfaceFormats[0].format, VkExtent2D{width, height});
+        }
+        const std::string filename = "screenshot" + std::to_string(frameIndex) + ".png";
+        std::shared_ptr<magma::Semaphore> captureFinished = screenshotCapture->capture(graphicsQueue,
+            swapchain->getImages()[bufferIndex], renderFinished, filename);
+        if (captureFinished)
+            return captureFinished;
+        std::cout << "Too many screenshots in flight" << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cout << e.what() << std::endl;
+    }
+    return renderFinished;
+}
+
 void VulkanApp::submitCopyBufferCommands()
 {
     waitFences[1]->reset();
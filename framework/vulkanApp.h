@@ -20,6 +20,8 @@ typedef XlibApp NativeApp;
 typedef XcbApp NativeApp;
 #endif // VK_USE_PLATFORM_XCB_KHR
 
+class ScreenshotCapture;
+
 class VulkanApp : public NativeApp
 {
 protected:
@@ -41,6 +43,8 @@ public:
     virtual void render(uint32_t bufferIndex) = 0;
     virtual void onIdle() override;
     virtual void onPaint() override;
+    // 'P' saves screenshot of the next presented frame
+    virtual void onKeyDown(char key, int repeat, uint32_t flags) override;
 
 protected:
     virtual void initialize();
@@ -57,6 +61,8 @@ protected:
     void submitCommandBuffer(uint32_t bufferIndex);
     void submitCopyImageCommands();
     void submitCopyBufferCommands();
+    // Returns semaphore that presentation should wait for
+    std::shared_ptr<magma::Semaphore> captureScreenshot(uint32_t bufferIndex);
 
     std::shared_ptr<magma::Instance> instance;
     std::shared_ptr<magma::DebugReportCallback> debugReportCallback;
@@ -87,9 +93,12 @@ protected:
 
     std::shared_ptr<ShaderReflectionFactory> shaderReflectionFactory;
     std::unique_ptr<Timer> timer;
+    std::unique_ptr<ScreenshotCapture> screenshotCapture;
+    bool screenshotRequested;
     bool vSync;
     bool depthBuffer;
     bool negateViewport;
+    bool multiDrawIndirect;
     WaitMethod waitMethod;
     uint32_t frameIndex;
 };